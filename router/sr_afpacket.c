@@ -0,0 +1,636 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_afpacket.c
+ *
+ * Description:
+ *
+ * AF_PACKET TPACKET_V3 transport, see sr_afpacket.h.  Linux only;
+ * elsewhere opening it fails.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "sr_afpacket.h"
+#include "sr_transport.h"
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_timer.h"
+
+#ifdef _LINUX_
+
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <ifaddrs.h>
+#include <linux/if_packet.h>
+#include <linux/if_ether.h>
+
+#ifndef PACKET_IGNORE_OUTGOING
+#define PACKET_IGNORE_OUTGOING 23
+#endif
+
+#define SR_AFP_RING_BYTES (SR_AFP_BLOCK_SIZE * SR_AFP_BLOCK_NR)
+
+static struct sr_afpacket* sr_afp(struct sr_instance* sr)
+{ return (struct sr_afpacket*)sr->transport_priv; }
+
+/*---------------------------------------------------------------------
+ * Method: sr_afp_kernel_if(..)
+ * Scope:  Global
+ *
+ * Look up the kernel's index, MAC, IPv4 address and mask for interface
+ * name.  Returns 0 on success, 1 if it is not Ethernet or has no IPv4
+ * address, -1 if there is no such interface.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_afp_kernel_if(const char* name, struct sr_kif* kif)
+{
+    struct ifreq ifr;
+    int fd;
+    int ret = 1;
+
+    if(strlen(name) >= sr_IFACE_NAMELEN || strlen(name) >= IFNAMSIZ)
+    {
+        fprintf(stderr, "interface name %s too long\n", name);
+        return -1;
+    }
+    fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+
+    memset(&ifr, 0, sizeof(ifr));
+    strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+    if(ioctl(fd, SIOCGIFINDEX, &ifr) != 0)
+    {
+        fprintf(stderr, "no interface %s\n", name);
+        close(fd);
+        return -1;
+    }
+    kif->os_ifindex = ifr.ifr_ifindex;
+
+    if(ioctl(fd, SIOCGIFHWADDR, &ifr) == 0 &&
+       ifr.ifr_hwaddr.sa_family == ARPHRD_ETHER)
+    {
+        memcpy(kif->addr, ifr.ifr_hwaddr.sa_data, ETHER_ADDR_LEN);
+        ifr.ifr_addr.sa_family = AF_INET;
+        if(ioctl(fd, SIOCGIFADDR, &ifr) == 0)
+        {
+            kif->ip = ((struct sockaddr_in*)&(ifr.ifr_addr))->sin_addr.s_addr;
+            if(ioctl(fd, SIOCGIFNETMASK, &ifr) == 0)
+            {
+                kif->mask = ((struct sockaddr_in*)&(ifr.ifr_netmask))->sin_addr.s_addr;
+                ret = 0;
+            }
+        }
+    }
+    close(fd);
+    return ret;
+} /* -- sr_afp_kernel_if -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_afp_if_names(..)
+ * Scope:  Global
+ *
+ * Split arg, a comma separated list of interfaces, into names; with no
+ * arg list every non-loopback interface that is up instead.  Returns
+ * the number of names, -1 on error.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_afp_if_names(const char* arg, char names[][sr_IFACE_NAMELEN],
+                    unsigned int max)
+{
+    struct ifaddrs* ifa_list = 0;
+    struct ifaddrs* ifa;
+    char list[256];
+    char* name;
+    char* save = 0;
+    unsigned int n = 0;
+
+    if(arg && *arg)
+    {
+        strncpy(list, arg, sizeof(list) - 1);
+        list[sizeof(list) - 1] = 0;
+        for(name = strtok_r(list, ",", &save); name;
+            name = strtok_r(0, ",", &save))
+        {
+            if(n == max || strlen(name) >= sr_IFACE_NAMELEN)
+            {
+                fprintf(stderr, "too many interfaces, or %s too long\n", name);
+                return -1;
+            }
+            strcpy(names[n++], name);
+        }
+        return n;
+    }
+
+    if(getifaddrs(&ifa_list) != 0)
+    {
+        perror("getifaddrs");
+        return -1;
+    }
+    for(ifa = ifa_list; ifa && n < max; ifa = ifa->ifa_next)
+    {
+        /* -- one AF_PACKET entry per interface -- */
+        if(ifa->ifa_addr == 0 || ifa->ifa_addr->sa_family != AF_PACKET ||
+           (ifa->ifa_flags & IFF_LOOPBACK) || !(ifa->ifa_flags & IFF_UP) ||
+           strlen(ifa->ifa_name) >= sr_IFACE_NAMELEN)
+        { continue; }
+        strcpy(names[n++], ifa->ifa_name);
+    }
+    freeifaddrs(ifa_list);
+    return n;
+} /* -- sr_afp_if_names -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_afp_open_if(..)
+ * Scope:  Local
+ *
+ * Open the socket and receive ring for interface kif and append it to
+ * sr->if_list.  Returns 0 on success, -1 on error.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_afp_open_if(struct sr_instance* sr, struct sr_afpacket* afp,
+                          const char* name, struct sr_kif* kif)
+{
+    struct sr_afp_if* aif = &(afp->ifs[afp->nifs]);
+    struct tpacket_req3 req;
+    struct sockaddr_ll sll;
+    struct epoll_event ev;
+    int version = TPACKET_V3;
+    int one = 1;
+
+    aif->fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, htons(ETH_P_ALL));
+    if(aif->fd < 0)
+    {
+        perror("socket(AF_PACKET)");
+        return -1;
+    }
+    aif->ring = 0;
+    aif->block = 0;
+    aif->os_ifindex = kif->os_ifindex;
+    strncpy(aif->name, name, sr_IFACE_NAMELEN);
+
+    /* -- receive ring: the kernel hands over whole blocks of frames -- */
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size     = SR_AFP_BLOCK_SIZE;
+    req.tp_block_nr       = SR_AFP_BLOCK_NR;
+    req.tp_frame_size     = SR_AFP_FRAME_SIZE;
+    req.tp_frame_nr       = SR_AFP_RING_BYTES / SR_AFP_FRAME_SIZE;
+    req.tp_retire_blk_tov = SR_AFP_BLOCK_TOV_MS;
+    if(setsockopt(aif->fd, SOL_PACKET, PACKET_VERSION,
+                  &version, sizeof(version)) != 0 ||
+       setsockopt(aif->fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) != 0)
+    {
+        perror("setsockopt(PACKET_RX_RING)");
+        goto fail;
+    }
+    aif->ring = (uint8_t*)mmap(0, SR_AFP_RING_BYTES, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_LOCKED, aif->fd, 0);
+    if(aif->ring == MAP_FAILED)
+    {
+        /* -- without the privilege to lock it -- */
+        aif->ring = (uint8_t*)mmap(0, SR_AFP_RING_BYTES, PROT_READ | PROT_WRITE,
+                                   MAP_SHARED, aif->fd, 0);
+    }
+    if(aif->ring == MAP_FAILED)
+    {
+        perror("mmap(PACKET_RX_RING)");
+        aif->ring = 0;
+        goto fail;
+    }
+
+    /* -- our own transmissions are filtered below if this is not known -- */
+    setsockopt(aif->fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one));
+
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family   = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    sll.sll_ifindex  = aif->os_ifindex;
+    if(bind(aif->fd, (struct sockaddr*)&sll, sizeof(sll)) != 0)
+    {
+        perror("bind(AF_PACKET)");
+        goto fail;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = afp->nifs;
+    if(epoll_ctl(afp->epfd, EPOLL_CTL_ADD, aif->fd, &ev) != 0)
+    {
+        perror("epoll_ctl");
+        goto fail;
+    }
+
+    /* -- position in if_list is the index into afp->ifs -- */
+    sr_add_interface(sr, name);
+    sr_set_ether_addr(sr, kif->addr);
+    sr_set_ether_ip(sr, kif->ip);
+    sr_set_ether_mask(sr, kif->mask);
+    sr_add_interface_status(sr, name);
+    afp->nifs++;
+    return 0;
+
+fail:
+    if(aif->ring)
+    { munmap(aif->ring, SR_AFP_RING_BYTES); }
+    close(aif->fd);
+    return -1;
+} /* -- sr_afp_open_if -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_afp_open(..)
+ * Scope:  Local
+ *
+ * arg is a comma separated list of interfaces, or 0 for every
+ * non-loopback interface that is up and has an IPv4 address.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_afp_close(struct sr_instance* sr);
+
+static int sr_afp_open(struct sr_instance* sr, const char* arg)
+{
+    struct sr_afpacket* afp;
+    char names[SR_AFP_MAX_IFS][sr_IFACE_NAMELEN];
+    struct sr_kif kif;
+    int n, i;
+    int ret = 0;
+
+    assert(sr);
+    if(sr->if_list)
+    {
+        fprintf(stderr, "afpacket: interface list already set up\n");
+        return -1;
+    }
+    n = sr_afp_if_names(arg, names, SR_AFP_MAX_IFS);
+    if(n < 0)
+    { return -1; }
+
+    afp = (struct sr_afpacket*)calloc(1, sizeof(struct sr_afpacket));
+    if(afp == 0)
+    { return -1; }
+    afp->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if(afp->epfd < 0)
+    {
+        perror("epoll_create1");
+        free(afp);
+        return -1;
+    }
+    sr->transport_priv = afp;
+    sr->sockfd = afp->epfd;
+
+    for(i = 0; i < n && ret == 0; i++)
+    {
+        ret = sr_afp_kernel_if(names[i], &kif);
+        if(ret == 1 && !(arg && *arg))
+        {
+            /* -- looking for interfaces: skip the ones we cannot route on -- */
+            ret = 0;
+            continue;
+        }
+        if(ret == 1)
+        { fprintf(stderr, "afpacket: %s is not Ethernet with an IPv4 address\n", names[i]); }
+        if(ret == 0)
+        { ret = sr_afp_open_if(sr, afp, names[i], &kif); }
+    }
+
+    if(ret != 0 || afp->nifs == 0)
+    {
+        if(ret == 0)
+        { fprintf(stderr, "afpacket: no usable interfaces\n"); }
+        sr_afp_close(sr);
+        return -1;
+    }
+
+    printf("afpacket: %u interfaces\n", afp->nifs);
+    sr_print_if_list(sr);
+    return 0;
+} /* -- sr_afp_open -- */
+
+static void sr_afp_close(struct sr_instance* sr)
+{
+    struct sr_afpacket* afp = sr_afp(sr);
+    unsigned int i;
+
+    if(afp == 0)
+    { return; }
+
+    for(i = 0; i < afp->nifs; i++)
+    {
+        munmap(afp->ifs[i].ring, SR_AFP_RING_BYTES);
+        close(afp->ifs[i].fd);
+    }
+    close(afp->epfd);
+    free(afp);
+    sr->transport_priv = 0;
+    sr->sockfd = -1;
+}
+
+static void sr_afp_print_stats(struct sr_instance* sr, FILE* out)
+{
+    struct sr_afpacket* afp = sr_afp(sr);
+
+    fprintf(out, "received %lu frames in %lu ring blocks\n",
+            afp ? afp->frames : 0, afp ? afp->blocks : 0);
+    fprintf(out, "sent %lu frames in %lu writes\n",
+            sr->txq.frames, sr->txq.writes);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_afp_poll(..)
+ * Scope:  Local
+ *
+ * Handle every block the kernel has handed over on every interface and
+ * give the blocks back.  Returns the number of frames handled.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int sr_afp_poll(struct sr_instance* sr, struct sr_afpacket* afp)
+{
+    struct sr_afp_if* aif;
+    struct tpacket_block_desc* bd;
+    struct tpacket3_hdr* ppd;
+    struct sockaddr_ll* sll;
+    unsigned int i, n, k, npkts;
+    unsigned int handled = 0;
+
+    for(i = 0; i < afp->nifs; i++)
+    {
+        aif = &(afp->ifs[i]);
+        for(n = 0; n < SR_AFP_BLOCK_NR; n++)
+        {
+            bd = (struct tpacket_block_desc*)
+                 (aif->ring + (size_t)aif->block * SR_AFP_BLOCK_SIZE);
+            if((__atomic_load_n(&(bd->hdr.bh1.block_status), __ATOMIC_ACQUIRE)
+                & TP_STATUS_USER) == 0)
+            { break; }
+
+            npkts = bd->hdr.bh1.num_pkts;
+            ppd = (struct tpacket3_hdr*)((uint8_t*)bd + bd->hdr.bh1.offset_to_first_pkt);
+            for(k = 0; k < npkts; k++)
+            {
+                sll = (struct sockaddr_ll*)((uint8_t*)ppd +
+                                            TPACKET_ALIGN(sizeof(struct tpacket3_hdr)));
+                if(sll->sll_pkttype != PACKET_OUTGOING)
+                {
+                    sr_handlepacket(sr, (uint8_t*)ppd + ppd->tp_mac,
+                                    ppd->tp_snaplen, i);
+                    handled++;
+                }
+                ppd = (struct tpacket3_hdr*)((uint8_t*)ppd + ppd->tp_next_offset);
+            }
+
+            /* -- the frames were only lent, the block goes back -- */
+            __atomic_store_n(&(bd->hdr.bh1.block_status), TP_STATUS_KERNEL,
+                             __ATOMIC_RELEASE);
+            aif->block = (aif->block + 1) % SR_AFP_BLOCK_NR;
+            afp->blocks++;
+        }
+    }
+    afp->frames += handled;
+    return handled;
+} /* -- sr_afp_poll -- */
+
+static int sr_afp_read(struct sr_instance* sr)
+{
+    struct sr_afpacket* afp = sr_afp(sr);
+    struct epoll_event evs[SR_AFP_MAX_IFS];
+    int timeout = sr->event_loop ? 0 : -1; /* the event loop already waited */
+    int n, i;
+
+    while(1)
+    {
+        if(sr_afp_poll(sr, afp))
+        { return 1; }
+
+        n = epoll_wait(afp->epfd, evs, SR_AFP_MAX_IFS, timeout);
+        if(n < 0 && errno == EINTR)
+        { continue; }
+        if(n < 0)
+        {
+            perror("epoll_wait");
+            return -1;
+        }
+        for(i = 0; i < n; i++)
+        {
+            if(evs[i].events & (EPOLLERR | EPOLLHUP))
+            {
+                fprintf(stderr, "afpacket: interface %s went away\n",
+                        afp->ifs[evs[i].data.u32].name);
+                return 0;
+            }
+        }
+        if(sr->event_loop)
+        { return 1; }
+    }
+} /* -- sr_afp_read -- */
+
+/* -- sendmmsg() until all n went or one fails -- */
+static int sr_afp_sendmmsg(struct sr_instance* sr, int fd,
+                           struct mmsghdr* msgs, unsigned int n)
+{
+    int ret;
+
+    while(n)
+    {
+        ret = sendmmsg(fd, msgs, n, 0);
+        if(ret < 0 && errno == EINTR)
+        { continue; }
+        sr->txq.writes++;
+        if(ret <= 0)
+        {
+            perror("sendmmsg(..):sr_afpacket.c::sr_afp_sendmmsg");
+            return -1;
+        }
+        msgs += ret;
+        n -= ret;
+    }
+    return 0;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_afp_flush(..)
+ * Scope:  Local
+ *
+ * Send the queued frames, one sendmmsg() per interface; frames out of
+ * the same interface keep their order.  Caller holds sr->send_lock.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_afp_flush(struct sr_instance* sr)
+{
+    struct sr_afpacket* afp = sr_afp(sr);
+    struct sr_txq* txq = &(sr->txq);
+    struct mmsghdr msgs[SR_AFP_TX_FRAMES];
+    struct iovec iovs[SR_AFP_TX_FRAMES];
+    unsigned int i, k, n;
+    int ret = 0;
+
+    if(txq->nframes == 0)
+    { return 0; }
+
+    memset(msgs, 0, sizeof(msgs));
+    for(i = 0; i < afp->nifs; i++)
+    {
+        n = 0;
+        for(k = 0; k < txq->nframes; k++)
+        {
+            if(afp->tx_if[k] != i)
+            { continue; }
+            iovs[n].iov_base = txq->buf + afp->tx_off[k];
+            iovs[n].iov_len  = afp->tx_len[k];
+            msgs[n].msg_hdr.msg_iov    = &(iovs[n]);
+            msgs[n].msg_hdr.msg_iovlen = 1;
+            n++;
+        }
+        if(n && sr_afp_sendmmsg(sr, afp->ifs[i].fd, msgs, n) != 0)
+        { ret = -1; }
+    }
+
+    txq->frames += txq->nframes;
+    txq->len = 0;
+    txq->nframes = 0;
+    return ret;
+} /* -- sr_afp_flush -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_afp_send(..)
+ * Scope:  Local
+ *
+ * Queue one frame for iface, or send it straight away if it does not
+ * fit the queue.  Caller holds sr->send_lock.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_afp_send(struct sr_instance* sr, uint8_t* buf, unsigned int len,
+                       const char* iface)
+{
+    struct sr_afpacket* afp = sr_afp(sr);
+    struct sr_txq* txq = &(sr->txq);
+    struct sr_if* sr_iface;
+    unsigned int k;
+    uint64_t now;
+    int ret;
+
+    assert(buf);
+    assert(iface);
+
+    if(len < sizeof(struct sr_ethernet_hdr))
+    {
+        fprintf(stderr , "** Error: packet is wayy to short \n");
+        return -1;
+    }
+    sr_iface = sr_get_interface(sr, iface);
+    if(sr_iface == 0 || sr_iface->ifindex >= afp->nifs)
+    {
+        fprintf(stderr, "afpacket: no interface %s\n", iface);
+        return -1;
+    }
+
+    if(txq->buf == 0 || len > SR_TXQ_BYTES)
+    {
+        if(sr_afp_flush(sr) != 0)
+        { return -1; }
+        do
+        { ret = send(afp->ifs[sr_iface->ifindex].fd, buf, len, 0); }
+        while(ret < 0 && errno == EINTR);
+        txq->writes++;
+        txq->frames++;
+        if(ret < 0)
+        {
+            perror("send(..):sr_afpacket.c::sr_afp_send");
+            return -1;
+        }
+        return 0;
+    }
+
+    if((txq->len + len > SR_TXQ_BYTES || txq->nframes == SR_AFP_TX_FRAMES) &&
+       sr_afp_flush(sr) != 0)
+    { return -1; }
+
+    k = txq->nframes;
+    memcpy(txq->buf + txq->len, buf, len);
+    afp->tx_off[k] = txq->len;
+    afp->tx_len[k] = len;
+    afp->tx_if[k]  = (unsigned char)sr_iface->ifindex;
+    txq->len += len;
+
+    now = sr_timer_now_ms();
+    if(txq->nframes++ == 0)
+    { txq->first_ms = now; }
+    else if(now - txq->first_ms >= SR_TXQ_LATENCY_MS)
+    { return sr_afp_flush(sr); }
+
+    return 0;
+} /* -- sr_afp_send -- */
+
+const struct sr_transport_ops sr_afpacket_transport =
+{
+    "afpacket",
+    sr_afp_open,
+    sr_afp_read,
+    sr_afp_send,
+    sr_afp_flush,
+    sr_afp_close,
+    sr_afp_print_stats
+};
+
+#else /* -- no AF_PACKET -- */
+
+static int sr_afp_open(struct sr_instance* sr, const char* arg)
+{
+    fprintf(stderr, "afpacket transport needs Linux\n");
+    return -1;
+}
+
+static int sr_afp_read(struct sr_instance* sr)
+{ return -1; }
+
+static int sr_afp_send(struct sr_instance* sr, uint8_t* buf, unsigned int len,
+                       const char* iface)
+{ return -1; }
+
+static int sr_afp_flush(struct sr_instance* sr)
+{ return 0; }
+
+static void sr_afp_close(struct sr_instance* sr)
+{ }
+
+static void sr_afp_print_stats(struct sr_instance* sr, FILE* out)
+{ }
+
+int sr_afp_kernel_if(const char* name, struct sr_kif* kif)
+{ return -1; }
+
+int sr_afp_if_names(const char* arg, char names[][sr_IFACE_NAMELEN],
+                    unsigned int max)
+{ return -1; }
+
+const struct sr_transport_ops sr_afpacket_transport =
+{
+    "afpacket",
+    sr_afp_open,
+    sr_afp_read,
+    sr_afp_send,
+    sr_afp_flush,
+    sr_afp_close,
+    sr_afp_print_stats
+};
+
+#endif /* _LINUX_ */
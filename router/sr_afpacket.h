@@ -0,0 +1,83 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_afpacket.h
+ *
+ * Description:
+ *
+ * Transport that runs the router on real Linux interfaces instead of
+ * through the VNS server.  Each interface gets an AF_PACKET socket with a
+ * memory mapped TPACKET_V3 receive ring: the kernel fills whole blocks of
+ * frames and hands a block over at once, so a busy interface costs one
+ * wakeup per block rather than one system call per frame.  Frames are
+ * handled straight out of the ring.  Outgoing frames are queued per
+ * interface and sent with one sendmmsg() per interface on flush.
+ *
+ * The interface list comes from the kernel (addresses, masks and MACs of
+ * the named interfaces, or of every non-loopback interface with an IPv4
+ * address) rather than from VNSHWINFO.  Needs CAP_NET_RAW.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef sr_AFPACKET_H
+#define sr_AFPACKET_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#include "sr_protocol.h"
+
+#define SR_AFP_MAX_IFS      16         /* interfaces the transport drives */
+#define SR_AFP_BLOCK_SIZE   (1 << 18)  /* receive ring block */
+#define SR_AFP_BLOCK_NR     16         /* blocks per interface */
+#define SR_AFP_FRAME_SIZE   2048
+#define SR_AFP_BLOCK_TOV_MS 1          /* kernel hands over a partial block */
+#define SR_AFP_TX_FRAMES    64         /* frames queued before a flush */
+
+struct sr_instance;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_afp_if
+ *
+ * One interface: its socket and receive ring.  Indexed by sr_if->ifindex.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_afp_if
+{
+    int fd;
+    int os_ifindex;           /* kernel interface index */
+    uint8_t* ring;            /* SR_AFP_BLOCK_NR blocks, mmap()ed */
+    unsigned int block;       /* next block to look at */
+    char name[sr_IFACE_NAMELEN];
+};
+
+struct sr_afpacket
+{
+    int epfd;                 /* all the interface sockets; sr->sockfd */
+    unsigned int nifs;
+    struct sr_afp_if ifs[SR_AFP_MAX_IFS];
+
+    /* -- frames queued in sr->txq.buf, under sr->send_lock -- */
+    unsigned int tx_off[SR_AFP_TX_FRAMES];
+    unsigned int tx_len[SR_AFP_TX_FRAMES];
+    unsigned char tx_if[SR_AFP_TX_FRAMES];
+
+    unsigned long blocks;     /* ring blocks handled */
+    unsigned long frames;     /* frames received */
+};
+
+/* -- what the kernel knows about an interface -- */
+struct sr_kif
+{
+    int os_ifindex;
+    unsigned char addr[ETHER_ADDR_LEN];
+    uint32_t ip;              /* network byte order */
+    uint32_t mask;
+};
+
+/* -- shared with the other transports that run on kernel interfaces -- */
+int sr_afp_kernel_if(const char* name, struct sr_kif* kif);
+int sr_afp_if_names(const char* arg, char names[][sr_IFACE_NAMELEN],
+                    unsigned int max);
+
+#endif  /* --  sr_AFPACKET_H -- */
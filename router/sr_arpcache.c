@@ -6,15 +6,20 @@
 #include <pthread.h>
 #include <sched.h>
 #include <string.h>
+#include <assert.h>
 #include "sr_arpcache.h"
 #include "sr_router.h"
 #include "sr_if.h"
 #include "sr_protocol.h"
 #include "sr_rt.h"
+#include "sr_slab.h"
 
-/* handle sending ARP requests if necessary */
+/* handle sending ARP requests if necessary. A retransmit is due once the
+   request's timer is no longer pending: it has never been sent, or the
+   timing wheel fired it SR_ARPREQ_RETX_MS after the last send. */
 void handle_arpreq(struct sr_instance *sr, struct sr_arpreq* req) {
-    if(difftime(time(NULL),req->sent)>1.0){
+    pthread_mutex_lock(&(sr->cache.lock));
+    if(!sr_timer_pending(&(req->timer))){
         if(req->times_sent>=5){
             /* Send ICMP Host unreachable to source addr of all pkts waiting */
             struct sr_packet *packets_iter;
@@ -25,22 +30,16 @@ void handle_arpreq(struct sr_instance *sr, struct sr_arpreq* req) {
               sr_ip_hdr_t* pac_ip_header = (sr_ip_hdr_t*) (packets_iter->buf + sizeof(sr_ethernet_hdr_t));
 
               /* Get source ip from des MAC */
-              struct sr_if* if_iter;
-              struct sr_if* iface;
-              for(if_iter = sr->if_list;if_iter!=NULL;if_iter = if_iter->next){
-                if(compare_two_name((char*)if_iter->addr,(char*)pac_eth_header->ether_dhost,ETHER_ADDR_LEN)){
-                    iface = if_iter;
-                    break;
-                }
-              }
+              struct sr_if* iface = sr_get_interface_by_addr(sr, pac_eth_header->ether_dhost);
+              struct sr_if* out_iface = sr_get_interface_by_index(sr, packets_iter->ifindex);
+              if(iface && out_iface)
               send_icmp_error_message(sr,
-                            packets_iter->iface,
+                            out_iface->name,
                             pac_ip_header->ip_id,
                             (uint8_t*)pac_ip_header, 
                             pac_ip_header->ip_src,
-                            iface->ip,
+                            iface,                         /* source MAC and IP */
                             pac_eth_header->ether_shost,   /* destination ethernet address */
-                            pac_eth_header->ether_dhost,  /* source ethernet address */
                             ICMP_DESTINATION_HOST_UNREACHABLE /* ICMP Error Message Type, defined in sr_router.h */
               );
               
@@ -56,12 +55,22 @@ void handle_arpreq(struct sr_instance *sr, struct sr_arpreq* req) {
             /* Update req status */
             req->sent = time(NULL); 
 			req->times_sent++;
+            sr_timer_add(&(sr->cache.timers), &(req->timer), SR_ARPREQ_RETX_MS);
 
         }
     }
+    pthread_mutex_unlock(&(sr->cache.lock));
     return;
 }
 
+/* Timing wheel callback: an ARP request is due for a retransmit. */
+static void sr_arpcache_retransmit(void *sr_ptr, struct sr_timer *timer) {
+    handle_arpreq((struct sr_instance *) sr_ptr, (struct sr_arpreq *) timer->arg);
+}
+
+/* Timing wheel callback: a cache entry has been around SR_ARPCACHE_TO. */
+static void sr_arpcache_expire(void *sr_ptr, struct sr_timer *timer);
+
 /* 
   This function gets called every second. For each request sent out, we keep
   checking whether we should resend an request or destroy the arp request.
@@ -76,43 +85,188 @@ void sr_arpcache_sweepreqs(struct sr_instance *sr) {
 
 /* You should not need to touch the rest of this code. */
 
-/* Checks if an IP->MAC mapping is in the cache. IP is in network byte order.
-   You must free the returned structure if it is not NULL. */
-struct sr_arpentry *sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip) {
-    pthread_mutex_lock(&(cache->lock));
+/* Home slot of an IP in the open addressing table. */
+static unsigned int sr_arpcache_hash(struct sr_arpcache *cache, uint32_t ip) {
+    return (uint32_t)(ip * 2654435761U) >> cache->shift;
+}
+
+/* Returns the valid entry for ip, or NULL. Probing stops at the first
+   never-used slot. Caller must hold the cache lock. */
+static struct sr_arpentry *sr_arpcache_find(struct sr_arpcache *cache, uint32_t ip) {
+    unsigned int mask = cache->size - 1;
+    unsigned int i = sr_arpcache_hash(cache, ip);
+    unsigned int n;
+    
+    for (n = 0; n < cache->size; n++, i = (i + 1) & mask) {
+        struct sr_arpentry *entry = &(cache->entries[i]);
+        if (entry->valid == SR_ARPENTRY_EMPTY)
+            break;
+        if ((entry->valid == SR_ARPENTRY_VALID) && (entry->ip == ip))
+            return entry;
+    }
+    
+    return NULL;
+}
+
+/* Returns the first free (never used or expired) slot on ip's probe
+   sequence. The table always has free slots since it is at most half full. */
+static struct sr_arpentry *sr_arpcache_free_slot(struct sr_arpcache *cache, uint32_t ip) {
+    unsigned int mask = cache->size - 1;
+    unsigned int i = sr_arpcache_hash(cache, ip);
+    
+    while (cache->entries[i].valid == SR_ARPENTRY_VALID)
+        i = (i + 1) & mask;
+    
+    return &(cache->entries[i]);
+}
+
+/* Seqlock write side: make the counter odd before touching the protected
+   data and even again afterwards. Caller must hold the cache lock. */
+static void sr_arpcache_write_begin(unsigned int *seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static void sr_arpcache_write_end(unsigned int *seq) {
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+/* Fills a slot with a valid mapping and (re)arms its expiry timer. */
+static void sr_arpcache_set(struct sr_arpcache *cache, struct sr_arpentry *entry,
+                            uint32_t ip, unsigned char *mac, time_t added) {
+    double remaining = SR_ARPCACHE_TO - difftime(time(NULL), added);
+    
+    sr_arpcache_write_begin(&(entry->seq));
+    memcpy(entry->mac, mac, 6);
+    entry->ip = ip;
+    entry->added = added;
+    entry->valid = SR_ARPENTRY_VALID;
+    sr_arpcache_write_end(&(entry->seq));
     
-    struct sr_arpentry *entry = NULL, *copy = NULL;
+    sr_timer_del(&(cache->timers), &(entry->timer));
+    sr_timer_init(&(entry->timer), sr_arpcache_expire, entry);
+    sr_timer_add(&(cache->timers), &(entry->timer),
+                 remaining > 0 ? (unsigned int)(remaining * 1000) : 0);
+}
+
+static void sr_arpcache_expire(void *sr_ptr, struct sr_timer *timer) {
+    struct sr_arpcache *cache = &(((struct sr_instance *) sr_ptr)->cache);
+    struct sr_arpentry *entry = (struct sr_arpentry *) timer->arg;
     
-    int i;
-    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
-        if ((cache->entries[i].valid) && (cache->entries[i].ip == ip)) {
-            entry = &(cache->entries[i]);
+    sr_arpcache_write_begin(&(entry->seq));
+    entry->valid = SR_ARPENTRY_DEAD;
+    sr_arpcache_write_end(&(entry->seq));
+    cache->nvalid--;
+    cache->ndead++;
+}
+
+/* Reinserts all valid entries into the same slot array, dropping
+   tombstones. Readers see table_seq odd meanwhile and retry. */
+static void sr_arpcache_rehash(struct sr_arpcache *cache) {
+    struct sr_arpentry *live;
+    unsigned int i, n = 0;
+    
+    live = (struct sr_arpentry *) malloc((cache->nvalid + 1) * sizeof(struct sr_arpentry));
+    assert(live);
+    for (i = 0; i < cache->size; i++) {
+        if (cache->entries[i].valid == SR_ARPENTRY_VALID) {
+            sr_timer_del(&(cache->timers), &(cache->entries[i].timer));
+            memcpy(&(live[n++]), &(cache->entries[i]), sizeof(struct sr_arpentry));
         }
     }
     
-    /* Must return a copy b/c another thread could jump in and modify
-       table after we return. */
-    if (entry) {
-        copy = (struct sr_arpentry *) malloc(sizeof(struct sr_arpentry));
-        memcpy(copy, entry, sizeof(struct sr_arpentry));
-    }
+    sr_arpcache_write_begin(&(cache->table_seq));
+    for (i = 0; i < cache->size; i++)
+        cache->entries[i].valid = SR_ARPENTRY_EMPTY;
+    for (i = 0; i < n; i++)
+        sr_arpcache_set(cache, sr_arpcache_free_slot(cache, live[i].ip), live[i].ip,
+                        live[i].mac, live[i].added);
+    cache->ndead = 0;
+    sr_arpcache_write_end(&(cache->table_seq));
+    
+    free(live);
+}
+
+/* Checks if an IP->MAC mapping is in the cache. IP is in network byte order.
+   Returns 1 and copies the MAC into mac if found, returns 0 otherwise.
+   Lock free: see the seqlock notes on struct sr_arpcache. */
+int sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip, unsigned char *mac) {
+    unsigned int mask = cache->size - 1;
+    unsigned int tseq, seq, i, n;
+    unsigned char found_mac[6];
+    int found, valid;
+    
+    for (;;) {
+        tseq = __atomic_load_n(&(cache->table_seq), __ATOMIC_ACQUIRE);
+        if (tseq & 1) {
+            sched_yield();
+            continue;
+        }
         
-    pthread_mutex_unlock(&(cache->lock));
+        found = 0;
+        i = sr_arpcache_hash(cache, ip);
+        for (n = 0; n < cache->size; n++, i = (i + 1) & mask) {
+            struct sr_arpentry *entry = &(cache->entries[i]);
+            
+            /* Consistent snapshot of this slot */
+            do {
+                seq = __atomic_load_n(&(entry->seq), __ATOMIC_ACQUIRE);
+                valid = __atomic_load_n(&(entry->valid), __ATOMIC_RELAXED);
+                found = (valid == SR_ARPENTRY_VALID) &&
+                        (__atomic_load_n(&(entry->ip), __ATOMIC_RELAXED) == ip);
+                if (found)
+                    memcpy(found_mac, entry->mac, 6);
+                __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            } while ((seq & 1) || (seq != __atomic_load_n(&(entry->seq), __ATOMIC_RELAXED)));
+            
+            if (found || (valid == SR_ARPENTRY_EMPTY))
+                break;
+        }
+        
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (tseq == __atomic_load_n(&(cache->table_seq), __ATOMIC_RELAXED))
+            break;
+    }
+    
+    if (found)
+        memcpy(mac, found_mac, 6);
+    
+    return found;
+}
+
+/* Takes a queue node from the slab, or returns NULL once SR_ARPQ_POOL_SZ
+   nodes are queued. Caller must hold the cache lock. */
+static struct sr_packet *sr_arpcache_pkt_alloc(struct sr_arpcache *cache) {
+    struct sr_packet *pkt;
     
-    return copy;
+    if (cache->pkt_used >= SR_ARPQ_POOL_SZ)
+        return NULL;
+    pkt = (struct sr_packet *) sr_slab_alloc(sizeof(struct sr_packet));
+    if (pkt) {
+        cache->pkt_used++;
+        pkt->next = NULL;
+    }
+    return pkt;
+}
+
+static void sr_arpcache_pkt_free(struct sr_arpcache *cache, struct sr_packet *pkt) {
+    sr_slab_free(pkt);
+    cache->pkt_used--;
 }
 
 /* Adds an ARP request to the ARP request queue. If the request is already on
    the queue, adds the packet to the linked list of packets for this sr_arpreq
-   that corresponds to this ARP request. You should free the passed *packet.
+   that corresponds to this ARP request. The request holds its own
+   reference, the caller keeps its reference to *packet.
    
    A pointer to the ARP request is returned; it should not be freed. The caller
-   can remove the ARP request from the queue by calling sr_arpreq_destroy. */
+   can remove the ARP request from the queue by calling sr_arpreq_destroy.
+   Another thread can resolve and free the request as soon as the lock is
+   dropped, so only use it with cache->lock held (see sr_arpcache_queue_send). */
 struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
                                        uint32_t ip,
-                                       uint8_t *packet,           /* borrowed */
-                                       unsigned int packet_len,
-                                       char *iface)
+                                       struct sr_pbuf *packet,    /* borrowed */
+                                       unsigned int ifindex)
 {
     pthread_mutex_lock(&(cache->lock));
     
@@ -125,30 +279,43 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
     
     /* If the IP wasn't found, add it */
     if (!req) {
-        req = (struct sr_arpreq *) calloc(1, sizeof(struct sr_arpreq));
+        req = (struct sr_arpreq *) sr_slab_alloc(sizeof(struct sr_arpreq));
+        if (!req) {
+            cache->drops_nobuf++;
+            pthread_mutex_unlock(&(cache->lock));
+            return NULL;
+        }
+        memset(req, 0, sizeof(struct sr_arpreq));
         req->ip = ip;
+        sr_timer_init(&(req->timer), sr_arpcache_retransmit, req);
         req->next = cache->requests;
         cache->requests = req;
     }
     
-    /* Add the packet to the list of packets for this request */
-    if (packet && packet_len && iface) {
-        struct sr_packet *new_pkt = (struct sr_packet *)malloc(sizeof(struct sr_packet));
+    /* Add the packet to the tail of the list of packets for this request */
+    if (packet && packet->len) {
+        struct sr_packet *new_pkt = NULL;
         
-        new_pkt->buf = (uint8_t *)malloc(packet_len);
-        memcpy(new_pkt->buf, packet, packet_len);
-        new_pkt->len = packet_len;
-		new_pkt->iface = (char *)malloc(sr_IFACE_NAMELEN);
-        strncpy(new_pkt->iface, iface, sr_IFACE_NAMELEN);
-        new_pkt->next = NULL;
-        if (req->packets == NULL){
-            req->packets = new_pkt;
+        if (req->npackets >= SR_ARPQ_PER_REQ)
+            cache->drops_req_full++;
+        else if (!(new_pkt = sr_arpcache_pkt_alloc(cache)))
+            cache->drops_pool_full++;
+        else if (!(new_pkt->pbuf = sr_pbuf_hold(packet))) {
+            sr_arpcache_pkt_free(cache, new_pkt);
+            new_pkt = NULL;
+            cache->drops_nobuf++;
         }
-        else{
-            struct sr_packet *p = req->packets;
-            while(p->next != NULL)
-                p = p->next;
-            p->next = new_pkt;
+        
+        if (new_pkt) {
+            new_pkt->buf = new_pkt->pbuf->data;
+            new_pkt->len = new_pkt->pbuf->len;
+            new_pkt->ifindex = ifindex;
+            if (req->packets_tail)
+                req->packets_tail->next = new_pkt;
+            else
+                req->packets = new_pkt;
+            req->packets_tail = new_pkt;
+            req->npackets++;
         }
     }
     
@@ -157,6 +324,27 @@ struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
     return req;
 }
 
+/* Queues the packet on the ARP request for ip and sends the request if it
+   is due, without dropping the cache lock in between: with forwarding
+   workers the ARP reply may be handled on another thread, which frees the
+   request once it is resolved. Returns 0, or -1 if no request could be
+   allocated. */
+int sr_arpcache_queue_send(struct sr_instance *sr,
+                           uint32_t ip,
+                           struct sr_pbuf *packet,    /* borrowed */
+                           unsigned int ifindex)
+{
+    struct sr_arpreq *req;
+    
+    pthread_mutex_lock(&(sr->cache.lock));
+    req = sr_arpcache_queuereq(&(sr->cache), ip, packet, ifindex);
+    if (req)
+        handle_arpreq(sr, req);
+    pthread_mutex_unlock(&(sr->cache.lock));
+    
+    return req ? 0 : -1;
+}
+
 /* This method performs two functions:
    1) Looks up this IP in the request queue. If it is found, returns a pointer
       to the sr_arpreq with this IP. Otherwise, returns NULL.
@@ -179,24 +367,29 @@ struct sr_arpreq *sr_arpcache_insert(struct sr_arpcache *cache,
                 cache->requests = next;
             }
             
+            /* Resolved, so no more retransmits */
+            sr_timer_del(&(cache->timers), &(req->timer));
             break;
         }
         prev = req;
     }
     
-    int i;
-    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
-        if (!(cache->entries[i].valid))
-            break;
-    }
+    struct sr_arpentry *entry = sr_arpcache_find(cache, ip);
     
-    if (i != SR_ARPCACHE_SZ) {
-        memcpy(cache->entries[i].mac, mac, 6);
-        cache->entries[i].ip = ip;
-        cache->entries[i].added = time(NULL);
-        cache->entries[i].valid = 1;
+    if (!entry && (cache->nvalid < cache->max_entries)) {
+        /* Keep probe sequences short: at most 3/4 of the slots in use */
+        if (4 * (cache->nvalid + cache->ndead + 1) > 3 * cache->size)
+            sr_arpcache_rehash(cache);
+        
+        entry = sr_arpcache_free_slot(cache, ip);
+        if (entry->valid == SR_ARPENTRY_DEAD)
+            cache->ndead--;
+        cache->nvalid++;
     }
     
+    if (entry)
+        sr_arpcache_set(cache, entry, ip, mac, time(NULL));
+    
     pthread_mutex_unlock(&(cache->lock));
     
     return req;
@@ -225,18 +418,17 @@ void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry) {
             prev = req;
         }
         
+        sr_timer_del(&(cache->timers), &(entry->timer));
+        
         struct sr_packet *pkt, *nxt;
         
         for (pkt = entry->packets; pkt; pkt = nxt) {
             nxt = pkt->next;
-            if (pkt->buf)
-                free(pkt->buf);
-            if (pkt->iface)
-                free(pkt->iface);
-            free(pkt);
+            sr_pbuf_put(pkt->pbuf);
+            sr_arpcache_pkt_free(cache, pkt);
         }
         
-        free(entry);
+        sr_slab_free(entry);
     }
     
     pthread_mutex_unlock(&(cache->lock));
@@ -244,28 +436,64 @@ void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry) {
 
 /* Prints out the ARP table. */
 void sr_arpcache_dump(struct sr_arpcache *cache) {
-    fprintf(stderr, "\nMAC            IP         ADDED                      VALID\n");
-    fprintf(stderr, "-----------------------------------------------------------\n");
+    sr_arpcache_fprint(cache, stderr);
+}
+
+/* Prints out the ARP table to out. */
+void sr_arpcache_fprint(struct sr_arpcache *cache, FILE *out) {
+    fprintf(out, "\nMAC            IP         ADDED                      VALID\n");
+    fprintf(out, "-----------------------------------------------------------\n");
     
-    int i;
-    for (i = 0; i < SR_ARPCACHE_SZ; i++) {
+    unsigned int i;
+    for (i = 0; i < cache->size; i++) {
         struct sr_arpentry *cur = &(cache->entries[i]);
+        if (cur->valid != SR_ARPENTRY_VALID)
+            continue;
         unsigned char *mac = cur->mac;
-        fprintf(stderr, "%.1x%.1x%.1x%.1x%.1x%.1x   %.8x   %.24s   %d\n", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], ntohl(cur->ip), ctime(&(cur->added)), cur->valid);
+        fprintf(out, "%.1x%.1x%.1x%.1x%.1x%.1x   %.8x   %.24s   %d\n", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], ntohl(cur->ip), ctime(&(cur->added)), cur->valid);
     }
     
-    fprintf(stderr, "\n");
+    fprintf(out, "\nqueued packets: %u/%d, dropped: %lu request full, %lu pool full, %lu no buffer\n",
+            cache->pkt_used, SR_ARPQ_POOL_SZ, cache->drops_req_full,
+            cache->drops_pool_full, cache->drops_nobuf);
+    fprintf(out, "\n");
 }
 
 /* Initialize table + table lock. Returns 0 on success. */
-int sr_arpcache_init(struct sr_arpcache *cache) {  
+int sr_arpcache_init(struct sr_arpcache *cache, unsigned int max_entries) {  
     /* Seed RNG to kick out a random entry if all entries full. */
     srand(time(NULL));
     
+    if (max_entries == 0)
+        max_entries = SR_ARPCACHE_SZ;
+    
+    /* Size the table so that it is never more than half full */
+    cache->size = 16;
+    cache->shift = 28;
+    while (cache->size < 2 * max_entries) {
+        cache->size <<= 1;
+        cache->shift--;
+    }
+    cache->max_entries = max_entries;
+    cache->table_seq = 0;
+    cache->nvalid = 0;
+    cache->ndead = 0;
+    
     /* Invalidate all entries */
-    memset(cache->entries, 0, sizeof(cache->entries));
+    cache->entries = (struct sr_arpentry *) calloc(cache->size, sizeof(struct sr_arpentry));
+    if (!cache->entries)
+        return -1;
     cache->requests = NULL;
     
+    /* Queue nodes come from the slab; warm it so the first misses don't grow it */
+    sr_slab_reserve(sizeof(struct sr_packet), SR_ARPQ_POOL_SZ);
+    cache->pkt_used = 0;
+    cache->drops_req_full = 0;
+    cache->drops_pool_full = 0;
+    cache->drops_nobuf = 0;
+    
+    sr_timer_wheel_init(&(cache->timers), SR_ARPCACHE_TICK_MS);
+    
     /* Acquire mutex lock */
     pthread_mutexattr_init(&(cache->attr));
     pthread_mutexattr_settype(&(cache->attr), PTHREAD_MUTEX_RECURSIVE);
@@ -276,32 +504,37 @@ int sr_arpcache_init(struct sr_arpcache *cache) {
 
 /* Destroys table + table lock. Returns 0 on success. */
 int sr_arpcache_destroy(struct sr_arpcache *cache) {
+    free(cache->entries);
+    cache->entries = NULL;
     return pthread_mutex_destroy(&(cache->lock)) && pthread_mutexattr_destroy(&(cache->attr));
 }
 
-/* Thread which sweeps through the cache and invalidates entries that were added
-   more than SR_ARPCACHE_TO seconds ago. */
-void *sr_arpcache_timeout(void *sr_ptr) {
-    struct sr_instance *sr = sr_ptr;
+/* Fires the timers that are due: expires entries and retransmits or
+   gives up on ARP requests. Returns the milliseconds until the next
+   tick. */
+unsigned int sr_arpcache_tick(struct sr_instance *sr) {
     struct sr_arpcache *cache = &(sr->cache);
+    unsigned int next_ms;
     
-    while (1) {
-        sleep(1.0);
-        
-        pthread_mutex_lock(&(cache->lock));
+    pthread_mutex_lock(&(cache->lock));
+    sr_timer_wheel_advance(&(cache->timers), sr);
+    next_ms = sr_timer_wheel_next_ms(&(cache->timers));
+    pthread_mutex_unlock(&(cache->lock));
+    sr_flush_packets(sr);
     
-        time_t curtime = time(NULL);
-        
-        int i;    
-        for (i = 0; i < SR_ARPCACHE_SZ; i++) {
-            if ((cache->entries[i].valid) && (difftime(curtime,cache->entries[i].added) > SR_ARPCACHE_TO)) {
-                cache->entries[i].valid = 0;
-            }
-        }
-        
-        sr_arpcache_sweepreqs(sr);
+    return next_ms;
+}
 
-        pthread_mutex_unlock(&(cache->lock));
+/* Thread which runs the cache's timing wheel: invalidates entries that were
+   added more than SR_ARPCACHE_TO seconds ago and retransmits ARP requests.
+   Each tick only touches the timers that are due. */
+void *sr_arpcache_timeout(void *sr_ptr) {
+    struct sr_instance *sr = sr_ptr;
+    unsigned int next_ms = sr_timer_wheel_next_ms(&(sr->cache.timers));
+    
+    while (1) {
+        usleep(1000 * next_ms);
+        next_ms = sr_arpcache_tick(sr);
     }
     
     return NULL;
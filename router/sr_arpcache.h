@@ -9,14 +9,17 @@
    --
 
    # When sending packet to next_hop_ip
-   entry = arpcache_lookup(next_hop_ip)
+   found = arpcache_lookup(next_hop_ip, mac)
 
-   if entry:
-       use next_hop_ip->mac mapping in entry to send the packet
-       free entry
+   if found:
+       use next_hop_ip->mac mapping copied into mac to send the packet
    else:
-       req = arpcache_queuereq(next_hop_ip, packet, len)
-       handle_arpreq(req)
+       with the cache locked:
+           req = arpcache_queuereq(next_hop_ip, packet, len)
+           handle_arpreq(req)
+
+   sr_arpcache_queue_send() does both under the cache lock; the request
+   must not be touched once the lock is dropped.
 
    --
 
@@ -24,7 +27,7 @@
    handle sending ARP requests if necessary:
 
    function handle_arpreq(req):
-       if difftime(now, req->sent) > 1.0
+       if req->timer is not pending (never sent, or 1 second has passed)
            if req->times_sent >= 5:
                send icmp host unreachable to source addr of all pkts waiting
                  on this request
@@ -33,6 +36,7 @@
                send arp request
                req->sent = now
                req->times_sent++
+               arm req->timer to call handle_arpreq(req) again in 1 second
 
    --
 
@@ -48,10 +52,15 @@
 
    --
 
+   Expiry of cache entries and retransmission of ARP requests are driven by
+   a timing wheel (sr_timer.h) owned by the cache. The timeout thread
+   advances it every SR_ARPCACHE_TICK_MS and only touches the entries and
+   requests that are due, instead of scanning the whole cache.
+
    To meet the guidelines in the assignment (ARP requests are sent every second
    until we send 5 ARP requests, then we send ICMP host unreachable back to
-   all packets waiting on this ARP request), you must fill out the following
-   function that is called every second and is defined in sr_arpcache.c:
+   all packets waiting on this ARP request), the following function walks all
+   pending requests; it is kept for callers that want an explicit sweep:
 
    void sr_arpcache_sweepreqs(struct sr_instance *sr) {
        for each request on sr->cache.requests:
@@ -67,17 +76,33 @@
 #define SR_ARPCACHE_H
 
 #include <inttypes.h>
+#include <stdio.h>
 #include <time.h>
 #include <pthread.h>
 #include "sr_if.h"
+#include "sr_timer.h"
+#include "sr_pbuf.h"
 
-#define SR_ARPCACHE_SZ    100  
+#define SR_ARPCACHE_SZ    100  /* default capacity, see sr_arpcache_init */
 #define SR_ARPCACHE_TO    15.0
+#define SR_ARPCACHE_TICK_MS 100  /* timing wheel granularity */
+#define SR_ARPREQ_RETX_MS   1000 /* interval between ARP request retransmits */
+
+/* Packets waiting on ARP replies hold a reference to their pbuf; the
+   queue nodes come from a preallocated pool instead of malloc. */
+#define SR_ARPQ_POOL_SZ   512   /* packets queued over all pending requests */
+#define SR_ARPQ_PER_REQ   32    /* most packets queued on one request */
+
+/* Slot states of the open addressing table */
+#define SR_ARPENTRY_EMPTY 0     /* never used, ends a probe sequence */
+#define SR_ARPENTRY_VALID 1
+#define SR_ARPENTRY_DEAD  2     /* expired, skipped by probes and reused */
 
 struct sr_packet {
-    uint8_t *buf;               /* A raw Ethernet frame, presumably with the dest MAC empty */
+    struct sr_pbuf *pbuf;       /* Reference held while queued */
+    uint8_t *buf;               /* A raw Ethernet frame (pbuf->data), presumably with the dest MAC empty */
     unsigned int len;           /* Length of raw Ethernet frame */
-    char *iface;                /* The outgoing interface */
+    unsigned int ifindex;       /* The outgoing interface, see sr_get_interface_by_index */
     struct sr_packet *next;
 };
 
@@ -85,7 +110,9 @@ struct sr_arpentry {
     unsigned char mac[6]; 
     uint32_t ip;                /* IP addr in network byte order */
     time_t added;         
-    int valid;
+    int valid;                  /* SR_ARPENTRY_* */
+    unsigned int seq;           /* seqlock, odd while the slot is written */
+    struct sr_timer timer;      /* expiry, SR_ARPCACHE_TO after added */
 };
 
 struct sr_arpreq {
@@ -96,32 +123,65 @@ struct sr_arpreq {
     uint32_t times_sent;        /* Number of times this request was sent. You 
                                    should update this. */
     struct sr_packet *packets;  /* List of pkts waiting on this req to finish */
+    struct sr_packet *packets_tail;
+    unsigned int npackets;
+    struct sr_timer timer;      /* Pending until the next retransmit is due */
     struct sr_arpreq *next;
 };
 
+/* The entries form an open addressing hash table keyed by IP with linear
+   probing. Expired entries become tombstones so that live entries never
+   move; the table is rehashed in place when tombstones pile up.
+
+   Writers (insert, expiry) are serialized by lock. sr_arpcache_lookup()
+   never takes the lock: every slot carries a sequence counter that is odd
+   while the slot is being written, and table_seq does the same for a
+   rehash. Readers retry when a counter was odd or changed under them. */
 struct sr_arpcache {
-    struct sr_arpentry entries[SR_ARPCACHE_SZ];
+    struct sr_arpentry *entries;
+    unsigned int table_seq;     /* seqlock for rehashing the whole table */
+    unsigned int size;          /* number of slots, a power of two */
+    unsigned int shift;         /* 32 - log2(size), for the hash */
+    unsigned int max_entries;   /* capacity, at most half of size */
+    unsigned int nvalid;
+    unsigned int ndead;
     struct sr_arpreq *requests;
+    struct sr_timer_wheel timers; /* entry expiry and request retransmits */
+    unsigned int pkt_used;        /* queue nodes, at most SR_ARPQ_POOL_SZ */
+    unsigned long drops_req_full; /* request already held SR_ARPQ_PER_REQ */
+    unsigned long drops_pool_full;
+    unsigned long drops_nobuf;    /* could not copy a borrowed frame */
     pthread_mutex_t lock;
     pthread_mutexattr_t attr;
 };
 
 /* Checks if an IP->MAC mapping is in the cache. IP is in network byte order. 
-   You must free the returned structure if it is not NULL. */
-struct sr_arpentry *sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip);
+   Returns 1 and copies the MAC into mac if found, returns 0 and leaves mac
+   untouched otherwise. */
+int sr_arpcache_lookup(struct sr_arpcache *cache, uint32_t ip, unsigned char *mac);
 
 /* Adds an ARP request to the ARP request queue. If the request is already on
    the queue, adds the packet to the linked list of packets for this sr_arpreq
-   that corresponds to this ARP request. The packet argument should not be
-   freed by the caller.
-
-   A pointer to the ARP request is returned; it should be freed. The caller
-   can remove the ARP request from the queue by calling sr_arpreq_destroy. */
+   that corresponds to this ARP request. The request takes a reference to
+   the packet (see sr_pbuf_hold); it is dropped (and counted) if the
+   request already holds SR_ARPQ_PER_REQ packets or the pool is exhausted.
+
+   A pointer to the ARP request is returned; it should not be freed. The caller
+   can remove the ARP request from the queue by calling sr_arpreq_destroy.
+   Returns NULL if no request could be allocated. The request is only safe
+   to use while cache->lock is held. */
 struct sr_arpreq *sr_arpcache_queuereq(struct sr_arpcache *cache,
                          uint32_t ip,
-                         uint8_t *packet,               /* borrowed */
-                         unsigned int packet_len,
-                         char *iface);
+                         struct sr_pbuf *packet,        /* borrowed */
+                         unsigned int ifindex);
+
+/* Queues the packet with sr_arpcache_queuereq() and sends the ARP request
+   if it is due (handle_arpreq), all under the cache lock. Returns 0, or -1
+   if the packet could not be queued. */
+int sr_arpcache_queue_send(struct sr_instance *sr,
+                           uint32_t ip,
+                           struct sr_pbuf *packet,      /* borrowed */
+                           unsigned int ifindex);
 
 /* This method performs two functions:
    1) Looks up this IP in the request queue. If it is found, returns a pointer
@@ -137,14 +197,20 @@ void sr_arpreq_destroy(struct sr_arpcache *cache, struct sr_arpreq *entry);
 
 /* Prints out the ARP table. */
 void sr_arpcache_dump(struct sr_arpcache *cache);
+void sr_arpcache_fprint(struct sr_arpcache *cache, FILE *out);
 
 /* You shouldn't have to call these methods--they're already called in the
    starter code for you. The init call is a constructor, the destroy call is
-   a destructor, and a cleanup thread times out cache entries every 15
-   seconds. */
+   a destructor, and a cleanup thread runs the timing wheel that times out
+   cache entries after 15 seconds and retransmits ARP requests. max_entries
+   is the cache capacity, 0 means SR_ARPCACHE_SZ. */
 
-int   sr_arpcache_init(struct sr_arpcache *cache);
+int   sr_arpcache_init(struct sr_arpcache *cache, unsigned int max_entries);
 int   sr_arpcache_destroy(struct sr_arpcache *cache);
 void *sr_arpcache_timeout(void *cache_ptr);
 
+/* One pass of the thread above, for callers that drive it from their own
+   loop. Returns the milliseconds until it is due again. */
+unsigned int sr_arpcache_tick(struct sr_instance *sr);
+
 #endif
@@ -0,0 +1,500 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_bench.c
+ *
+ * Description:
+ *
+ * Offline throughput benchmark.  Loads a routing table with sr_load_rt(),
+ * makes up the interfaces it names, reads frames from a pcap file in the
+ * format sr_dumper.c writes and pushes them through sr_handlepacket() in
+ * a tight loop.  Frames the router sends go to a counting sink instead of
+ * a network, so nothing but the router itself is measured.
+ *
+ * Frames whose next hop is not in the ARP cache are queued by the router
+ * on the warm up passes; the bench answers those ARP requests itself, so
+ * the timed passes see a warm cache like a router that has been up for a
+ * while.  The router's logging is buffered and discarded unless -v is
+ * given, so it costs formatting but no system calls.  Each frame is
+ * copied from the file image before it is handled, outside the timed
+ * region, since the router rewrites frames in place.
+ *
+ * Usage: sr_bench -r rtable -p file.pcap [-i name=ip/mask ...] [-I iface]
+ *                 [-n passes] [-f trie|dir24] [-a arp entries] [-k] [-v]
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#ifdef _LINUX_
+#include <getopt.h>
+#endif /* _LINUX_ */
+
+#include "sr_dumper.h"
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_rt.h"
+#include "sr_slab.h"
+#include "sr_bench_common.h"
+
+#define BENCH_SAMPLES  1000000 /* frames timed by default */
+#define BENCH_MAX_IFS  32
+#define BENCH_FRAME_MAX 10240  /* largest frame read from the file */
+#define BENCH_ARP_SZ   4096    /* default ARP cache capacity */
+#define BENCH_WARMUPS  8       /* most passes spent filling the ARP cache */
+
+extern char* optarg;
+
+/* -- one frame of the capture -- */
+struct bench_frame
+{
+    uint8_t* data;
+    unsigned int len;
+};
+
+#ifdef _LINUX_
+/* -- heap allocations, counted with the linker's --wrap (see Makefile) -- */
+static unsigned long bench_heap_allocs;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+    __atomic_fetch_add(&bench_heap_allocs, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size)
+{
+    __atomic_fetch_add(&bench_heap_allocs, 1, __ATOMIC_RELAXED);
+    return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+    __atomic_fetch_add(&bench_heap_allocs, 1, __ATOMIC_RELAXED);
+    return __real_realloc(ptr, size);
+}
+#endif /* _LINUX_ */
+
+static void usage(char* argv0)
+{
+    printf("Format: %s -r routing table -p pcap file \n", argv0);
+    printf("           [-i name=ip/masklen ...] [-I ingress interface] \n");
+    printf("           [-n passes] [-f trie|dir24] [-a arp entries] [-k] [-v] \n");
+    printf("   -k keeps the destination MACs in the file, otherwise frames\n");
+    printf("      are addressed to the ingress interface\n");
+    printf("   -v keeps the router's own output\n");
+}
+
+static uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*---------------------------------------------------------------------
+ * Method: bench_load_pcap(..)
+ * Scope:  Local
+ *
+ * Read every frame of a pcap file into memory.  Returns the number of
+ * frames, -1 on error.
+ *
+ *---------------------------------------------------------------------*/
+
+static int bench_load_pcap(const char* path, struct bench_frame** frames_out)
+{
+    struct pcap_file_header fh;
+    struct pcap_sf_pkthdr ph;
+    struct bench_frame* frames = 0;
+    int n = 0, cap = 0;
+    FILE* fp;
+
+    fp = fopen(path, "rb");
+    if(fp == 0)
+    {
+        perror(path);
+        return -1;
+    }
+    if(fread(&fh, sizeof(fh), 1, fp) != 1 || fh.magic != TCPDUMP_MAGIC ||
+       fh.linktype != LINKTYPE_ETHERNET)
+    {
+        fprintf(stderr, "%s: not an Ethernet pcap file in host byte order\n", path);
+        fclose(fp);
+        return -1;
+    }
+
+    while(fread(&ph, sizeof(ph), 1, fp) == 1)
+    {
+        if(ph.caplen > BENCH_FRAME_MAX)
+        {
+            fprintf(stderr, "%s: frame %d is %u bytes\n", path, n, ph.caplen);
+            break;
+        }
+        if(n == cap)
+        {
+            cap = cap ? 2 * cap : 1024;
+            frames = (struct bench_frame*)realloc(frames, cap * sizeof(*frames));
+            assert(frames);
+        }
+        frames[n].len = ph.caplen;
+        frames[n].data = (uint8_t*)malloc(ph.caplen ? ph.caplen : 1);
+        assert(frames[n].data);
+        if(fread(frames[n].data, 1, ph.caplen, fp) != ph.caplen)
+        {
+            fprintf(stderr, "%s: truncated frame %d\n", path, n);
+            free(frames[n].data);
+            break;
+        }
+        n++;
+    }
+    fclose(fp);
+
+    *frames_out = frames;
+    return n;
+} /* -- bench_load_pcap -- */
+
+/*---------------------------------------------------------------------
+ * Method: bench_add_if(..)
+ * Scope:  Local
+ *
+ * Add interface name with a made up MAC, 02:00:00:00:00:<position>.
+ *
+ *---------------------------------------------------------------------*/
+
+static void bench_add_if(struct sr_instance* sr, const char* name,
+                         uint32_t ip, uint32_t mask)
+{
+    static unsigned char nifs = 0;
+    unsigned char mac[ETHER_ADDR_LEN] = { 0x02, 0, 0, 0, 0, 0 };
+
+    mac[5] = ++nifs;
+    sr_add_interface(sr, name);
+    sr_set_ether_addr(sr, mac);
+    sr_set_ether_ip(sr, ip);
+    sr_set_ether_mask(sr, mask);
+    sr_add_interface_status(sr, name);
+}
+
+/* -- parse name=a.b.c.d/len -- */
+static int bench_parse_if(struct sr_instance* sr, const char* spec)
+{
+    char name[sr_IFACE_NAMELEN];
+    char addr[32];
+    unsigned int len = 24;
+    struct in_addr ip;
+
+    if(sscanf(spec, "%31[^=]=%31[^/]/%u", name, addr, &len) < 2 ||
+       inet_aton(addr, &ip) == 0 || len > 32)
+    { return -1; }
+    bench_add_if(sr, name, ip.s_addr, len ? htonl(~0U << (32 - len)) : 0);
+    return 0;
+}
+
+/*---------------------------------------------------------------------
+ * Method: bench_synth_ifs(..)
+ * Scope:  Local
+ *
+ * Make up every interface the routing table uses that -i did not give.
+ * The address is .1 of the first directly connected route out of it, or
+ * 10.255.<n>.1/24 if it has none.
+ *
+ *---------------------------------------------------------------------*/
+
+static void bench_synth_ifs(struct sr_instance* sr)
+{
+    struct sr_rt* rt;
+    struct sr_rt* conn;
+    unsigned int n = 0;
+
+    for(rt = sr->routing_table; rt; rt = rt->next)
+    {
+        if(sr_get_interface(sr, rt->interface))
+        { continue; }
+        for(conn = sr->routing_table; conn; conn = conn->next)
+        {
+            if(strcmp(conn->interface, rt->interface) == 0 &&
+               conn->gw.s_addr == 0 && conn->mask.s_addr != 0 &&
+               conn->mask.s_addr != 0xffffffff)
+            { break; }
+        }
+        if(conn)
+        {
+            bench_add_if(sr, rt->interface,
+                         (conn->dest.s_addr & conn->mask.s_addr) | htonl(1),
+                         conn->mask.s_addr);
+        }
+        else
+        {
+            bench_add_if(sr, rt->interface, htonl(0x0aff0001 | (++n << 8)),
+                         htonl(0xffffff00));
+        }
+    }
+}
+
+/*---------------------------------------------------------------------
+ * Method: bench_resolve_arp(..)
+ * Scope:  Local
+ *
+ * Answer every outstanding ARP request with a made up MAC, as if the
+ * neighbours had replied.  The frames queued on them are dropped.
+ * Returns the number of neighbours added.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int bench_resolve_arp(struct sr_instance* sr)
+{
+    struct sr_arpreq* req;
+    uint32_t ips[1024];
+    unsigned char mac[ETHER_ADDR_LEN] = { 0x02, 0xee, 0, 0, 0, 0 };
+    unsigned int n = 0, i;
+
+    pthread_mutex_lock(&(sr->cache.lock));
+    for(req = sr->cache.requests; req && n < 1024; req = req->next)
+    { ips[n++] = req->ip; }
+    pthread_mutex_unlock(&(sr->cache.lock));
+
+    for(i = 0; i < n; i++)
+    {
+        memcpy(mac + 2, &(ips[i]), 4);
+        req = sr_arpcache_insert(&(sr->cache), mac, ips[i]);
+        if(req)
+        { sr_arpreq_destroy(&(sr->cache), req); }
+    }
+    return n;
+}
+
+static unsigned long bench_slab_allocs(void)
+{
+    struct sr_slab_stats st;
+    unsigned long total = 0;
+    unsigned int c;
+
+    for(c = 0; c <= SR_SLAB_NCLASSES; c++)
+    {
+        sr_slab_get_stats(c, &st);
+        total += st.allocs;
+    }
+    return total;
+}
+
+static int bench_cmp_u32(const void* a, const void* b)
+{
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+/*-----------------------------------------------------------------------------
+ *---------------------------------------------------------------------------*/
+
+int main(int argc, char** argv)
+{
+    struct sr_instance sr;
+    struct bench_frame* frames = 0;
+    uint8_t* work;
+    uint32_t* samples;
+    char* rtable = 0;
+    char* pcap = 0;
+    char* ingress = 0;
+    struct sr_if* in_if;
+    unsigned int passes = 0;
+    unsigned long nsamples, k, slab0, heap0 = 0, heap1 = 0, sink0;
+    int keep_macs = 0, verbose = 0;
+    int fib_mode = SR_FIB_TRIE;
+    int nframes, i, c, saved_stdout = -1, saved_stderr = -1, devnull;
+    unsigned int arpcache_sz = BENCH_ARP_SZ;
+    unsigned int p, n, nresolved = 0;
+    uint64_t t0, t1, busy = 0, wall;
+    double secs;
+
+    memset(&sr, 0, sizeof(sr));
+
+    while((c = getopt(argc, argv, "hr:p:i:I:n:f:a:kv")) != EOF)
+    {
+        switch(c)
+        {
+            case 'r':
+                rtable = optarg;
+                break;
+            case 'p':
+                pcap = optarg;
+                break;
+            case 'i':
+                if(bench_parse_if(&sr, optarg) != 0)
+                {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'I':
+                ingress = optarg;
+                break;
+            case 'n':
+                passes = atoi(optarg);
+                break;
+            case 'f':
+                fib_mode = (strcmp(optarg, "dir24") == 0) ? SR_FIB_DIR24 : SR_FIB_TRIE;
+                break;
+            case 'a':
+                arpcache_sz = atoi(optarg);
+                break;
+            case 'k':
+                keep_macs = 1;
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            default:
+                usage(argv[0]);
+                exit(c == 'h' ? 0 : 1);
+        }
+    }
+    if(rtable == 0 || pcap == 0)
+    {
+        usage(argv[0]);
+        exit(1);
+    }
+
+    /* -- an instance with no server and no threads -- */
+    sr_bench_instance(&sr);
+    sr.fib_mode = fib_mode;
+    sr.arpcache_sz = arpcache_sz;
+
+    if(sr_load_rt(&sr, rtable) != 0)
+    {
+        fprintf(stderr, "Error setting up routing table from file %s\n", rtable);
+        exit(1);
+    }
+    bench_synth_ifs(&sr);
+    if(sr.if_list == 0)
+    {
+        fprintf(stderr, "no interfaces: the routing table is empty and -i not given\n");
+        exit(1);
+    }
+    in_if = ingress ? sr_get_interface(&sr, ingress) : sr.if_list;
+    if(in_if == 0)
+    {
+        fprintf(stderr, "no interface %s\n", ingress);
+        exit(1);
+    }
+    sr_init(&sr);
+
+    nframes = bench_load_pcap(pcap, &frames);
+    if(nframes <= 0)
+    {
+        fprintf(stderr, "%s: no frames\n", pcap);
+        exit(1);
+    }
+    for(i = 0; i < nframes && !keep_macs; i++)
+    {
+        if(frames[i].len >= sizeof(sr_ethernet_hdr_t))
+        { memcpy(((sr_ethernet_hdr_t*)frames[i].data)->ether_dhost, in_if->addr, ETHER_ADDR_LEN); }
+    }
+    if(passes == 0)
+    { passes = (BENCH_SAMPLES + nframes - 1) / nframes; }
+    nsamples = (unsigned long)passes * nframes;
+    samples = (uint32_t*)malloc(nsamples * sizeof(uint32_t));
+    work = (uint8_t*)malloc(BENCH_FRAME_MAX);
+    assert(samples && work);
+
+    if(!verbose)
+    {
+        fflush(stdout);
+        fflush(stderr);
+        saved_stdout = dup(1);
+        saved_stderr = dup(2);
+        devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, 1);
+        dup2(devnull, 2);
+        close(devnull);
+        setvbuf(stderr, 0, _IOFBF, BUFSIZ);
+    }
+
+    /* -- warm up: untimed passes, answering the ARP requests they make -- */
+    for(p = 0; p < BENCH_WARMUPS; p++)
+    {
+        for(i = 0; i < nframes; i++)
+        {
+            memcpy(work, frames[i].data, frames[i].len);
+            sr_handlepacket(&sr, work, frames[i].len, in_if->ifindex);
+        }
+        n = bench_resolve_arp(&sr);
+        nresolved += n;
+        if(n == 0)
+        { break; }
+    }
+
+    sink0 = sr_bench_sink.frames;
+    slab0 = bench_slab_allocs();
+#ifdef _LINUX_
+    heap0 = __atomic_load_n(&bench_heap_allocs, __ATOMIC_RELAXED);
+#endif
+
+    k = 0;
+    wall = bench_now_ns();
+    for(p = 0; p < passes; p++)
+    {
+        for(i = 0; i < nframes; i++)
+        {
+            memcpy(work, frames[i].data, frames[i].len);
+            t0 = bench_now_ns();
+            sr_handlepacket(&sr, work, frames[i].len, in_if->ifindex);
+            t1 = bench_now_ns();
+            samples[k++] = (uint32_t)(t1 - t0);
+            busy += t1 - t0;
+        }
+    }
+    wall = bench_now_ns() - wall;
+
+#ifdef _LINUX_
+    heap1 = __atomic_load_n(&bench_heap_allocs, __ATOMIC_RELAXED);
+#endif
+
+    if(!verbose)
+    {
+        fflush(stdout);
+        fflush(stderr);
+        dup2(saved_stdout, 1);
+        dup2(saved_stderr, 2);
+        close(saved_stdout);
+        close(saved_stderr);
+        setvbuf(stderr, 0, _IONBF, 0);
+    }
+
+    qsort(samples, nsamples, sizeof(uint32_t), bench_cmp_u32);
+    secs = busy / 1e9;
+
+    printf("frames in %s: %d, passes: %u, warm up resolved %u neighbours\n",
+           pcap, nframes, passes, nresolved);
+    printf("handled %lu frames, sent %lu, in %.3f s (%.3f s wall)\n",
+           nsamples, sr_bench_sink.frames - sink0, secs, wall / 1e9);
+    printf("throughput: %.0f frames/s (%.0f frames/s wall)\n",
+           nsamples / secs, nsamples / (wall / 1e9));
+    printf("ns/frame: min %u p50 %u p90 %u p99 %u p99.9 %u max %u, mean %.1f\n",
+           samples[0], samples[nsamples / 2], samples[nsamples * 9 / 10],
+           samples[nsamples * 99 / 100], samples[nsamples * 999 / 1000],
+           samples[nsamples - 1], (double)busy / nsamples);
+    printf("allocations/frame: slab %.3f",
+           (double)(bench_slab_allocs() - slab0) / nsamples);
+#ifdef _LINUX_
+    printf(", heap %.3f", (double)(heap1 - heap0) / nsamples);
+#endif
+    printf("\n");
+
+    for(i = 0; i < nframes; i++)
+    { free(frames[i].data); }
+    free(frames);
+    free(samples);
+    free(work);
+    return 0;
+}/* -- main -- */
@@ -0,0 +1,31 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_bench_common.h
+ *
+ * Description:
+ *
+ * What sr_bench.c and sr_microbench.c share: a sink transport that
+ * counts what the router sends instead of putting it on a network, and
+ * an instance set up to use it, with no server and no threads.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef sr_BENCH_COMMON_H
+#define sr_BENCH_COMMON_H
+
+#include "sr_transport.h"
+
+struct sr_instance;
+
+/* -- what the router sent -- */
+struct sr_bench_sink
+{
+    unsigned long frames;
+    unsigned long bytes;
+};
+
+extern struct sr_bench_sink sr_bench_sink;
+extern const struct sr_transport_ops sr_bench_sink_transport;
+
+void sr_bench_instance(struct sr_instance* sr);
+
+#endif  /* --  sr_BENCH_COMMON_H -- */
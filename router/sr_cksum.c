@@ -0,0 +1,199 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_cksum.c
+ *
+ * Description:
+ *
+ * Scalar, SSE2 and AVX2 Internet checksum kernels.  The vector kernels
+ * zero-extend 16 bit words into 32 bit lanes and add them up; lanes are
+ * spilled into a 64 bit total before they could overflow, and the total
+ * is folded back to 16 bits at the end.  One's complement addition is
+ * byte order independent, so no swapping is needed anywhere.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SR_CKSUM_X86
+#include <immintrin.h>
+#endif
+
+#include "sr_cksum.h"
+
+/* -- vector iterations between spills, keeps 32 bit lanes from overflowing -- */
+#define SPILL_ITERS 4096
+
+static uint32_t cksum_fold16(uint64_t sum)
+{
+    sum = (sum & 0xffffffffU) + (sum >> 32);
+    sum = (sum & 0xffffffffU) + (sum >> 32);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return (uint32_t)sum;
+}
+
+static uint32_t cksum_partial_scalar(const void* _data, int len, uint32_t sum)
+{
+    const uint8_t* data = _data;
+    uint64_t total = sum;
+    uint32_t w32;
+    uint16_t w16;
+
+    for(; len >= 4; data += 4, len -= 4)
+    {
+        memcpy(&w32, data, 4);
+        total += w32;
+    }
+    if(len >= 2)
+    {
+        memcpy(&w16, data, 2);
+        total += w16;
+        data += 2;
+        len -= 2;
+    }
+    if(len > 0)
+    {
+        /* -- odd byte goes first in its word, padded with zero -- */
+        w16 = 0;
+        memcpy(&w16, data, 1);
+        total += w16;
+    }
+
+    return cksum_fold16(total);
+}
+
+#ifdef SR_CKSUM_X86
+
+__attribute__ ((target ("sse2")))
+static uint32_t cksum_partial_sse2(const void* _data, int len, uint32_t sum)
+{
+    const uint8_t* data = _data;
+    uint64_t total = sum;
+    uint32_t lanes[4];
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc, v;
+    int i;
+
+    while(len >= 16)
+    {
+        acc = _mm_setzero_si128();
+        for(i = 0; i < SPILL_ITERS && len >= 16; i++, data += 16, len -= 16)
+        {
+            v = _mm_loadu_si128((const __m128i*)data);
+            acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+            acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+        }
+        _mm_storeu_si128((__m128i*)lanes, acc);
+        total += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+
+    return cksum_partial_scalar(data, len, cksum_fold16(total));
+}
+
+__attribute__ ((target ("avx2")))
+static uint32_t cksum_partial_avx2(const void* _data, int len, uint32_t sum)
+{
+    const uint8_t* data = _data;
+    uint64_t total = sum;
+    uint32_t lanes[8];
+    __m256i zero = _mm256_setzero_si256();
+    __m256i acc, v;
+    int i;
+
+    while(len >= 32)
+    {
+        acc = _mm256_setzero_si256();
+        for(i = 0; i < SPILL_ITERS && len >= 32; i++, data += 32, len -= 32)
+        {
+            v = _mm256_loadu_si256((const __m256i*)data);
+            acc = _mm256_add_epi32(acc, _mm256_unpacklo_epi16(v, zero));
+            acc = _mm256_add_epi32(acc, _mm256_unpackhi_epi16(v, zero));
+        }
+        _mm256_storeu_si256((__m256i*)lanes, acc);
+        total += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3] +
+                 lanes[4] + lanes[5] + lanes[6] + lanes[7];
+    }
+
+    return cksum_partial_scalar(data, len, cksum_fold16(total));
+}
+
+#endif /* SR_CKSUM_X86 */
+
+typedef uint32_t (*cksum_partial_fn)(const void*, int, uint32_t);
+
+static cksum_partial_fn cksum_partial_impl = 0;
+static const char* cksum_impl = "scalar";
+
+/* -- pick a kernel once; racing callers all pick the same one -- */
+static cksum_partial_fn cksum_resolve(void)
+{
+    cksum_partial_fn fn = cksum_partial_scalar;
+    const char* name = "scalar";
+
+#ifdef SR_CKSUM_X86
+    __builtin_cpu_init();
+    if(__builtin_cpu_supports("avx2"))
+    {
+        fn = cksum_partial_avx2;
+        name = "avx2";
+    }
+    else if(__builtin_cpu_supports("sse2"))
+    {
+        fn = cksum_partial_sse2;
+        name = "sse2";
+    }
+#endif /* SR_CKSUM_X86 */
+
+    cksum_impl = name;
+    __atomic_store_n(&cksum_partial_impl, fn, __ATOMIC_RELEASE);
+    return fn;
+}
+
+uint32_t cksum_partial(const void* data, int len, uint32_t sum)
+{
+    cksum_partial_fn fn;
+
+    if(len < SR_CKSUM_SIMD_MIN)
+    { return cksum_partial_scalar(data, len, sum); }
+
+    fn = __atomic_load_n(&cksum_partial_impl, __ATOMIC_ACQUIRE);
+    if(fn == 0)
+    { fn = cksum_resolve(); }
+    return fn(data, len, sum);
+}
+
+uint16_t cksum_fold(uint32_t sum)
+{
+    uint16_t folded = (uint16_t)~cksum_fold16(sum);
+
+    return folded ? folded : 0xffff;
+}
+
+/*---------------------------------------------------------------------
+ * Method: cksum_update16(..)
+ * Scope:  Global
+ *
+ * HC' = ~(~HC + ~m + m'), the form RFC 1624 recommends over the one in
+ * RFC 1141, which goes wrong when the checksum ends up as 0.
+ *
+ *---------------------------------------------------------------------*/
+
+uint16_t cksum_update16(uint16_t cksum, uint16_t old_word, uint16_t new_word)
+{
+    uint32_t sum = (uint16_t)~cksum;
+
+    sum += (uint16_t)~old_word;
+    sum += new_word;
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    return (uint16_t)~sum;
+}
+
+const char* cksum_impl_name(void)
+{
+    if(__atomic_load_n(&cksum_partial_impl, __ATOMIC_ACQUIRE) == 0)
+    { cksum_resolve(); }
+    return cksum_impl;
+}
@@ -0,0 +1,44 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_cksum.h
+ *
+ * Description:
+ *
+ * Internet checksum (RFC 1071) building blocks behind cksum() in
+ * sr_utils.c.  The 16 bit one's complement sum is computed on words as
+ * they sit in memory, so results can be stored into headers as is.  On
+ * x86 the bulk of the data is summed with SSE2 or AVX2, selected at
+ * runtime from the CPU features; other machines use the scalar loop.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef sr_CKSUM_H
+#define sr_CKSUM_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+/* -- buffers shorter than this are not worth a vector loop -- */
+#define SR_CKSUM_SIMD_MIN 64
+
+/* Adds len bytes at data to the running sum and returns the new running
+   sum.  Every call but the last must cover an even number of bytes. */
+uint32_t cksum_partial(const void* data, int len, uint32_t sum);
+
+/* Folds a running sum into the checksum field value; as cksum(), returns
+   0xffff rather than 0. */
+uint16_t cksum_fold(uint32_t sum);
+
+/* RFC 1624 eqn. 3: the checksum after one 16 bit word covered by it
+   changed from old_word to new_word, all three as stored in the packet. */
+uint16_t cksum_update16(uint16_t cksum, uint16_t old_word, uint16_t new_word);
+
+/* Name of the implementation picked for this CPU: "avx2", "sse2" or
+   "scalar". */
+const char* cksum_impl_name(void);
+
+#endif  /* --  sr_CKSUM_H -- */
@@ -0,0 +1,428 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_event.c
+ *
+ * Description:
+ *
+ * epoll and timerfd event loop for sr_event.h.  Linux only; elsewhere
+ * sr_event_loop_init() fails and the router keeps its threads.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "sr_event.h"
+#include "sr_router.h"
+#include "sr_arpcache.h"
+#include "sr_rt.h"
+#include "sr_slab.h"
+
+#ifdef _LINUX_
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* -- a connection on the control socket -- */
+struct sr_ctl_client
+{
+    struct sr_event ev;
+    unsigned int len;
+    char buf[SR_EVENT_CTL_BUF];
+};
+
+/*---------------------------------------------------------------------
+ * Method: sr_event_add(..)
+ * Scope:  Global
+ *
+ * Watch fd for events and call fn(loop, arg, events) when any occur.
+ * Returns 0 on success, -1 on error.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_event_add(struct sr_event_loop* loop, struct sr_event* ev, int fd,
+                 uint32_t events, sr_event_fn fn, void* arg)
+{
+    struct epoll_event eev;
+
+    ev->fd  = fd;
+    ev->fn  = fn;
+    ev->arg = arg;
+
+    memset(&eev, 0, sizeof(eev));
+    eev.events   = events;
+    eev.data.ptr = ev;
+    if(epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &eev) != 0)
+    {
+        perror("epoll_ctl");
+        return -1;
+    }
+    return 0;
+} /* -- sr_event_add -- */
+
+void sr_event_del(struct sr_event_loop* loop, struct sr_event* ev)
+{
+    if(ev->fd < 0)
+    { return; }
+    epoll_ctl(loop->epfd, EPOLL_CTL_DEL, ev->fd, 0);
+    ev->fd = -1;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_event_add_timer(..)
+ * Scope:  Global
+ *
+ * Call fn every period_ms milliseconds, first period_ms from now.  The
+ * timer is a timerfd owned by ev; the handler must read it.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_event_add_timer(struct sr_event_loop* loop, struct sr_event* ev,
+                       unsigned int period_ms, sr_event_fn fn, void* arg)
+{
+    struct itimerspec its;
+    int fd;
+
+    fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(fd < 0)
+    {
+        perror("timerfd_create");
+        return -1;
+    }
+
+    its.it_interval.tv_sec  = period_ms / 1000;
+    its.it_interval.tv_nsec = (long)(period_ms % 1000) * 1000000L;
+    its.it_value = its.it_interval;
+    if(timerfd_settime(fd, 0, &its, 0) != 0 ||
+       sr_event_add(loop, ev, fd, EPOLLIN, fn, arg) != 0)
+    {
+        close(fd);
+        ev->fd = -1;
+        return -1;
+    }
+    return 0;
+} /* -- sr_event_add_timer -- */
+
+/* -- number of times a timer expired since it was last read -- */
+static uint64_t sr_event_timer_read(int fd)
+{
+    uint64_t expirations = 0;
+
+    if(read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+    { return 0; }
+    return expirations;
+}
+
+static void sr_event_server(struct sr_event_loop* loop, void* arg,
+                            uint32_t events)
+{
+    if(sr_read_from_server(loop->sr) != 1)
+    { loop->running = 0; }
+}
+
+static void sr_event_arp_tick(struct sr_event_loop* loop, void* arg,
+                              uint32_t events)
+{
+    if(sr_event_timer_read(loop->arp_timer.fd))
+    { sr_arpcache_tick(loop->sr); }
+}
+
+static void sr_event_rip_tick(struct sr_event_loop* loop, void* arg,
+                              uint32_t events)
+{
+    if(sr_event_timer_read(loop->rip_timer.fd))
+    { sr_rip_tick(loop->sr); }
+}
+
+/*---------------------------------------------------------------------
+ * Control socket
+ *---------------------------------------------------------------------*/
+
+static void sr_ctl_close(struct sr_event_loop* loop, struct sr_ctl_client* client)
+{
+    int fd = client->ev.fd;
+
+    sr_event_del(loop, &(client->ev));
+    close(fd);
+    free(client);
+}
+
+static void sr_ctl_command(struct sr_event_loop* loop, int fd, const char* cmd)
+{
+    FILE* out;
+    struct sr_if* iface;
+    char name[32];
+    char state[8];
+    int out_fd = dup(fd);
+
+    if(out_fd < 0 || (out = fdopen(out_fd, "w")) == 0)
+    {
+        if(out_fd >= 0)
+        { close(out_fd); }
+        return;
+    }
+
+    if(strcmp(cmd, "stats") == 0)
+    {
+        sr_slab_print_stats(out);
+        if(loop->sr->icmp_rl.src_slots)
+        { sr_ratelimit_print_stats(&(loop->sr->icmp_rl), out); }
+        fprintf(out, "queued for ARP: %u\n", loop->sr->cache.pkt_used);
+        loop->sr->transport->print_stats(loop->sr, out);
+    }
+    else if(strcmp(cmd, "arp") == 0)
+    {
+        sr_arpcache_fprint(&(loop->sr->cache), out);
+        fprintf(out, "ok\n");
+    }
+    else if(strcmp(cmd, "routes") == 0)
+    {
+        sr_fprint_routing_table(loop->sr, out);
+        fprintf(out, "ok\n");
+    }
+    else if(strcmp(cmd, "rip") == 0)
+    { sr_rip_print_stats(loop->sr, out); }
+    else if(sscanf(cmd, "link %31s %7s", name, state) == 2 &&
+            (strcmp(state, "up") == 0 || strcmp(state, "down") == 0))
+    {
+        iface = sr_get_interface(loop->sr, name);
+        if(iface)
+        {
+            sr_rip_link_changed(loop->sr, iface->ifindex, strcmp(state, "up") == 0);
+            fprintf(out, "ok\n");
+        }
+        else
+        { fprintf(out, "unknown interface %s\n", name); }
+    }
+    else if(strcmp(cmd, "quit") == 0)
+    {
+        loop->running = 0;
+        fprintf(out, "ok\n");
+    }
+    else if(cmd[0])
+    { fprintf(out, "unknown command %s\n", cmd); }
+
+    fclose(out);
+} /* -- sr_ctl_command -- */
+
+static void sr_ctl_read(struct sr_event_loop* loop, void* arg, uint32_t events)
+{
+    struct sr_ctl_client* client = (struct sr_ctl_client*)arg;
+    char* nl;
+    ssize_t n;
+
+    n = read(client->ev.fd, client->buf + client->len,
+             sizeof(client->buf) - 1 - client->len);
+    if(n <= 0)
+    {
+        if(n < 0 && (errno == EAGAIN || errno == EINTR))
+        { return; }
+        sr_ctl_close(loop, client);
+        return;
+    }
+    client->len += n;
+    client->buf[client->len] = 0;
+
+    while((nl = strchr(client->buf, '\n')) != 0)
+    {
+        *nl = 0;
+        if(nl > client->buf && nl[-1] == '\r')
+        { nl[-1] = 0; }
+        sr_ctl_command(loop, client->ev.fd, client->buf);
+        client->len -= (nl + 1) - client->buf;
+        memmove(client->buf, nl + 1, client->len + 1);
+    }
+
+    /* -- a line that does not fit is not a command -- */
+    if(client->len == sizeof(client->buf) - 1)
+    { sr_ctl_close(loop, client); }
+} /* -- sr_ctl_read -- */
+
+static void sr_ctl_accept(struct sr_event_loop* loop, void* arg, uint32_t events)
+{
+    struct sr_ctl_client* client;
+    int fd;
+
+    fd = accept(loop->ctl.fd, 0, 0);
+    if(fd < 0)
+    { return; }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    client = (struct sr_ctl_client*)malloc(sizeof(struct sr_ctl_client));
+    if(client == 0)
+    {
+        close(fd);
+        return;
+    }
+    client->len = 0;
+    if(sr_event_add(loop, &(client->ev), fd, EPOLLIN, sr_ctl_read, client) != 0)
+    {
+        close(fd);
+        free(client);
+    }
+} /* -- sr_ctl_accept -- */
+
+static int sr_ctl_listen(struct sr_event_loop* loop, const char* path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if(strlen(path) >= sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "control socket path too long: %s\n", path);
+        return -1;
+    }
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+    {
+        perror("socket");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+    if(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 4) != 0)
+    {
+        perror("control socket");
+        close(fd);
+        return -1;
+    }
+
+    if(sr_event_add(loop, &(loop->ctl), fd, EPOLLIN, sr_ctl_accept, 0) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return 0;
+} /* -- sr_ctl_listen -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_event_loop_init(..)
+ * Scope:  Global
+ *
+ * Set up the loop for a router that is connected to the server.  The
+ * control socket is only created if ctl_path is not 0.  Returns 0 on
+ * success, -1 on error.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_event_loop_init(struct sr_event_loop* loop, struct sr_instance* sr,
+                       const char* ctl_path)
+{
+    assert(loop);
+    assert(sr);
+
+    loop->sr = sr;
+    loop->running = 0;
+    loop->ctl_path = ctl_path;
+    loop->server.fd = -1;
+    loop->arp_timer.fd = -1;
+    loop->rip_timer.fd = -1;
+    loop->ctl.fd = -1;
+
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if(loop->epfd < 0)
+    {
+        perror("epoll_create1");
+        return -1;
+    }
+
+    if(sr_event_add(loop, &(loop->server), sr->sockfd, EPOLLIN,
+                    sr_event_server, 0) != 0 ||
+       sr_event_add_timer(loop, &(loop->arp_timer), SR_ARPCACHE_TICK_MS,
+                          sr_event_arp_tick, 0) != 0 ||
+       sr_event_add_timer(loop, &(loop->rip_timer), SR_EVENT_RIP_MS,
+                          sr_event_rip_tick, 0) != 0 ||
+       (ctl_path && sr_ctl_listen(loop, ctl_path) != 0))
+    {
+        sr_event_loop_destroy(loop);
+        return -1;
+    }
+    return 0;
+} /* -- sr_event_loop_init -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_event_loop_run(..)
+ * Scope:  Global
+ *
+ * Dispatch events until the server connection closes or the control
+ * socket asks to quit.  Returns 0 then, -1 if epoll fails.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_event_loop_run(struct sr_event_loop* loop)
+{
+    struct epoll_event events[SR_EVENT_MAX];
+    struct sr_event* ev;
+    int i, n;
+
+    loop->running = 1;
+    while(loop->running)
+    {
+        n = epoll_wait(loop->epfd, events, SR_EVENT_MAX, -1);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            { continue; }
+            perror("epoll_wait");
+            return -1;
+        }
+
+        for(i = 0; i < n && loop->running; i++)
+        {
+            ev = (struct sr_event*)events[i].data.ptr;
+            ev->fn(loop, ev->arg, events[i].events);
+        }
+
+        /* -- everything this iteration sent goes out in one write -- */
+        sr_flush_packets(loop->sr);
+    }
+    return 0;
+} /* -- sr_event_loop_run -- */
+
+void sr_event_loop_destroy(struct sr_event_loop* loop)
+{
+    /* -- the server socket belongs to the instance -- */
+    sr_event_del(loop, &(loop->server));
+
+    if(loop->arp_timer.fd >= 0)
+    { close(loop->arp_timer.fd); }
+    if(loop->rip_timer.fd >= 0)
+    { close(loop->rip_timer.fd); }
+    if(loop->ctl.fd >= 0)
+    {
+        close(loop->ctl.fd);
+        unlink(loop->ctl_path);
+    }
+    loop->arp_timer.fd = loop->rip_timer.fd = loop->ctl.fd = -1;
+
+    if(loop->epfd >= 0)
+    { close(loop->epfd); }
+    loop->epfd = -1;
+}
+
+#else /* -- no epoll -- */
+
+int sr_event_loop_init(struct sr_event_loop* loop, struct sr_instance* sr,
+                       const char* ctl_path)
+{
+    fprintf(stderr, "event loop needs epoll, not available on this system\n");
+    return -1;
+}
+
+int sr_event_loop_run(struct sr_event_loop* loop)
+{ return -1; }
+
+void sr_event_loop_destroy(struct sr_event_loop* loop)
+{ }
+
+#endif /* _LINUX_ */
@@ -0,0 +1,77 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_event.h
+ *
+ * Description:
+ *
+ * Single threaded event loop built on epoll.  It multiplexes the socket
+ * to the VNS server, timerfd timers that replace the ARP and RIP threads,
+ * and an optional UNIX domain control socket.  In this mode nothing else
+ * touches the router state, so all of its locks are uncontended and the
+ * time between a packet arriving and being handled does not depend on
+ * what other threads are doing.
+ *
+ * Control socket commands, one per line: "stats", "arp", "routes",
+ * "rip", "link <interface> up|down" and "quit".
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef sr_EVENT_H
+#define sr_EVENT_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_EVENT_MAX      16    /* events handled per epoll_wait */
+#define SR_EVENT_RIP_MS   SR_RIP_TICK_MS  /* RIP timer period, see sr_rt.h */
+#define SR_EVENT_CTL_BUF  128   /* longest control command */
+
+struct sr_instance;
+struct sr_event_loop;
+
+typedef void (*sr_event_fn)(struct sr_event_loop* loop, void* arg,
+                            uint32_t events);
+
+/* ----------------------------------------------------------------------------
+ * struct sr_event
+ *
+ * One file descriptor watched by the loop.  Embedded in its owner; the
+ * pointer is the epoll user data.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_event
+{
+    int fd;
+    sr_event_fn fn;
+    void* arg;
+};
+
+struct sr_event_loop
+{
+    int epfd;
+    int running;
+    struct sr_instance* sr;
+    struct sr_event server;     /* VNS socket */
+    struct sr_event arp_timer;
+    struct sr_event rip_timer;
+    struct sr_event ctl;        /* listening control socket, fd -1 if none */
+    const char* ctl_path;
+};
+
+int  sr_event_add(struct sr_event_loop* loop, struct sr_event* ev, int fd,
+                  uint32_t events, sr_event_fn fn, void* arg);
+void sr_event_del(struct sr_event_loop* loop, struct sr_event* ev);
+int  sr_event_add_timer(struct sr_event_loop* loop, struct sr_event* ev,
+                        unsigned int period_ms, sr_event_fn fn, void* arg);
+
+int  sr_event_loop_init(struct sr_event_loop* loop, struct sr_instance* sr,
+                        const char* ctl_path);
+int  sr_event_loop_run(struct sr_event_loop* loop);
+void sr_event_loop_destroy(struct sr_event_loop* loop);
+
+#endif  /* --  sr_EVENT_H -- */
@@ -0,0 +1,499 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fib.c
+ *
+ * Description:
+ *
+ * Path-compressed binary trie for longest prefix match.  Only nodes that
+ * either carry a route or branch into two subtrees are stored, so the
+ * depth of the trie is bounded by 32 and in practice by the number of
+ * distinct prefix lengths on the lookup path.
+ *
+ * In SR_FIB_DIR24 mode the same entry points maintain a DIR-24-8-BASIC
+ * table instead (see sr_fib.h).
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sr_fib.h"
+#include "sr_rt.h"
+
+/* -- mask covering the first len bits, host byte order -- */
+#define FIB_MASK(len) ((len) == 0 ? 0 : (0xffffffffU << (32 - (len))))
+
+/* -- bit number i (0 is the most significant) of x -- */
+#define FIB_BIT(x,i)  (((x) >> (31 - (i))) & 1)
+
+static struct sr_fib_node* sr_fib_node_new(struct sr_fib* fib,
+                                           uint32_t prefix, int len,
+                                           struct sr_rt* rt)
+{
+    struct sr_fib_node* node;
+
+    node = (struct sr_fib_node*)malloc(sizeof(struct sr_fib_node));
+    assert(node);
+    node->prefix   = prefix & FIB_MASK(len);
+    node->len      = len;
+    node->rt       = rt;
+    node->child[0] = 0;
+    node->child[1] = 0;
+    fib->nnodes++;
+    return node;
+}
+
+static void sr_fib_free_nodes(struct sr_fib_node* node)
+{
+    if(node == 0)
+    { return; }
+    sr_fib_free_nodes(node->child[0]);
+    sr_fib_free_nodes(node->child[1]);
+    free(node);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_masklen(..)
+ * Scope:  Global
+ *
+ * Number of leading one bits in a netmask given in network byte order.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_fib_masklen(uint32_t mask_nbo)
+{
+    uint32_t mask = ntohl(mask_nbo);
+    int len = 0;
+
+    while(len < 32 && (mask & 0x80000000U))
+    {
+        mask <<= 1;
+        len++;
+    }
+    return len;
+} /* -- sr_fib_masklen -- */
+
+void sr_fib_init(struct sr_fib* fib)
+{
+    assert(fib);
+
+    fib->mode      = SR_FIB_TRIE;
+    fib->root      = 0;
+    fib->nroutes   = 0;
+    fib->nnodes    = 0;
+    fib->tbl24     = 0;
+    fib->tbl8      = 0;
+    fib->tbl8_used = 0;
+    fib->tbl8_cap  = 0;
+    fib->nh        = 0;
+    fib->nh_len    = 0;
+    fib->nh_prefix = 0;
+    fib->nh_used   = 0;
+    fib->nh_cap    = 0;
+    fib->nh_hash   = 0;
+    fib->nh_hash_mask = 0;
+    fib->rts       = 0;
+    fib->nrts      = 0;
+}
+
+void sr_fib_flush(struct sr_fib* fib)
+{
+    struct sr_rt* rts;
+    unsigned int nrts;
+    int mode;
+
+    assert(fib);
+
+    mode = fib->mode;
+    rts  = fib->rts;
+    nrts = fib->nrts;
+    sr_fib_free_nodes(fib->root);
+    free(fib->tbl24);
+    free(fib->tbl8);
+    free(fib->nh);
+    free(fib->nh_len);
+    free(fib->nh_prefix);
+    free(fib->nh_hash);
+    sr_fib_init(fib);
+    fib->mode = mode;
+    fib->rts  = rts;
+    fib->nrts = nrts;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_create(..)
+ * Scope:  Global
+ *
+ * Build an immutable snapshot of a routing table list.  The snapshot
+ * copies every reachable entry (metric below INFINITY), so it stays
+ * valid whatever later happens to the list.  Returns 0 on failure.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_fib* sr_fib_create(int mode, struct sr_rt* table)
+{
+    struct sr_fib* fib;
+    struct sr_rt* rt_walker;
+    unsigned int i;
+
+    fib = (struct sr_fib*)malloc(sizeof(struct sr_fib));
+    assert(fib);
+    sr_fib_init(fib);
+    fib->mode = mode;
+
+    for(rt_walker = table; rt_walker; rt_walker = rt_walker->next)
+    {
+        if(rt_walker->metric < INFINITY)
+        { fib->nrts++; }
+    }
+
+    if(fib->nrts)
+    {
+        fib->rts = (struct sr_rt*)malloc(fib->nrts * sizeof(struct sr_rt));
+        assert(fib->rts);
+        for(i = 0, rt_walker = table; rt_walker; rt_walker = rt_walker->next)
+        {
+            if(rt_walker->metric >= INFINITY)
+            { continue; }
+            memcpy(&(fib->rts[i]), rt_walker, sizeof(struct sr_rt));
+            fib->rts[i].next = (i + 1 < fib->nrts) ? &(fib->rts[i + 1]) : 0;
+            i++;
+        }
+    }
+
+    if(sr_fib_build(fib, fib->rts) != 0)
+    {
+        sr_fib_destroy(fib);
+        return 0;
+    }
+    return fib;
+} /* -- sr_fib_create -- */
+
+void sr_fib_destroy(struct sr_fib* fib)
+{
+    if(fib == 0)
+    { return; }
+
+    free(fib->rts);
+    sr_fib_flush(fib);
+    free(fib);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_set_mode(..)
+ * Scope:  Global
+ *
+ * Switch the lookup structure and rebuild it from the routing table.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_fib_set_mode(struct sr_fib* fib, int mode, struct sr_rt* table)
+{
+    assert(fib);
+
+    if(mode != SR_FIB_TRIE && mode != SR_FIB_DIR24)
+    { return -1; }
+
+    sr_fib_flush(fib);
+    fib->mode = mode;
+    return sr_fib_build(fib, table);
+} /* -- sr_fib_set_mode -- */
+
+/* -- DIR-24-8 helpers -- */
+
+static uint32_t* sr_fib_dir24_slot(struct sr_fib* fib, uint32_t prefix, int len)
+{
+    uint32_t i = ((prefix ^ (uint32_t)len) * 0x9e3779b1U) & fib->nh_hash_mask;
+    uint32_t nh;
+
+    while((nh = fib->nh_hash[i]) != 0)
+    {
+        if(fib->nh_prefix[nh] == prefix && fib->nh_len[nh] == len)
+        { break; }
+        i = (i + 1) & fib->nh_hash_mask;
+    }
+    return &(fib->nh_hash[i]);
+}
+
+/* -- keep the (prefix, length) index at most half full -- */
+static void sr_fib_dir24_rehash(struct sr_fib* fib)
+{
+    uint32_t size = fib->nh_hash ? 2 * (fib->nh_hash_mask + 1) : 128;
+    uint32_t nh;
+
+    free(fib->nh_hash);
+    fib->nh_hash = (uint32_t*)calloc(size, sizeof(uint32_t));
+    assert(fib->nh_hash);
+    fib->nh_hash_mask = size - 1;
+    for(nh = 1; nh < fib->nh_used; nh++)
+    { *sr_fib_dir24_slot(fib, fib->nh_prefix[nh], fib->nh_len[nh]) = nh; }
+}
+
+static uint32_t sr_fib_dir24_nh(struct sr_fib* fib, struct sr_rt* rt,
+                                uint32_t prefix, int len)
+{
+    if(fib->nh_used == fib->nh_cap)
+    {
+        fib->nh_cap = fib->nh_cap ? fib->nh_cap * 2 : 64;
+        fib->nh = (struct sr_rt**)realloc(fib->nh,
+                fib->nh_cap * sizeof(struct sr_rt*));
+        fib->nh_len = (uint8_t*)realloc(fib->nh_len, fib->nh_cap);
+        fib->nh_prefix = (uint32_t*)realloc(fib->nh_prefix,
+                fib->nh_cap * sizeof(uint32_t));
+        assert(fib->nh && fib->nh_len && fib->nh_prefix);
+        if(fib->nh_used == 0)
+        {
+            /* -- index 0 means no route -- */
+            fib->nh[0] = 0;
+            fib->nh_len[0] = 0;
+            fib->nh_prefix[0] = 0;
+            fib->nh_used = 1;
+        }
+    }
+    if(fib->nh_hash == 0 || 2 * fib->nh_used >= fib->nh_hash_mask + 1)
+    { sr_fib_dir24_rehash(fib); }
+
+    fib->nh[fib->nh_used] = rt;
+    fib->nh_len[fib->nh_used] = len;
+    fib->nh_prefix[fib->nh_used] = prefix;
+    *sr_fib_dir24_slot(fib, prefix, len) = fib->nh_used;
+    return fib->nh_used++;
+}
+
+static uint32_t sr_fib_dir24_chunk(struct sr_fib* fib, uint32_t fill)
+{
+    uint32_t* chunk;
+    int i;
+
+    if(fib->tbl8_used == fib->tbl8_cap)
+    {
+        fib->tbl8_cap = fib->tbl8_cap ? fib->tbl8_cap * 2 : 16;
+        fib->tbl8 = (uint32_t*)realloc(fib->tbl8,
+                fib->tbl8_cap * SR_FIB_TBL8_SZ * sizeof(uint32_t));
+        assert(fib->tbl8);
+    }
+    chunk = fib->tbl8 + fib->tbl8_used * SR_FIB_TBL8_SZ;
+    for(i = 0; i < SR_FIB_TBL8_SZ; i++)
+    { chunk[i] = fill; }
+    return fib->tbl8_used++;
+}
+
+/* -- overwrite entries in [first,first+count) not covered by a longer prefix -- */
+static void sr_fib_dir24_fill(struct sr_fib* fib, uint32_t* tbl,
+                              uint32_t first, uint32_t count,
+                              uint32_t nh, int len)
+{
+    uint32_t i;
+
+    for(i = first; i < first + count; i++)
+    {
+        if(fib->nh_len[tbl[i]] <= len)
+        { tbl[i] = nh; }
+    }
+}
+
+static int sr_fib_dir24_insert(struct sr_fib* fib, uint32_t prefix, int len,
+                               struct sr_rt* rt)
+{
+    uint32_t nh;
+    uint32_t e;
+    uint32_t i;
+
+    /* -- the prefix is in the tables already: only its route changes -- */
+    if(fib->nh_hash && (nh = *sr_fib_dir24_slot(fib, prefix, len)) != 0)
+    {
+        fib->nh[nh] = rt;
+        return 0;
+    }
+
+    if(fib->tbl24 == 0)
+    {
+        fib->tbl24 = (uint32_t*)calloc(1 << 24, sizeof(uint32_t));
+        if(fib->tbl24 == 0)
+        {
+            perror("calloc");
+            return -1;
+        }
+    }
+
+    nh = sr_fib_dir24_nh(fib, rt, prefix, len);
+
+    if(len <= 24)
+    {
+        for(i = prefix >> 8; i < (prefix >> 8) + (1U << (24 - len)); i++)
+        {
+            e = fib->tbl24[i];
+            if(e & SR_FIB_TBL8_FLAG)
+            {
+                sr_fib_dir24_fill(fib,
+                        fib->tbl8 + (e & ~SR_FIB_TBL8_FLAG) * SR_FIB_TBL8_SZ,
+                        0, SR_FIB_TBL8_SZ, nh, len);
+            }
+            else if(fib->nh_len[e] <= len)
+            { fib->tbl24[i] = nh; }
+        }
+    }
+    else
+    {
+        e = fib->tbl24[prefix >> 8];
+        if(!(e & SR_FIB_TBL8_FLAG))
+        {
+            e = SR_FIB_TBL8_FLAG | sr_fib_dir24_chunk(fib, e);
+            fib->tbl24[prefix >> 8] = e;
+        }
+        sr_fib_dir24_fill(fib,
+                fib->tbl8 + (e & ~SR_FIB_TBL8_FLAG) * SR_FIB_TBL8_SZ,
+                prefix & 0xff, 1U << (32 - len), nh, len);
+    }
+
+    fib->nroutes++;
+    return 0;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_insert(..)
+ * Scope:  Global
+ *
+ * Add a route to the FIB.  If the same prefix is already present the
+ * newer route replaces it, matching the "last entry wins" behaviour of
+ * the old linear scan.  Returns 0 on success.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_fib_insert(struct sr_fib* fib, struct sr_rt* rt)
+{
+    struct sr_fib_node** link;
+    struct sr_fib_node* node;
+    struct sr_fib_node* glue;
+    uint32_t prefix;
+    uint32_t diff;
+    int len;
+    int common;
+
+    /* -- REQUIRES -- */
+    assert(fib);
+    assert(rt);
+
+    len    = sr_fib_masklen(rt->mask.s_addr);
+    prefix = ntohl(rt->dest.s_addr) & FIB_MASK(len);
+
+    if(fib->mode == SR_FIB_DIR24)
+    { return sr_fib_dir24_insert(fib, prefix, len, rt); }
+
+    link = &(fib->root);
+    while((node = *link) != 0)
+    {
+        /* -- length of the prefix shared by node and the new route -- */
+        common = (node->len < len) ? node->len : len;
+        diff = (node->prefix ^ prefix) & FIB_MASK(common);
+        if(diff)
+        {
+            common = 0;
+            while(!FIB_BIT(diff,common))
+            { common++; }
+        }
+
+        if(common < node->len)
+        {
+            if(common == len)
+            {
+                /* -- new route is an ancestor of node -- */
+                glue = sr_fib_node_new(fib, prefix, len, rt);
+                glue->child[FIB_BIT(node->prefix,len)] = node;
+            }
+            else
+            {
+                /* -- diverge below a new branching node -- */
+                glue = sr_fib_node_new(fib, prefix, common, 0);
+                glue->child[FIB_BIT(node->prefix,common)] = node;
+                glue->child[FIB_BIT(prefix,common)] =
+                    sr_fib_node_new(fib, prefix, len, rt);
+            }
+            *link = glue;
+            fib->nroutes++;
+            return 0;
+        }
+
+        if(node->len == len)
+        {
+            if(node->rt == 0)
+            { fib->nroutes++; }
+            node->rt = rt;
+            return 0;
+        }
+
+        link = &(node->child[FIB_BIT(prefix,node->len)]);
+    }
+
+    *link = sr_fib_node_new(fib, prefix, len, rt);
+    fib->nroutes++;
+    return 0;
+} /* -- sr_fib_insert -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_build(..)
+ * Scope:  Global
+ *
+ * Throw away the current lookup structure and rebuild it from a routing
+ * table list.  Call this after the table is rewritten wholesale.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_fib_build(struct sr_fib* fib, struct sr_rt* table)
+{
+    struct sr_rt* rt_walker;
+
+    assert(fib);
+
+    sr_fib_flush(fib);
+    for(rt_walker = table; rt_walker; rt_walker = rt_walker->next)
+    {
+        if(sr_fib_insert(fib, rt_walker) != 0)
+        { return -1; }
+    }
+    return 0;
+} /* -- sr_fib_build -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fib_lookup(..)
+ * Scope:  Global
+ *
+ * Longest prefix match for an address in network byte order.  Returns
+ * the matching route or 0 if no prefix covers the address.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_rt* sr_fib_lookup(const struct sr_fib* fib, uint32_t ip_nbo)
+{
+    const struct sr_fib_node* node;
+    struct sr_rt* best = 0;
+    uint32_t ip = ntohl(ip_nbo);
+    uint32_t e;
+
+    if(fib->mode == SR_FIB_DIR24)
+    {
+        if(fib->tbl24 == 0)
+        { return 0; }
+        e = fib->tbl24[ip >> 8];
+        if(e & SR_FIB_TBL8_FLAG)
+        { e = fib->tbl8[(e & ~SR_FIB_TBL8_FLAG) * SR_FIB_TBL8_SZ + (ip & 0xff)]; }
+        return fib->nh[e];
+    }
+
+    node = fib->root;
+    while(node)
+    {
+        if((ip ^ node->prefix) & FIB_MASK(node->len))
+        { break; }
+        if(node->rt)
+        { best = node->rt; }
+        if(node->len == 32)
+        { break; }
+        node = node->child[FIB_BIT(ip,node->len)];
+    }
+    return best;
+} /* -- sr_fib_lookup -- */
@@ -0,0 +1,97 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fib.h
+ *
+ * Description:
+ *
+ * Forwarding information base used by the data plane.  The FIB is a
+ * path-compressed binary (Patricia) trie built from the struct sr_rt
+ * entries in sr->routing_table, which remains the control-plane source of
+ * truth.  Lookups cost O(prefix length) and are independent of the number
+ * of routes.
+ *
+ * Alternatively the FIB can be kept as a DIR-24-8-BASIC table: a 2^24
+ * entry first level indexed by the top 24 bits of the address and 256
+ * entry second level chunks for prefixes longer than /24.  Every lookup
+ * is then one or two memory reads, at the price of 64MB for the first
+ * level.
+ *
+ * The data plane only ever sees FIBs made by sr_fib_create(): immutable
+ * snapshots that carry private copies of the routes, published through
+ * sr->fib and read under sr_rcu_read_lock() (see sr_rcu.h).
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef sr_FIB_H
+#define sr_FIB_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+struct sr_rt;
+
+/* ----------------------------------------------------------------------------
+ * struct sr_fib_node
+ *
+ * Node in the trie.  Each node covers the first 'len' bits of 'prefix'
+ * (host byte order); 'rt' is set only if a route ends at this node,
+ * otherwise the node is an internal branching point.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_fib_node
+{
+    uint32_t prefix;
+    uint8_t  len;
+    struct sr_rt* rt;
+    struct sr_fib_node* child[2];
+};
+
+#define SR_FIB_TRIE  0
+#define SR_FIB_DIR24 1
+
+#define SR_FIB_TBL8_FLAG 0x80000000U /* tbl24 entry refers to a tbl8 chunk */
+#define SR_FIB_TBL8_SZ   256
+
+struct sr_fib
+{
+    int mode;              /* SR_FIB_TRIE or SR_FIB_DIR24 */
+    struct sr_fib_node* root;
+    unsigned int nroutes;  /* prefixes carrying a route */
+    unsigned int nnodes;   /* prefixes + branching nodes */
+
+    /* -- DIR-24-8 mode, entries are indices into nh (0 is no route) -- */
+    uint32_t* tbl24;
+    uint32_t* tbl8;
+    uint32_t tbl8_used;    /* chunks in use */
+    uint32_t tbl8_cap;
+    struct sr_rt** nh;
+    uint8_t* nh_len;       /* prefix length of each next hop */
+    uint32_t* nh_prefix;   /* and its prefix, host byte order */
+    uint32_t nh_used;
+    uint32_t nh_cap;
+    uint32_t* nh_hash;     /* open addressed (prefix, length) -> nh index */
+    uint32_t nh_hash_mask;
+
+    /* -- routes owned by a snapshot, linked in table order -- */
+    struct sr_rt* rts;
+    unsigned int nrts;
+};
+
+struct sr_fib* sr_fib_create(int mode, struct sr_rt* table);
+void sr_fib_destroy(struct sr_fib* fib);
+
+void sr_fib_init(struct sr_fib* fib);
+int  sr_fib_set_mode(struct sr_fib* fib, int mode, struct sr_rt* table);
+void sr_fib_flush(struct sr_fib* fib);
+int  sr_fib_insert(struct sr_fib* fib, struct sr_rt* rt);
+int  sr_fib_build(struct sr_fib* fib, struct sr_rt* table);
+struct sr_rt* sr_fib_lookup(const struct sr_fib* fib, uint32_t ip_nbo);
+
+int sr_fib_masklen(uint32_t mask_nbo);
+
+#endif  /* --  sr_FIB_H -- */
@@ -0,0 +1,291 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fwd.c
+ *
+ * Description:
+ *
+ * Worker threads and flow sharding for sr_fwd.h.  Workers drain their
+ * ring in bursts of up to SR_BURST_MAX frames and process each burst
+ * with sr_handlepacket_burst().
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <arpa/inet.h>
+
+#include "sr_fwd.h"
+#include "sr_router.h"
+
+#define RING_MASK (SR_FWD_RING_SZ - 1)
+
+/* -- final avalanche step of MurmurHash3 -- */
+static uint32_t sr_fwd_mix(uint32_t h)
+{
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U;
+    h ^= h >> 16;
+    return h;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_fwd_flow_hash(..)
+ * Scope:  Global
+ *
+ * Hash of the IP 5-tuple of an ethernet frame.  Ports are only used for
+ * unfragmented TCP and UDP, so every fragment of a datagram hashes like
+ * its first one.  Non-IP frames hash to 0.
+ *
+ *---------------------------------------------------------------------*/
+
+uint32_t sr_fwd_flow_hash(const uint8_t* packet, unsigned int len)
+{
+    const sr_ethernet_hdr_t* eth_hdr = (const sr_ethernet_hdr_t*)packet;
+    const sr_ip_hdr_t* ip_hdr;
+    unsigned int hl;
+    uint32_t h;
+
+    if(len < sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) ||
+       eth_hdr->ether_type != htons(ethertype_ip))
+    { return 0; }
+
+    ip_hdr = (const sr_ip_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t));
+    h = sr_fwd_mix(ip_hdr->ip_src) ^ ip_hdr->ip_dst;
+    h = sr_fwd_mix(h) ^ ip_hdr->ip_p;
+
+    hl = ip_hdr->ip_hl * 4;
+    if((ip_hdr->ip_p == ip_protocol_tcp || ip_hdr->ip_p == ip_protocol_udp) &&
+       !(ip_hdr->ip_off & htons(IP_MF | IP_OFFMASK)) &&
+       len >= sizeof(sr_ethernet_hdr_t) + hl + 4)
+    {
+        uint32_t ports;
+        memcpy(&ports, packet + sizeof(sr_ethernet_hdr_t) + hl, 4);
+        h = sr_fwd_mix(h) ^ ports;
+    }
+
+    return sr_fwd_mix(h);
+} /* -- sr_fwd_flow_hash -- */
+
+static void* sr_fwd_worker_main(void* arg)
+{
+    struct sr_fwd_worker* w = (struct sr_fwd_worker*)arg;
+    struct sr_fwd_slot* slot;
+    struct sr_pbuf* pbufs[SR_BURST_MAX];
+    unsigned int ifindexes[SR_BURST_MAX];
+    unsigned int tail, head, n, i;
+    int stop;
+
+    while(1)
+    {
+        tail = w->tail;
+        head = __atomic_load_n(&(w->head), __ATOMIC_ACQUIRE);
+        if(tail == head)
+        {
+            pthread_mutex_lock(&(w->lock));
+            __atomic_store_n(&(w->sleeping), 1, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_SEQ_CST);
+            while(tail == __atomic_load_n(&(w->head), __ATOMIC_ACQUIRE) && !w->stop)
+            { pthread_cond_wait(&(w->wake), &(w->lock)); }
+            __atomic_store_n(&(w->sleeping), 0, __ATOMIC_RELAXED);
+            stop = w->stop;
+            pthread_mutex_unlock(&(w->lock));
+            if(stop && tail == __atomic_load_n(&(w->head), __ATOMIC_ACQUIRE))
+            { break; }
+            continue;
+        }
+
+        /* -- drain up to a burst worth of slots in one pass -- */
+        for(n = 0; n < SR_BURST_MAX && tail + n != head; n++)
+        {
+            slot = &(w->ring[(tail + n) & RING_MASK]);
+            pbufs[n]  = slot->pbuf;
+            ifindexes[n] = slot->ifindex;
+        }
+        sr_handlepacket_burst(w->sr, pbufs, ifindexes, n);
+        sr_flush_packets(w->sr);
+        for(i = 0; i < n; i++)
+        { sr_pbuf_put(pbufs[i]); }
+        __atomic_store_n(&(w->processed), w->processed + n, __ATOMIC_RELAXED);
+        __atomic_store_n(&(w->tail), tail + n, __ATOMIC_RELEASE);
+    }
+
+    return 0;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_fwd_destroy(..)
+ * Scope:  Local
+ *
+ * Stop and join the first nstarted workers once their rings are
+ * drained, then free the rings and the engine.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_fwd_destroy(struct sr_fwd* fwd, unsigned int nstarted)
+{
+    struct sr_fwd_worker* w;
+    unsigned int i;
+
+    for(i = 0; i < nstarted; i++)
+    {
+        w = &(fwd->workers[i]);
+        pthread_mutex_lock(&(w->lock));
+        w->stop = 1;
+        pthread_cond_signal(&(w->wake));
+        pthread_mutex_unlock(&(w->lock));
+        pthread_join(w->thread, 0);
+    }
+    for(i = 0; i < fwd->nworkers; i++)
+    {
+        w = &(fwd->workers[i]);
+        if(w->ring == 0)
+        { continue; }
+        pthread_cond_destroy(&(w->wake));
+        pthread_mutex_destroy(&(w->lock));
+        free(w->ring);
+    }
+    free(fwd->workers);
+    free(fwd);
+} /* -- sr_fwd_destroy -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fwd_start(..)
+ * Scope:  Global
+ *
+ * Create nworkers worker threads, each with its own ring, and attach
+ * the engine to sr so that sr_handlepacket() dispatches to it.  Worker i
+ * is pinned to CPU i modulo the number of online CPUs.  Returns 0 on
+ * success, -1 on error.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_fwd_start(struct sr_instance* sr, unsigned int nworkers)
+{
+    struct sr_fwd* fwd;
+    struct sr_fwd_worker* w;
+    pthread_attr_t attr;
+    unsigned int i;
+    long ncpus;
+
+    assert(sr);
+
+    if(nworkers == 0)
+    { return 0; }
+    if(nworkers > SR_FWD_MAX_WORKERS)
+    {
+        fprintf(stderr,"Limiting forwarding workers to %d\n",SR_FWD_MAX_WORKERS);
+        nworkers = SR_FWD_MAX_WORKERS;
+    }
+
+    fwd = (struct sr_fwd*)malloc(sizeof(struct sr_fwd));
+    assert(fwd);
+    fwd->nworkers = nworkers;
+    if(posix_memalign((void**)&(fwd->workers), 64,
+                      nworkers * sizeof(struct sr_fwd_worker)) != 0)
+    {
+        free(fwd);
+        return -1;
+    }
+    memset(fwd->workers, 0, nworkers * sizeof(struct sr_fwd_worker));
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+    pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+    ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    for(i = 0; i < nworkers; i++)
+    {
+        w = &(fwd->workers[i]);
+        w->ring = (struct sr_fwd_slot*)malloc(SR_FWD_RING_SZ * sizeof(struct sr_fwd_slot));
+        assert(w->ring);
+        w->sr = sr;
+        w->id = i;
+        pthread_mutex_init(&(w->lock), 0);
+        pthread_cond_init(&(w->wake), 0);
+
+#ifdef _LINUX_
+        if(ncpus > 0)
+        {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(i % ncpus, &cpus);
+            pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+        }
+#endif /* _LINUX_ */
+
+        if(pthread_create(&(w->thread), &attr, sr_fwd_worker_main, w) != 0)
+        {
+            fprintf(stderr,"Error creating forwarding worker %u\n",i);
+            pthread_attr_destroy(&attr);
+            sr_fwd_destroy(fwd, i);
+            return -1;
+        }
+    }
+    pthread_attr_destroy(&attr);
+
+    sr->fwd = fwd;
+    return 0;
+} /* -- sr_fwd_start -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_fwd_dispatch(..)
+ * Scope:  Global
+ *
+ * Queue a reference to a frame on the ring of the worker owning its
+ * flow.  Must only be called from one thread.  The frame is dropped if
+ * that ring is full.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_fwd_dispatch(struct sr_fwd* fwd, struct sr_pbuf* pbuf /* lent */,
+                     unsigned int ifindex)
+{
+    struct sr_fwd_worker* w;
+    struct sr_fwd_slot* slot;
+    unsigned int head;
+
+    w = &(fwd->workers[sr_fwd_flow_hash(pbuf->data, pbuf->len) % fwd->nworkers]);
+
+    head = w->head;
+    if(head - __atomic_load_n(&(w->tail), __ATOMIC_ACQUIRE) >= SR_FWD_RING_SZ)
+    {
+        w->drops++;
+        return;
+    }
+
+    slot = &(w->ring[head & RING_MASK]);
+    slot->pbuf = sr_pbuf_hold(pbuf);
+    if(slot->pbuf == 0)
+    {
+        w->drops++;
+        return;
+    }
+    slot->ifindex = ifindex;
+    __atomic_store_n(&(w->head), head + 1, __ATOMIC_RELEASE);
+
+    /* -- pairs with the fence the worker issues before going to sleep -- */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if(__atomic_load_n(&(w->sleeping), __ATOMIC_RELAXED))
+    {
+        pthread_mutex_lock(&(w->lock));
+        pthread_cond_signal(&(w->wake));
+        pthread_mutex_unlock(&(w->lock));
+    }
+} /* -- sr_fwd_dispatch -- */
+
+void sr_fwd_print_stats(struct sr_fwd* fwd)
+{
+    unsigned int i;
+
+    for(i = 0; i < fwd->nworkers; i++)
+    {
+        fprintf(stderr,"worker %u: %lu processed, %lu dropped\n", i,
+                __atomic_load_n(&(fwd->workers[i].processed), __ATOMIC_RELAXED),
+                fwd->workers[i].drops);
+    }
+}
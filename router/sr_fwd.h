@@ -0,0 +1,80 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_fwd.h
+ *
+ * Description:
+ *
+ * Multi-threaded forwarding engine.  The thread reading from the server
+ * hashes the IP 5-tuple of every frame (RSS style) to one of N worker
+ * threads and passes a reference to the frame's pbuf through that
+ * worker's single-producer / single-consumer ring.  Workers run the
+ * normal packet path, so forwarding, ICMP generation and ARP queueing
+ * scale across cores.  All frames of one flow land on the same worker
+ * and keep their order.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef sr_FWD_H
+#define sr_FWD_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include <pthread.h>
+
+#include "sr_protocol.h"
+#include "sr_pbuf.h"
+
+#define SR_FWD_MAX_WORKERS 32
+#define SR_FWD_RING_SZ     1024  /* slots per worker, a power of two */
+
+struct sr_instance;
+
+struct sr_fwd_slot
+{
+    struct sr_pbuf* pbuf;      /* reference owned by the ring */
+    unsigned int ifindex;
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_fwd_worker
+ *
+ * head is only written by the reader thread and tail only by the worker;
+ * they live on separate cache lines.  A worker that finds its ring empty
+ * sets 'sleeping' and waits on 'wake'.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_fwd_worker
+{
+    unsigned int head __attribute__ ((aligned (64)));  /* next slot to fill */
+    unsigned int tail __attribute__ ((aligned (64)));  /* next slot to drain */
+    int sleeping __attribute__ ((aligned (64)));
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    struct sr_fwd_slot* ring;
+    struct sr_instance* sr;
+    unsigned int id;
+    unsigned long processed;
+    unsigned long drops;      /* ring was full or no buffer */
+    int stop;                 /* under lock, exit once the ring is empty */
+    pthread_t thread;
+};
+
+struct sr_fwd
+{
+    unsigned int nworkers;
+    struct sr_fwd_worker* workers;
+};
+
+int  sr_fwd_start(struct sr_instance* sr, unsigned int nworkers);
+void sr_fwd_dispatch(struct sr_fwd* fwd, struct sr_pbuf* pbuf,
+                     unsigned int ifindex);
+uint32_t sr_fwd_flow_hash(const uint8_t* packet, unsigned int len);
+void sr_fwd_print_stats(struct sr_fwd* fwd);
+
+#endif  /* --  sr_FWD_H -- */
@@ -22,6 +22,108 @@
 
 #include "sr_if.h"
 #include "sr_router.h"
+#include "sr_cksum.h"
+#include "sr_fib.h"
+
+/* -- FNV-1a, for names, MACs and IP addresses alike -- */
+static uint32_t sr_if_hash(const void* key, unsigned int len)
+{
+    const unsigned char* p = (const unsigned char*)key;
+    uint32_t h = 2166136261U;
+
+    while(len--)
+    {
+        h ^= *p++;
+        h *= 16777619U;
+    }
+    return h;
+}
+
+static unsigned int sr_if_hash_name(const char* name)
+{ return sr_if_hash(name, strnlen(name, sr_IFACE_NAMELEN)) & (SR_IF_HASH_SZ - 1); }
+
+static void sr_if_hash_insert(uint8_t* slots, unsigned int h, unsigned int ifindex)
+{
+    while(slots[h])
+    { h = (h + 1) & (SR_IF_HASH_SZ - 1); }
+    slots[h] = ifindex + 1;
+}
+
+/* -- the slot holding (ip, len), or the empty slot that ends its probe -- */
+static struct sr_if_dst* sr_if_dst_slot(struct sr_if_dst* slots, unsigned int size,
+                                        uint32_t ip, unsigned int len)
+{
+    unsigned int h = sr_if_hash(&ip, 4) & (size - 1);
+
+    while(slots[h].kind && (slots[h].ip != ip || slots[h].len != len))
+    { h = (h + 1) & (size - 1); }
+    return &(slots[h]);
+}
+
+/* -- the first interface to claim an address keeps it -- */
+static void sr_if_dst_add(struct sr_if_dst* slots, unsigned int size, uint32_t ip,
+                          unsigned int len, int kind, unsigned int ifindex)
+{
+    struct sr_if_dst* d = sr_if_dst_slot(slots, size, ip, len);
+
+    if(d->kind)
+    { return; }
+    d->ip = ip;
+    d->len = len;
+    d->kind = kind;
+    d->ifindex = ifindex;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_if_table_rebuild(..)
+ * Scope: Local
+ *
+ * Rehash every interface after one was added or readdressed.  The
+ * router's own addresses go in before any directed broadcast address,
+ * so that they win if the two ever coincide.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_if_table_rebuild(struct sr_instance* sr)
+{
+    struct sr_if_table* t = &(sr->if_table);
+    struct sr_if* iface;
+    unsigned int i;
+    int len;
+
+    memset(t->by_name, 0, sizeof(t->by_name));
+    memset(t->by_addr, 0, sizeof(t->by_addr));
+    memset(t->addrs, 0, sizeof(t->addrs));
+    memset(t->subnets, 0, sizeof(t->subnets));
+    t->subnet_lens = 0;
+
+    for(i = 0; i < t->nifs; i++)
+    {
+        iface = t->by_index[i];
+        sr_if_hash_insert(t->by_name, sr_if_hash_name(iface->name), i);
+        sr_if_hash_insert(t->by_addr,
+                          sr_if_hash(iface->addr, ETHER_ADDR_LEN) & (SR_IF_HASH_SZ - 1), i);
+        if(iface->ip)
+        { sr_if_dst_add(t->addrs, SR_IF_ADDR_HASH_SZ, iface->ip, 32, SR_DST_LOCAL, i); }
+    }
+
+    for(i = 0; i < t->nifs; i++)
+    {
+        iface = t->by_index[i];
+        len = sr_fib_masklen(iface->mask);
+        if(iface->ip == 0 || len == 0)
+        { continue; }
+        /* -- /31 and /32 subnets have no broadcast address (RFC 3021) -- */
+        if(len < 31)
+        {
+            sr_if_dst_add(t->addrs, SR_IF_ADDR_HASH_SZ, iface->ip | ~iface->mask, 32,
+                          SR_DST_BROADCAST, i);
+        }
+        sr_if_dst_add(t->subnets, SR_IF_HASH_SZ, iface->ip & iface->mask, len,
+                      SR_DST_CONNECTED, i);
+        t->subnet_lens |= (uint64_t)1 << len;
+    }
+} /* -- sr_if_table_rebuild -- */
 
 /*--------------------------------------------------------------------- 
  * Method: sr_get_interface
@@ -34,24 +136,135 @@
 
 struct sr_if* sr_get_interface(struct sr_instance* sr, const char* name)
 {
-    struct sr_if* if_walker = 0;
+    struct sr_if_table* t;
+    struct sr_if* iface;
+    unsigned int h, slot;
 
     /* -- REQUIRES -- */
     assert(name);
     assert(sr);
 
-    if_walker = sr->if_list;
-
-    while(if_walker)
+    t = &(sr->if_table);
+    for(h = sr_if_hash_name(name); (slot = t->by_name[h]) != 0;
+        h = (h + 1) & (SR_IF_HASH_SZ - 1))
     {
-       if(!strncmp(if_walker->name,name,sr_IFACE_NAMELEN))
-        { return if_walker; }
-        if_walker = if_walker->next;
+        iface = t->by_index[slot - 1];
+        if(!strncmp(iface->name,name,sr_IFACE_NAMELEN))
+        { return iface; }
     }
 
     return 0;
 } /* -- sr_get_interface -- */
 
+/*--------------------------------------------------------------------- 
+ * Method: sr_get_interface_by_index
+ * Scope: Global
+ *
+ * Given an interface index return the interface record or 0 if it doesn't
+ * exist.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_if* sr_get_interface_by_index(struct sr_instance* sr, unsigned int ifindex)
+{
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    if(ifindex >= sr->if_table.nifs)
+    { return 0; }
+    return sr->if_table.by_index[ifindex];
+} /* -- sr_get_interface_by_index -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_get_interface_by_addr
+ * Scope: Global
+ *
+ * Given a MAC address return the interface that has it or 0 if none
+ * does.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_if* sr_get_interface_by_addr(struct sr_instance* sr, const unsigned char* addr)
+{
+    struct sr_if_table* t = &(sr->if_table);
+    struct sr_if* iface;
+    unsigned int h, slot;
+
+    for(h = sr_if_hash(addr, ETHER_ADDR_LEN) & (SR_IF_HASH_SZ - 1); (slot = t->by_addr[h]) != 0;
+        h = (h + 1) & (SR_IF_HASH_SZ - 1))
+    {
+        iface = t->by_index[slot - 1];
+        if(!memcmp(iface->addr, addr, ETHER_ADDR_LEN))
+        { return iface; }
+    }
+    return 0;
+} /* -- sr_get_interface_by_addr -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_get_interface_by_ip
+ * Scope: Global
+ *
+ * Given an IP address in network byte order return the interface that
+ * has it, or 0 if it is not one of the router's own addresses.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_if* sr_get_interface_by_ip(struct sr_instance* sr, uint32_t ip_nbo)
+{
+    struct sr_if* iface;
+
+    if(sr_if_classify(sr, ip_nbo, &iface) != SR_DST_LOCAL)
+    { return 0; }
+    return iface;
+} /* -- sr_get_interface_by_ip -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_if_classify
+ * Scope: Global
+ *
+ * Say what the router does with an IP datagram to ip_nbo: deliver it
+ * (SR_DST_LOCAL), neither forward nor answer it (SR_DST_BROADCAST), or
+ * forward it, to a neighbour (SR_DST_CONNECTED) or beyond.  iface, if
+ * not 0, is set to the interface the address belongs to, or 0.
+ *
+ * Own and broadcast addresses take one hash probe; subnets one per
+ * prefix length in use, longest first.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_if_classify(struct sr_instance* sr, uint32_t ip_nbo, struct sr_if** iface)
+{
+    struct sr_if_table* t = &(sr->if_table);
+    struct sr_if_dst* d;
+    uint64_t lens;
+    unsigned int len;
+
+    if(iface)
+    { *iface = 0; }
+
+    if(ip_nbo == 0xffffffff || (ip_nbo & htonl(0xf0000000)) == htonl(0xe0000000))
+    { return SR_DST_BROADCAST; }
+
+    d = sr_if_dst_slot(t->addrs, SR_IF_ADDR_HASH_SZ, ip_nbo, 32);
+    if(d->kind == 0)
+    {
+        for(lens = t->subnet_lens; lens; lens &= ~((uint64_t)1 << len))
+        {
+            len = 63 - __builtin_clzll(lens);
+            d = sr_if_dst_slot(t->subnets, SR_IF_HASH_SZ,
+                               ip_nbo & htonl(~0U << (32 - len)), len);
+            if(d->kind)
+            { break; }
+        }
+        if(d->kind == 0)
+        { return SR_DST_FORWARD; }
+    }
+
+    if(iface)
+    { *iface = t->by_index[d->ifindex]; }
+    return d->kind;
+} /* -- sr_if_classify -- */
+
 /*--------------------------------------------------------------------- 
  * Method: sr_add_interface(..)
  * Scope: Global
@@ -108,28 +321,38 @@ void sr_add_interface(struct sr_instance* sr, const char* name)
     assert(name);
     assert(sr);
 
+    assert(sr->if_table.nifs < SR_IF_MAX);
+
     /* -- empty list special case -- */
     if(sr->if_list == 0)
     {
-        sr->if_list = (struct sr_if*)malloc(sizeof(struct sr_if));
+        sr->if_list = (struct sr_if*)calloc(1, sizeof(struct sr_if));
         assert(sr->if_list);
         sr->if_list->next = 0;
         sr->if_list->status = 1;
+        sr->if_list->ifindex = 0;
         strncpy(sr->if_list->name,name,sr_IFACE_NAMELEN);
-        return;
+        if_walker = sr->if_list;
+    }
+    else
+    {
+        /* -- find the end of the list -- */
+        if_walker = sr->if_list;
+        while(if_walker->next)
+        {if_walker = if_walker->next; }
+
+        if_walker->next = (struct sr_if*)calloc(1, sizeof(struct sr_if));
+        assert(if_walker->next);
+        if_walker->next->ifindex = if_walker->ifindex + 1;
+        if_walker = if_walker->next;
+        strncpy(if_walker->name,name,sr_IFACE_NAMELEN);
+        if_walker->status = 1;
+        if_walker->next = 0;
     }
 
-    /* -- find the end of the list -- */
-    if_walker = sr->if_list;
-    while(if_walker->next)
-    {if_walker = if_walker->next; }
-
-    if_walker->next = (struct sr_if*)malloc(sizeof(struct sr_if));
-    assert(if_walker->next);
-    if_walker = if_walker->next;
-    strncpy(if_walker->name,name,sr_IFACE_NAMELEN);
-    if_walker->status = 1;
-    if_walker->next = 0;
+    sr->if_table.by_index[if_walker->ifindex] = if_walker;
+    sr->if_table.nifs = if_walker->ifindex + 1;
+    sr_if_table_rebuild(sr);
 } /* -- sr_add_interface -- */ 
 
 /*--------------------------------------------------------------------- 
@@ -153,6 +376,7 @@ void sr_set_ether_addr(struct sr_instance* sr, const unsigned char* addr)
 
     /* -- copy address -- */
     memcpy(if_walker->addr,addr,6);
+    sr_if_table_rebuild(sr);
 
 } /* -- sr_set_ether_addr -- */
 
@@ -177,6 +401,7 @@ void sr_set_ether_ip(struct sr_instance* sr, uint32_t ip_nbo)
 
     /* -- copy address -- */
     if_walker->ip = ip_nbo;
+    sr_if_table_rebuild(sr);
 
 } /* -- sr_set_ether_ip -- */
 
@@ -194,6 +419,7 @@ void sr_set_ether_mask(struct sr_instance* sr, uint32_t mask_nbo)
 
     /* -- copy address -- */
     if_walker->mask = mask_nbo;
+    sr_if_table_rebuild(sr);
 
 } /* -- sr_set_ether_ip -- */
 
@@ -263,3 +489,51 @@ void sr_print_if(struct sr_if* iface)
     Debug("\tinet addr %s\n",inet_ntoa(ip_addr));
     Debug("\tinet mask %s\n",inet_ntoa(ip_mask));
 } /* -- sr_print_if -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_if_build_templates(..)
+ * Scope: Global
+ *
+ * Fill in the header templates of iface from its MAC and IP address.
+ * The IP template is an ICMP datagram with DF set and a TTL of 64;
+ * the ARP template is a broadcast request from iface.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_if_build_templates(struct sr_if* iface)
+{
+    sr_ethernet_hdr_t* eth_hdr;
+    sr_ip_hdr_t* ip_hdr;
+    sr_arp_hdr_t* arp_hdr;
+
+    assert(iface);
+
+    memset(iface->ip_tmpl, 0, SR_IF_IP_TMPL_LEN);
+    eth_hdr = (sr_ethernet_hdr_t*)iface->ip_tmpl;
+    memcpy(eth_hdr->ether_shost, iface->addr, ETHER_ADDR_LEN);
+    eth_hdr->ether_type = htons(ethertype_ip);
+
+    ip_hdr = (sr_ip_hdr_t*)(iface->ip_tmpl + sizeof(sr_ethernet_hdr_t));
+    ip_hdr->ip_v   = 4;
+    ip_hdr->ip_hl  = 5;
+    ip_hdr->ip_off = htons(IP_DF);
+    ip_hdr->ip_ttl = 64;
+    ip_hdr->ip_p   = ip_protocol_icmp;
+    iface->ip_tmpl_sum = cksum_partial(ip_hdr, sizeof(sr_ip_hdr_t), 0);
+    ip_hdr->ip_src = iface->ip;
+
+    memset(iface->arp_tmpl, 0, SR_IF_ARP_TMPL_LEN);
+    eth_hdr = (sr_ethernet_hdr_t*)iface->arp_tmpl;
+    memset(eth_hdr->ether_dhost, 0xff, ETHER_ADDR_LEN);
+    memcpy(eth_hdr->ether_shost, iface->addr, ETHER_ADDR_LEN);
+    eth_hdr->ether_type = htons(ethertype_arp);
+
+    arp_hdr = (sr_arp_hdr_t*)(iface->arp_tmpl + sizeof(sr_ethernet_hdr_t));
+    arp_hdr->ar_hrd = htons(arp_hrd_ethernet);
+    arp_hdr->ar_pro = htons(ethertype_ip);
+    arp_hdr->ar_hln = ETHER_ADDR_LEN;
+    arp_hdr->ar_pln = sizeof(uint32_t);
+    arp_hdr->ar_op  = htons(arp_op_request);
+    memcpy(arp_hdr->ar_sha, iface->addr, ETHER_ADDR_LEN);
+    arp_hdr->ar_sip = iface->ip;
+} /* -- sr_if_build_templates -- */
@@ -26,11 +26,30 @@
 
 struct sr_instance;
 
+#define SR_IF_IP_TMPL_LEN  (sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t))
+#define SR_IF_ARP_TMPL_LEN (sizeof(sr_ethernet_hdr_t) + sizeof(sr_arp_hdr_t))
+
+#define SR_IF_MAX     64             /* interfaces a router can have */
+#define SR_IF_HASH_SZ (2 * SR_IF_MAX) /* slots per hash, a power of two */
+#define SR_IF_ADDR_HASH_SZ (2 * SR_IF_HASH_SZ) /* two addresses per interface */
+#define SR_IF_NONE    (~0U)          /* ifindex of a route to no known interface */
+
+/* -- what sr_if_classify() says about a destination address -- */
+#define SR_DST_FORWARD   0  /* not on any of the router's subnets */
+#define SR_DST_LOCAL     1  /* one of the router's own addresses */
+#define SR_DST_BROADCAST 2  /* limited or directed broadcast, or multicast */
+#define SR_DST_CONNECTED 3  /* a neighbour on one of the router's subnets */
+
 /* ----------------------------------------------------------------------------
  * struct sr_if
  *
  * Node in the interface list for each router
  *
+ * ip_tmpl and arp_tmpl hold the headers of frames the router generates
+ * with this interface as the source (see sr_if_build_templates).
+ * ip_tmpl_sum is the running checksum of the IP header words that never
+ * change: everything but ip_len, ip_id, ip_src and ip_dst.
+ *
  * -------------------------------------------------------------------------- */
 
 struct sr_if
@@ -41,9 +60,47 @@ struct sr_if
   uint32_t speed;
   uint32_t mask; 
   uint32_t status; /* 0 - interface down; 1 - interface up*/
+  unsigned int ifindex; /* position in the interface list, from 0 */
+  uint8_t ip_tmpl[SR_IF_IP_TMPL_LEN];   /* Ethernet + IPv4/ICMP header */
+  uint32_t ip_tmpl_sum;
+  uint8_t arp_tmpl[SR_IF_ARP_TMPL_LEN]; /* Ethernet + ARP request */
   struct sr_if* next;
 };
 
+/* -- an address the router treats specially, see sr_if_classify() -- */
+struct sr_if_dst
+{
+  uint32_t ip;       /* address, or subnet prefix, in network byte order */
+  uint8_t kind;      /* SR_DST_*, 0 when the slot is empty */
+  uint8_t len;       /* prefix length of a subnet */
+  uint8_t ifindex;
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_if_table
+ *
+ * The interfaces of sr->if_list by ifindex, and open addressing hashes
+ * with linear probing from name and MAC to ifindex, where a slot holds
+ * ifindex + 1, 0 when empty.  The destination classifier is two more:
+ * the router's own and directed broadcast addresses, and its subnets by
+ * (prefix, length), with a bitmap of the lengths in use.
+ *
+ * Interfaces are only ever added or readdressed before the first frame
+ * is handled, so lookups take no lock.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_if_table
+{
+  struct sr_if* by_index[SR_IF_MAX];
+  unsigned int nifs;
+  uint8_t by_name[SR_IF_HASH_SZ];
+  uint8_t by_addr[SR_IF_HASH_SZ];
+  struct sr_if_dst addrs[SR_IF_ADDR_HASH_SZ];  /* SR_DST_LOCAL or _BROADCAST */
+  struct sr_if_dst subnets[SR_IF_HASH_SZ];     /* SR_DST_CONNECTED */
+  uint64_t subnet_lens;                        /* bit n: some subnet is a /n */
+};
+
 struct sr_if_status_cache{
   char name[sr_IFACE_NAMELEN];
   uint32_t status;
@@ -51,6 +108,10 @@ struct sr_if_status_cache{
 };
 
 struct sr_if* sr_get_interface(struct sr_instance* sr, const char* name);
+struct sr_if* sr_get_interface_by_index(struct sr_instance* sr, unsigned int ifindex);
+struct sr_if* sr_get_interface_by_addr(struct sr_instance* sr, const unsigned char* addr);
+struct sr_if* sr_get_interface_by_ip(struct sr_instance* sr, uint32_t ip_nbo);
+int sr_if_classify(struct sr_instance* sr, uint32_t ip_nbo, struct sr_if** iface);
 void sr_add_interface(struct sr_instance*, const char*);
 void sr_add_interface_status(struct sr_instance*, const char*);
 void sr_update_interface_status(struct sr_instance*, uint32_t status, const char*);
@@ -58,6 +119,7 @@ uint32_t sr_obtain_interface_status(struct sr_instance*, const char*);
 void sr_set_ether_addr(struct sr_instance*, const unsigned char*);
 void sr_set_ether_ip(struct sr_instance*, uint32_t ip_nbo);
 void sr_set_ether_mask(struct sr_instance*, uint32_t mask_nbo);
+void sr_if_build_templates(struct sr_if* iface);
 void sr_print_if_list(struct sr_instance*);
 void sr_print_if(struct sr_if*);
 
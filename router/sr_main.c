@@ -29,6 +29,8 @@
 #include "sr_dumper.h"
 #include "sr_router.h"
 #include "sr_rt.h"
+#include "sr_slab.h"
+#include "sr_event.h"
 
 extern char* optarg;
 
@@ -43,10 +45,11 @@ extern char* optarg;
 #define DEFAULT_TOPO 0
 
 static void usage(char* );
-static void sr_init_instance(struct sr_instance* );
 static void sr_destroy_instance(struct sr_instance* );
 static void sr_set_user(struct sr_instance* );
 static void sr_load_rt_wrap(struct sr_instance* sr, char* rtable);
+static const struct sr_transport_ops* sr_find_transport(const char* spec,
+                                                        const char** arg);
 
 /*-----------------------------------------------------------------------------
  *---------------------------------------------------------------------------*/
@@ -62,11 +65,22 @@ int main(int argc, char **argv)
     unsigned int port = DEFAULT_PORT;
     unsigned int topo = DEFAULT_TOPO;
     char *logfile = 0;
+    int fib_mode = SR_FIB_TRIE;
+    unsigned int arpcache_sz = 0;
+    unsigned int nworkers = 0;
+    unsigned int icmp_src_rate = SR_RL_SRC_RATE;
+    unsigned int icmp_if_rate = SR_RL_IF_RATE;
+    int event_loop = 0;
+    int rip = 0;
+    char *ctl_path = 0;
+    const struct sr_transport_ops* transport = &sr_vns_transport;
+    const char* transport_arg = 0;
     struct sr_instance sr;
+    struct sr_event_loop loop;
 
     printf("Using %s\n", VERSION_INFO);
 
-    while ((c = getopt(argc, argv, "hs:v:p:u:t:r:l:T:")) != EOF)
+    while ((c = getopt(argc, argv, "hs:v:p:u:t:r:l:T:f:a:w:R:PEc:b:")) != EOF)
     {
         switch (c)
         {
@@ -98,11 +112,62 @@ int main(int argc, char **argv)
             case 'T':
                 template = optarg;
                 break;
+            case 'f':
+                if(strcmp(optarg, "dir24") == 0)
+                { fib_mode = SR_FIB_DIR24; }
+                else if(strcmp(optarg, "trie") == 0)
+                { fib_mode = SR_FIB_TRIE; }
+                else
+                {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'a':
+                arpcache_sz = atoi((char *) optarg);
+                break;
+            case 'w':
+                nworkers = atoi((char *) optarg);
+                break;
+            case 'R':
+                /* -- per source /24 rate, optionally ",per interface rate" -- */
+                if(sscanf(optarg, "%u,%u", &icmp_src_rate, &icmp_if_rate) < 1)
+                {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
+            case 'P':
+                rip = 1;
+                break;
+            case 'E':
+                event_loop = 1;
+                break;
+            case 'c':
+                ctl_path = optarg;
+                event_loop = 1;
+                break;
+            case 'b':
+                transport = sr_find_transport(optarg, &transport_arg);
+                if(transport == 0)
+                {
+                    usage(argv[0]);
+                    exit(1);
+                }
+                break;
         } /* switch */
     } /* -- while -- */
 
     /* -- zero out sr instance -- */
     sr_init_instance(&sr);
+    sr.fib_mode = fib_mode;
+    sr.arpcache_sz = arpcache_sz;
+    sr.nworkers = nworkers;
+    sr.icmp_src_rate = icmp_src_rate;
+    sr.icmp_if_rate = icmp_if_rate;
+    sr.event_loop = event_loop;
+    sr.rip.enabled = rip;
+    sr.transport = transport;
 
     /* -- set up routing table from file -- */
     if(template == NULL) {
@@ -139,8 +204,19 @@ int main(int argc, char **argv)
     else
         Debug("Requesting topology %d\n", topo);
 
+    if(sr.transport != &sr_vns_transport)
+    {
+        /* -- interfaces come from the kernel, the table from the file -- */
+        if(sr.transport->open(&sr, transport_arg) != 0)
+        { return 1; }
+        if(sr.routing_table && sr_verify_routing_table(&sr) != 0)
+        {
+            fprintf(stderr,"Routing table not consistent with hardware\n");
+            return 1;
+        }
+    }
     /* connect to server and negotiate session */
-    if(sr_connect_to_server(&sr,port,server) == -1)
+    else if(sr_connect_to_server(&sr,port,server) == -1)
     {
         return 1;
     }
@@ -152,8 +228,20 @@ int main(int argc, char **argv)
     
     /* call router init (for arp subsystem etc.) */
     sr_init(&sr);
-    /* -- whizbang main loop ;-) */
-    while( sr_read_from_server(&sr) == 1);
+    if(sr.event_loop)
+    {
+        /* -- single threaded: socket, timers and control in one loop -- */
+        if(sr_event_loop_init(&loop, &sr, ctl_path) != 0)
+        { return 1; }
+        sr_event_loop_run(&loop);
+        sr_event_loop_destroy(&loop);
+    }
+    else
+    {
+        /* -- whizbang main loop ;-) */
+        while( sr_read_from_server(&sr) == 1)
+        { sr_flush_packets(&sr); }
+    }
     sr_destroy_instance(&sr);
 
     return 0;
@@ -170,7 +258,11 @@ static void usage(char* argv0)
     printf("Format: %s [-h] [-v host] [-s server] [-p port] \n",argv0);
     printf("           [-T template_name] [-u username] \n");
     printf("           [-t topo id] [-r routing table] \n");
-    printf("           [-l log file] \n");
+    printf("           [-l log file] [-f trie|dir24] \n");
+    printf("           [-a arp cache entries] [-w forwarding workers] \n");
+    printf("           [-R icmp errors/s per /24[,per interface]] \n");
+    printf("           [-P] [-E] [-c control socket] \n");
+    printf("           [-b vns|afpacket|xdp[:if1,if2,...]] \n");
     printf("   defaults server=%s port=%d host=%s  \n",
             DEFAULT_SERVER, DEFAULT_PORT, DEFAULT_HOST );
 } /* -- usage -- */
@@ -217,88 +309,53 @@ static void sr_destroy_instance(struct sr_instance* sr)
         sr_dump_close(sr->logfile);
     }
 
+    sr_flush_packets(sr);
+    sr->transport->print_stats(sr, stderr);
+    sr->transport->close(sr);
+    free(sr->txq.buf);
+    sr->txq.buf = 0;
+    free(sr->rx.buf);
+    sr->rx.buf = 0;
+
+    sr_slab_print_stats(stderr);
+    if(sr->icmp_rl.src_slots)
+    {
+        sr_ratelimit_print_stats(&(sr->icmp_rl), stderr);
+        sr_ratelimit_destroy(&(sr->icmp_rl));
+    }
+
     /*
     fprintf(stderr,"sr_destroy_instance leaking memory\n");
     */
 } /* -- sr_destroy_instance -- */
 
 /*-----------------------------------------------------------------------------
- * Method: sr_init_instance(..)
+ * Method: sr_find_transport(..)
  * Scope: Local
  *
- *
- *----------------------------------------------------------------------------*/
-
-static void sr_init_instance(struct sr_instance* sr)
-{
-    /* REQUIRES */
-    assert(sr);
-
-    sr->sockfd = -1;
-    sr->user[0] = 0;
-    sr->host[0] = 0;
-    sr->topo_id = 0;
-    sr->if_list = 0;
-    sr->if_cache = 0;
-    sr->routing_table = 0;
-    sr->logfile = 0;
-
-    srand(time(NULL));
-    pthread_mutexattr_init(&(sr->rt_locker_attr));
-    pthread_mutexattr_settype(&(sr->rt_locker_attr), PTHREAD_MUTEX_RECURSIVE);
-    pthread_mutex_init(&(sr->rt_locker), &(sr->rt_locker_attr));
-} /* -- sr_init_instance -- */
-
-/*-----------------------------------------------------------------------------
- * Method: sr_verify_routing_table()
- * Scope: Global
- *
- * make sure the routing table is consistent with the interface list by
- * verifying that all interfaces used in the routing table actually exist
- * in the hardware.
- *
- * RETURN VALUES:
- *
- *  0 on success
- *  something other than zero on error
+ * Look up the transport named by -b, "name" or "name:arg".  *arg is set
+ * to what follows the colon, or 0.  Returns 0 for an unknown name.
  *
  *---------------------------------------------------------------------------*/
 
-int sr_verify_routing_table(struct sr_instance* sr)
+static const struct sr_transport_ops* sr_find_transport(const char* spec,
+                                                        const char** arg)
 {
-    struct sr_rt* rt_walker = 0;
-    struct sr_if* if_walker = 0;
-    int ret = 0;
-
-    /* -- REQUIRES --*/
-    assert(sr);
-
-    if( (sr->if_list == 0) || (sr->routing_table == 0))
+    static const struct sr_transport_ops* transports[] =
+    { &sr_vns_transport, &sr_afpacket_transport, &sr_xdp_transport };
+    const char* colon = strchr(spec, ':');
+    size_t len = colon ? (size_t)(colon - spec) : strlen(spec);
+    unsigned int i;
+
+    *arg = colon ? colon + 1 : 0;
+    for(i = 0; i < sizeof(transports) / sizeof(transports[0]); i++)
     {
-        return 999; /* doh! */
+        if(strlen(transports[i]->name) == len &&
+           strncmp(transports[i]->name, spec, len) == 0)
+        { return transports[i]; }
     }
-
-    rt_walker = sr->routing_table;
-
-    while(rt_walker)
-    {
-        /* -- check to see if interface exists -- */
-        if_walker = sr->if_list;
-        while(if_walker)
-        {
-            if( strncmp(if_walker->name,rt_walker->interface,sr_IFACE_NAMELEN)
-                    == 0)
-            { break; }
-            if_walker = if_walker->next;
-        }
-        if(if_walker == 0)
-        { ret++; } /* -- interface not found! -- */
-
-        rt_walker = rt_walker->next;
-    } /* -- while -- */
-
-    return ret;
-} /* -- sr_verify_routing_table -- */
+    return 0;
+} /* -- sr_find_transport -- */
 
 static void sr_load_rt_wrap(struct sr_instance* sr, char* rtable) {
     if(sr_load_rt(sr, rtable) != 0) {
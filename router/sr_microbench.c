@@ -0,0 +1,659 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_microbench.c
+ *
+ * Description:
+ *
+ * Microbenchmarks for the parts of the router every frame goes through:
+ * longest_prefix_match() over synthetic tables of 10 to 1M prefixes in
+ * both FIB modes, sr_arpcache_lookup() and sr_arpcache_insert() at
+ * several occupancies, cksum() over 20 to 9000 byte buffers, and the
+ * ICMP and ARP frame builders with sr_send_packet() going to a sink.
+ *
+ * Every benchmark is run several times and the best and median ns per
+ * operation are reported, as JSON, so that runs of two releases (or of
+ * two data structures) can be compared by a script.  The inputs come
+ * from a fixed seed, so every run measures the same work.
+ *
+ * Usage: sr_microbench [-n reps] [-m max prefixes] [-f name] [-o file] [-v]
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#ifdef _LINUX_
+#include <getopt.h>
+#endif /* _LINUX_ */
+
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_rt.h"
+#include "sr_fib.h"
+#include "sr_arpcache.h"
+#include "sr_cksum.h"
+#include "sr_utils.h"
+#include "sr_bench_common.h"
+
+#define MB_REPS        5
+#define MB_MAX_PREFIXES 1000000
+#define MB_KEYS        (1 << 20)  /* lookup keys, a power of two */
+#define MB_OPS         1000000    /* operations per run, unless noted */
+#define MB_BUILD_OPS   200000     /* frame builder calls per run */
+#define MB_CKSUM_BYTES (64 << 20) /* bytes summed per cksum() run */
+#define MB_ARP_FILL    20         /* insert_new times the last 1/20 of a fill */
+
+extern char* optarg;
+
+typedef void (*mb_fn)(void* arg, unsigned long ops);
+
+/* -- keeps the compiler from dropping results nobody reads -- */
+static volatile uintptr_t mb_sink;
+
+static struct
+{
+    FILE* out;
+    unsigned int reps;
+    const char* filter;
+    int nresults;
+} mb;
+
+static void usage(char* argv0)
+{
+    printf("Format: %s [-n reps] [-m max prefixes] [-f name] [-o file] [-v] \n", argv0);
+    printf("   -f runs only the benchmarks whose name contains name\n");
+    printf("   -v keeps the router's own output\n");
+}
+
+static uint64_t mb_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* -- xorshift32, so that every run draws the same inputs -- */
+static uint32_t mb_rand_state = 2463534242U;
+
+static uint32_t mb_rand(void)
+{
+    uint32_t x = mb_rand_state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return mb_rand_state = x;
+}
+
+static int mb_cmp_u64(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static int mb_wanted(const char* name)
+{ return mb.filter == 0 || strstr(name, mb.filter) != 0; }
+
+/*---------------------------------------------------------------------
+ * Method: mb_report(..)
+ * Scope:  Local
+ *
+ * Write one result object.  params is a list of extra "key": value
+ * members, or 0; times holds the ns of each of the mb.reps runs.
+ *
+ *---------------------------------------------------------------------*/
+
+static void mb_report(const char* name, const char* params,
+                      unsigned long ops, uint64_t* times)
+{
+    qsort(times, mb.reps, sizeof(uint64_t), mb_cmp_u64);
+    fprintf(mb.out, "%s\n    {\"name\": \"%s\", %s%s\"ops\": %lu, "
+            "\"ns_per_op\": %.2f, \"ns_per_op_median\": %.2f}",
+            mb.nresults ? "," : "", name, params ? params : "", params ? ", " : "",
+            ops, (double)times[0] / ops, (double)times[mb.reps / 2] / ops);
+    mb.nresults++;
+}
+
+/*---------------------------------------------------------------------
+ * Method: mb_run(..)
+ * Scope:  Local
+ *
+ * Time mb.reps runs of fn(arg, ops), after one untimed run to warm the
+ * caches, and report them.
+ *
+ *---------------------------------------------------------------------*/
+
+static void mb_run(const char* name, const char* params, mb_fn fn,
+                   void* arg, unsigned long ops)
+{
+    uint64_t times[64];
+    uint64_t t0;
+    unsigned int r;
+
+    fn(arg, ops);
+    for(r = 0; r < mb.reps; r++)
+    {
+        t0 = mb_now_ns();
+        fn(arg, ops);
+        times[r] = mb_now_ns() - t0;
+    }
+    mb_report(name, params, ops, times);
+}
+
+/*-----------------------------------------------------------------------------
+ * longest_prefix_match()
+ *---------------------------------------------------------------------------*/
+
+struct mb_fib_arg
+{
+    struct sr_instance* sr;
+    uint32_t* keys;
+};
+
+static void mb_fib_lookup(void* arg, unsigned long ops)
+{
+    struct mb_fib_arg* a = (struct mb_fib_arg*)arg;
+    uintptr_t acc = 0;
+    unsigned long i;
+
+    sr_rcu_read_lock(&(a->sr->rcu));
+    for(i = 0; i < ops; i++)
+    { acc += (uintptr_t)longest_prefix_match(a->sr, a->keys[i & (MB_KEYS - 1)]); }
+    sr_rcu_read_unlock(&(a->sr->rcu));
+    mb_sink = acc;
+}
+
+/* -- prefix lengths roughly as in an Internet routing table -- */
+static unsigned int mb_prefix_len(void)
+{
+    unsigned int r = mb_rand() % 100;
+
+    if(r < 55) { return 24; }
+    if(r < 65) { return 22; }
+    if(r < 73) { return 23; }
+    if(r < 80) { return 21; }
+    if(r < 86) { return 20; }
+    if(r < 91) { return 16 + mb_rand() % 4; }
+    if(r < 95) { return 8 + mb_rand() % 8; }
+    if(r < 98) { return 25 + mb_rand() % 6; }
+    return 32;
+}
+
+/*---------------------------------------------------------------------
+ * Method: mb_fib(..)
+ * Scope:  Local
+ *
+ * For each table size up to max_prefixes, build a FIB of random unicast
+ * prefixes in both modes and look up keys of which half fall inside a
+ * prefix of the table and half are random addresses.
+ *
+ *---------------------------------------------------------------------*/
+
+static void mb_fib(struct sr_instance* sr, unsigned int max_prefixes)
+{
+    static const unsigned int sizes[] = { 10, 100, 1000, 10000, 100000, 1000000 };
+    static const char* ifnames[] = { "eth1", "eth2", "eth3", "eth4" };
+    struct mb_fib_arg arg;
+    struct sr_rt* rts;
+    struct sr_fib* fib;
+    struct sr_fib* saved = sr->fib;
+    char params[160];
+    uint32_t mask, host;
+    uint64_t t0, t1;
+    unsigned int s, i, len, mode;
+
+    if(!mb_wanted("fib_lookup"))
+    { return; }
+
+    arg.sr = sr;
+    arg.keys = (uint32_t*)malloc(MB_KEYS * sizeof(uint32_t));
+    assert(arg.keys);
+
+    for(s = 0; s < sizeof(sizes) / sizeof(sizes[0]) && sizes[s] <= max_prefixes; s++)
+    {
+        rts = (struct sr_rt*)calloc(sizes[s], sizeof(struct sr_rt));
+        assert(rts);
+        for(i = 0; i < sizes[s]; i++)
+        {
+            len = mb_prefix_len();
+            mask = len ? ~0U << (32 - len) : 0;
+            rts[i].dest.s_addr = htonl((0x01000000 + mb_rand() % 0xdf000000) & mask);
+            rts[i].mask.s_addr = htonl(mask);
+            rts[i].gw.s_addr = htonl(0x0a000001 + i % 4);
+            strncpy(rts[i].interface, ifnames[i % 4], sr_IFACE_NAMELEN);
+            rts[i].next = (i + 1 < sizes[s]) ? &(rts[i + 1]) : 0;
+        }
+        for(i = 0; i < MB_KEYS; i++)
+        {
+            if(i & 1)
+            { arg.keys[i] = htonl(mb_rand()); }
+            else
+            {
+                struct sr_rt* rt = &(rts[mb_rand() % sizes[s]]);
+                host = mb_rand() & ~ntohl(rt->mask.s_addr);
+                arg.keys[i] = rt->dest.s_addr | htonl(host);
+            }
+        }
+
+        for(mode = SR_FIB_TRIE; mode <= SR_FIB_DIR24; mode++)
+        {
+            t0 = mb_now_ns();
+            fib = sr_fib_create(mode, rts);
+            t1 = mb_now_ns();
+            if(fib == 0)
+            {
+                fprintf(stderr, "could not build a FIB of %u prefixes\n", sizes[s]);
+                continue;
+            }
+            sr->fib = fib;
+            snprintf(params, sizeof(params),
+                     "\"fib\": \"%s\", \"prefixes\": %u, \"routes\": %u, \"build_ms\": %.3f",
+                     mode == SR_FIB_DIR24 ? "dir24" : "trie", sizes[s], fib->nroutes,
+                     (t1 - t0) / 1e6);
+            mb_run("fib_lookup", params, mb_fib_lookup, &arg, MB_OPS);
+            sr->fib = saved;
+            sr_fib_destroy(fib);
+        }
+        free(rts);
+    }
+    free(arg.keys);
+}
+
+/*-----------------------------------------------------------------------------
+ * sr_arpcache_lookup() and sr_arpcache_insert()
+ *---------------------------------------------------------------------------*/
+
+struct mb_arp_arg
+{
+    struct sr_arpcache* cache;
+    uint32_t* keys;
+    unsigned int nkeys;
+};
+
+/* -- the n-th neighbour: distinct addresses spread over 10/8 -- */
+static uint32_t mb_arp_ip(unsigned int n)
+{ return htonl(0x0a000000 | ((n * 2654435761U) & 0x00ffffff)); }
+
+static void mb_arp_lookup(void* arg, unsigned long ops)
+{
+    struct mb_arp_arg* a = (struct mb_arp_arg*)arg;
+    unsigned char mac[ETHER_ADDR_LEN];
+    uintptr_t acc = 0;
+    unsigned long i;
+
+    for(i = 0; i < ops; i++)
+    { acc += sr_arpcache_lookup(a->cache, a->keys[i % a->nkeys], mac); }
+    mb_sink = acc;
+}
+
+static void mb_arp_update(void* arg, unsigned long ops)
+{
+    struct mb_arp_arg* a = (struct mb_arp_arg*)arg;
+    unsigned char mac[ETHER_ADDR_LEN] = { 0x02, 0xee, 0, 0, 0, 0 };
+    unsigned long i;
+
+    for(i = 0; i < ops; i++)
+    { sr_arpcache_insert(a->cache, mac, a->keys[i % a->nkeys]); }
+}
+
+static void mb_arp_fill(struct sr_arpcache* cache, unsigned int from, unsigned int to)
+{
+    unsigned char mac[ETHER_ADDR_LEN] = { 0x02, 0xee, 0, 0, 0, 0 };
+    unsigned int n;
+
+    for(n = from; n < to; n++)
+    { sr_arpcache_insert(cache, mac, mb_arp_ip(n)); }
+}
+
+/*---------------------------------------------------------------------
+ * Method: mb_arp(..)
+ * Scope:  Local
+ *
+ * For two capacities and several occupancies: hits, misses, refreshes
+ * of entries already there, and inserts of new entries as the cache
+ * fills up to the occupancy (the last 1/MB_ARP_FILL of the capacity).
+ *
+ *---------------------------------------------------------------------*/
+
+static void mb_arp(void)
+{
+    static const unsigned int caps[] = { 1024, 65536 };
+    static const unsigned int pcts[] = { 10, 50, 90, 100 };
+    struct sr_arpcache cache;
+    struct mb_arp_arg arg;
+    char params[128];
+    uint64_t times[64];
+    uint64_t t0;
+    unsigned int c, p, r, n, lo, i;
+
+    if(!mb_wanted("arp_"))
+    { return; }
+
+    arg.cache = &cache;
+    for(c = 0; c < sizeof(caps) / sizeof(caps[0]); c++)
+    {
+        arg.keys = (uint32_t*)malloc(caps[c] * sizeof(uint32_t));
+        assert(arg.keys);
+        for(p = 0; p < sizeof(pcts) / sizeof(pcts[0]); p++)
+        {
+            n = caps[c] * pcts[p] / 100;
+            lo = n - caps[c] / MB_ARP_FILL;
+            snprintf(params, sizeof(params), "\"capacity\": %u, \"occupancy\": %u",
+                     caps[c], pcts[p]);
+
+            if(mb_wanted("arp_insert_new"))
+            {
+                for(r = 0; r < mb.reps; r++)
+                {
+                    sr_arpcache_init(&cache, caps[c]);
+                    mb_arp_fill(&cache, 0, lo);
+                    t0 = mb_now_ns();
+                    mb_arp_fill(&cache, lo, n);
+                    times[r] = mb_now_ns() - t0;
+                    sr_arpcache_destroy(&cache);
+                }
+                mb_report("arp_insert_new", params, n - lo, times);
+            }
+
+            sr_arpcache_init(&cache, caps[c]);
+            mb_arp_fill(&cache, 0, n);
+
+            /* -- shuffled, so that successive lookups hit different lines -- */
+            for(i = 0; i < n; i++)
+            { arg.keys[i] = mb_arp_ip(mb_rand() % n); }
+            arg.nkeys = n;
+            if(mb_wanted("arp_lookup_hit"))
+            { mb_run("arp_lookup_hit", params, mb_arp_lookup, &arg, MB_OPS); }
+            if(mb_wanted("arp_insert_update"))
+            { mb_run("arp_insert_update", params, mb_arp_update, &arg, MB_OPS); }
+
+            for(i = 0; i < n; i++)
+            { arg.keys[i] = mb_arp_ip(caps[c] + mb_rand() % caps[c]); }
+            if(mb_wanted("arp_lookup_miss"))
+            { mb_run("arp_lookup_miss", params, mb_arp_lookup, &arg, MB_OPS); }
+
+            sr_arpcache_destroy(&cache);
+        }
+        free(arg.keys);
+    }
+}
+
+/*-----------------------------------------------------------------------------
+ * cksum()
+ *---------------------------------------------------------------------------*/
+
+struct mb_cksum_arg
+{
+    uint8_t* buf;
+    int len;
+};
+
+static void mb_cksum(void* arg, unsigned long ops)
+{
+    struct mb_cksum_arg* a = (struct mb_cksum_arg*)arg;
+    uintptr_t acc = 0;
+    unsigned long i;
+
+    for(i = 0; i < ops; i++)
+    {
+        a->buf[0] = (uint8_t)i; /* not a loop invariant */
+        acc += cksum(a->buf, a->len);
+    }
+    mb_sink = acc;
+}
+
+static void mb_cksums(void)
+{
+    static const int lens[] = { 20, 28, 64, 576, 1500, 9000 };
+    struct mb_cksum_arg arg;
+    char params[64];
+    unsigned int l, i;
+
+    if(!mb_wanted("cksum"))
+    { return; }
+
+    arg.buf = (uint8_t*)malloc(9000);
+    assert(arg.buf);
+    for(i = 0; i < 9000; i++)
+    { arg.buf[i] = (uint8_t)mb_rand(); }
+
+    for(l = 0; l < sizeof(lens) / sizeof(lens[0]); l++)
+    {
+        arg.len = lens[l];
+        snprintf(params, sizeof(params), "\"bytes\": %d", lens[l]);
+        mb_run("cksum", params, mb_cksum, &arg, MB_CKSUM_BYTES / lens[l]);
+    }
+    free(arg.buf);
+}
+
+/*-----------------------------------------------------------------------------
+ * The ICMP and ARP frame builders
+ *---------------------------------------------------------------------------*/
+
+struct mb_build_arg
+{
+    struct sr_instance* sr;
+    struct sr_if* iface;
+    uint8_t payload[ICMP_DATA_SIZE];
+    uint8_t echo[1500];
+    unsigned int echo_len;
+    int icmp_type;
+    uint8_t dhost[ETHER_ADDR_LEN];
+};
+
+static void mb_build_icmp_error(void* arg, unsigned long ops)
+{
+    struct mb_build_arg* a = (struct mb_build_arg*)arg;
+    unsigned long i;
+
+    for(i = 0; i < ops; i++)
+    {
+        send_icmp_error_message(a->sr, a->iface->name, (uint16_t)i, a->payload,
+                                htonl(0x0a000102), a->iface, a->dhost, a->icmp_type);
+    }
+}
+
+static void mb_build_echo_reply(void* arg, unsigned long ops)
+{
+    struct mb_build_arg* a = (struct mb_build_arg*)arg;
+    unsigned long i;
+
+    for(i = 0; i < ops; i++)
+    {
+        send_icmp_echo_reply(a->sr, a->iface, (uint16_t)i, (sr_icmp_hdr_t*)a->echo,
+                             a->echo_len, htonl(0x0a000102), a->iface->ip, a->dhost);
+    }
+}
+
+static void mb_build_arp_reply(void* arg, unsigned long ops)
+{
+    struct mb_build_arg* a = (struct mb_build_arg*)arg;
+    unsigned long i;
+
+    for(i = 0; i < ops; i++)
+    { send_arp_reply(a->sr, a->iface, htonl(0x0a000102), a->dhost); }
+}
+
+static void mb_build_arp_request(void* arg, unsigned long ops)
+{
+    struct mb_build_arg* a = (struct mb_build_arg*)arg;
+    unsigned long i;
+
+    for(i = 0; i < ops; i++)
+    { send_arp_request(a->sr, htonl(0x0a000102)); }
+}
+
+/* -- as mb_run(), adding how many frames each call sent -- */
+static void mb_run_builder(const char* name, const char* params, mb_fn fn,
+                           struct mb_build_arg* arg)
+{
+    char buf[160];
+    unsigned long sent0 = sr_bench_sink.frames;
+
+    fn(arg, MB_BUILD_OPS);
+    snprintf(buf, sizeof(buf), "%s%s\"frames_per_op\": %.2f", params ? params : "",
+             params ? ", " : "", (double)(sr_bench_sink.frames - sent0) / MB_BUILD_OPS);
+    mb_run(name, buf, fn, arg, MB_BUILD_OPS);
+}
+
+static void mb_builders(struct sr_instance* sr)
+{
+    static const unsigned int echo_lens[] = { 64, 1472 };
+    struct mb_build_arg arg;
+    char params[64];
+    unsigned int i;
+
+    if(!mb_wanted("build_"))
+    { return; }
+
+    memset(&arg, 0, sizeof(arg));
+    arg.sr = sr;
+    arg.iface = sr->if_list;
+    memcpy(arg.dhost, "\x02\xee\x0a\x00\x01\x02", ETHER_ADDR_LEN);
+    for(i = 0; i < sizeof(arg.payload); i++)
+    { arg.payload[i] = (uint8_t)mb_rand(); }
+    for(i = 0; i < sizeof(arg.echo); i++)
+    { arg.echo[i] = (uint8_t)mb_rand(); }
+    ((sr_icmp_hdr_t*)arg.echo)->icmp_type = 8;
+    ((sr_icmp_hdr_t*)arg.echo)->icmp_code = 0;
+
+    if(mb_wanted("build_icmp_error"))
+    {
+        arg.icmp_type = ICMP_TIME_EXCEEDED;
+        mb_run_builder("build_icmp_error", "\"type\": \"time_exceeded\"",
+                       mb_build_icmp_error, &arg);
+        arg.icmp_type = ICMP_DESTINATION_HOST_UNREACHABLE;
+        mb_run_builder("build_icmp_error", "\"type\": \"host_unreachable\"",
+                       mb_build_icmp_error, &arg);
+    }
+    for(i = 0; i < sizeof(echo_lens) / sizeof(echo_lens[0]) &&
+               mb_wanted("build_icmp_echo_reply"); i++)
+    {
+        arg.echo_len = echo_lens[i];
+        snprintf(params, sizeof(params), "\"icmp_len\": %u", echo_lens[i]);
+        mb_run_builder("build_icmp_echo_reply", params, mb_build_echo_reply, &arg);
+    }
+    if(mb_wanted("build_arp_reply"))
+    { mb_run_builder("build_arp_reply", 0, mb_build_arp_reply, &arg); }
+    if(mb_wanted("build_arp_request"))
+    { mb_run_builder("build_arp_request", 0, mb_build_arp_request, &arg); }
+}
+
+/*---------------------------------------------------------------------
+ * Method: mb_instance(..)
+ * Scope:  Local
+ *
+ * An instance with no server and no threads, two interfaces, eth1
+ * 10.0.1.1/24 and eth2 10.0.2.1/24, and their connected routes.  The
+ * ICMP rate limiter is off so that the builders are always run.
+ *
+ *---------------------------------------------------------------------*/
+
+static void mb_instance(struct sr_instance* sr)
+{
+    static const char* names[] = { "eth1", "eth2" };
+    unsigned char mac[ETHER_ADDR_LEN] = { 0x02, 0, 0, 0, 0, 0 };
+    struct in_addr dest, gw, mask;
+    unsigned int i;
+
+    sr_bench_instance(sr);
+
+    gw.s_addr = 0;
+    mask.s_addr = htonl(0xffffff00);
+    for(i = 0; i < 2; i++)
+    {
+        mac[5] = i + 1;
+        sr_add_interface(sr, names[i]);
+        sr_set_ether_addr(sr, mac);
+        sr_set_ether_ip(sr, htonl(0x0a000001 | ((i + 1) << 8)));
+        sr_set_ether_mask(sr, mask.s_addr);
+        sr_add_interface_status(sr, names[i]);
+        dest.s_addr = htonl(0x0a000000 | ((i + 1) << 8));
+        sr_add_rt_entry(sr, dest, gw, mask, 0, (char*)names[i]);
+    }
+    sr_init(sr);
+    sr_ratelimit_destroy(&(sr->icmp_rl));
+}
+
+/*-----------------------------------------------------------------------------
+ *---------------------------------------------------------------------------*/
+
+int main(int argc, char** argv)
+{
+    struct sr_instance sr;
+    unsigned int max_prefixes = MB_MAX_PREFIXES;
+    char* outfile = 0;
+    int verbose = 0, c, devnull;
+
+    mb.reps = MB_REPS;
+    while((c = getopt(argc, argv, "hn:m:f:o:v")) != EOF)
+    {
+        switch(c)
+        {
+            case 'n':
+                mb.reps = atoi(optarg);
+                break;
+            case 'm':
+                max_prefixes = atoi(optarg);
+                break;
+            case 'f':
+                mb.filter = optarg;
+                break;
+            case 'o':
+                outfile = optarg;
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            default:
+                usage(argv[0]);
+                exit(c == 'h' ? 0 : 1);
+        }
+    }
+    if(mb.reps == 0 || mb.reps > 64)
+    {
+        fprintf(stderr, "reps must be 1 to 64\n");
+        exit(1);
+    }
+
+    /* -- results go to the original stdout, the router's output nowhere -- */
+    if(outfile)
+    { mb.out = fopen(outfile, "w"); }
+    else
+    { mb.out = fdopen(dup(1), "w"); }
+    if(mb.out == 0)
+    {
+        perror(outfile ? outfile : "stdout");
+        exit(1);
+    }
+    if(!verbose)
+    {
+        fflush(stdout);
+        fflush(stderr);
+        devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, 1);
+        dup2(devnull, 2);
+        close(devnull);
+        setvbuf(stderr, 0, _IOFBF, BUFSIZ);
+    }
+
+    mb_instance(&sr);
+
+    fprintf(mb.out, "{\n  \"benchmark\": \"sr_microbench\",\n"
+            "  \"time\": %ld,\n  \"cksum_impl\": \"%s\",\n  \"reps\": %u,\n"
+            "  \"results\": [", (long)time(0), cksum_impl_name(), mb.reps);
+    mb_fib(&sr, max_prefixes);
+    mb_arp();
+    mb_cksums();
+    mb_builders(&sr);
+    fprintf(mb.out, "\n  ]\n}\n");
+
+    return fclose(mb.out) == 0 ? 0 : 1;
+} /* -- main -- */
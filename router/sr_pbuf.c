@@ -0,0 +1,193 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_pbuf.c
+ *
+ * Description:
+ *
+ * Packet buffer allocation and reference counting for sr_pbuf.h.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#include "sr_pbuf.h"
+#include "sr_slab.h"
+
+#define SLOT_SIZE (sizeof(struct sr_pbuf) + SR_PBUF_HEADROOM + SR_PBUF_DATA)
+
+/*---------------------------------------------------------------------
+ * Method: sr_pbuf_pool_init(..)
+ * Scope:  Global
+ *
+ * Reserve slab memory for count full size buffers up front.
+ * Returns 0 on success, -1 if out of memory.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_pbuf_pool_init(struct sr_pbuf_pool* pool, unsigned int count)
+{
+    assert(pool);
+
+    if(sr_slab_reserve(SLOT_SIZE, count) != 0)
+    { return -1; }
+
+    pool->count  = count;
+    pool->in_use = 0;
+
+    return 0;
+} /* -- sr_pbuf_pool_init -- */
+
+void sr_pbuf_pool_destroy(struct sr_pbuf_pool* pool)
+{
+    assert(pool->in_use == 0);
+    pool->count = 0;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_pbuf_alloc(..)
+ * Scope:  Global
+ *
+ * Return a buffer holding len uninitialized bytes after SR_PBUF_HEADROOM
+ * bytes of headroom, with one reference.  The pbuf and its storage are a
+ * single slab object of the smallest class that fits.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_pbuf* sr_pbuf_alloc(struct sr_pbuf_pool* pool, unsigned int len)
+{
+    struct sr_pbuf* pbuf;
+
+    assert(pool);
+
+    pbuf = (struct sr_pbuf*)sr_slab_alloc(sizeof(struct sr_pbuf) + SR_PBUF_HEADROOM + len);
+    if(pbuf == 0)
+    { return 0; }
+    __atomic_fetch_add(&(pool->in_use), 1, __ATOMIC_RELAXED);
+
+    pbuf->head   = (uint8_t*)(pbuf + 1);
+    pbuf->size   = sr_slab_usable(pbuf) - sizeof(struct sr_pbuf);
+    pbuf->data   = pbuf->head + SR_PBUF_HEADROOM;
+    pbuf->len    = len;
+    pbuf->refcnt = 1;
+    pbuf->flags  = 0;
+    pbuf->pool   = pool;
+    pbuf->next   = 0;
+    pbuf->release = 0;
+    pbuf->owner  = 0;
+    return pbuf;
+} /* -- sr_pbuf_alloc -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pbuf_wrap(..)
+ * Scope:  Global
+ *
+ * Describe a frame in memory the caller only lends for the duration of
+ * the current call, without copying it.  Typically lives on the stack.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_pbuf_wrap(struct sr_pbuf* pbuf, struct sr_pbuf_pool* pool,
+                  uint8_t* data, unsigned int len)
+{
+    pbuf->data   = data;
+    pbuf->len    = len;
+    pbuf->head   = data;
+    pbuf->size   = len;
+    pbuf->refcnt = 1;
+    pbuf->flags  = SR_PBUF_BORROWED;
+    pbuf->pool   = pool;
+    pbuf->next   = 0;
+    pbuf->release = 0;
+    pbuf->owner  = 0;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_pbuf_hold(..)
+ * Scope:  Global
+ *
+ * Get a reference that stays valid until it is sr_pbuf_put().  For an
+ * owned buffer this is the same pbuf with its count raised; a borrowed
+ * frame is copied into a new buffer.  Returns 0 if that copy fails.
+ *
+ *---------------------------------------------------------------------*/
+
+struct sr_pbuf* sr_pbuf_hold(struct sr_pbuf* pbuf)
+{
+    struct sr_pbuf* copy;
+
+    if(!(pbuf->flags & SR_PBUF_BORROWED))
+    {
+        __atomic_fetch_add(&(pbuf->refcnt), 1, __ATOMIC_RELAXED);
+        return pbuf;
+    }
+
+    copy = sr_pbuf_alloc(pbuf->pool, pbuf->len);
+    if(copy)
+    { memcpy(copy->data, pbuf->data, pbuf->len); }
+    return copy;
+} /* -- sr_pbuf_hold -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_pbuf_put(..)
+ * Scope:  Global
+ *
+ * Drop a reference.  The last one frees a pooled buffer, or gives a
+ * buffer with a release hook back to whoever lent it.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_pbuf_put(struct sr_pbuf* pbuf)
+{
+    if(pbuf == 0 || (pbuf->flags & SR_PBUF_BORROWED))
+    { return; }
+
+    if(__atomic_sub_fetch(&(pbuf->refcnt), 1, __ATOMIC_ACQ_REL) != 0)
+    { return; }
+
+    if(pbuf->release)
+    {
+        pbuf->release(pbuf);
+        return;
+    }
+    __atomic_fetch_sub(&(pbuf->pool->in_use), 1, __ATOMIC_RELAXED);
+    sr_slab_free(pbuf);
+} /* -- sr_pbuf_put -- */
+
+unsigned int sr_pbuf_headroom(const struct sr_pbuf* pbuf)
+{ return pbuf->data - pbuf->head; }
+
+unsigned int sr_pbuf_tailroom(const struct sr_pbuf* pbuf)
+{ return pbuf->size - sr_pbuf_headroom(pbuf) - pbuf->len; }
+
+/* -- grow the frame by n bytes in front, 0 if there is no headroom -- */
+uint8_t* sr_pbuf_push(struct sr_pbuf* pbuf, unsigned int n)
+{
+    if(sr_pbuf_headroom(pbuf) < n)
+    { return 0; }
+    pbuf->data -= n;
+    pbuf->len  += n;
+    return pbuf->data;
+}
+
+/* -- strip n bytes off the front, 0 if the frame is shorter -- */
+uint8_t* sr_pbuf_pull(struct sr_pbuf* pbuf, unsigned int n)
+{
+    if(pbuf->len < n)
+    { return 0; }
+    pbuf->data += n;
+    pbuf->len  -= n;
+    return pbuf->data;
+}
+
+/* -- grow the frame by n bytes at the end, returns the first new byte -- */
+uint8_t* sr_pbuf_append(struct sr_pbuf* pbuf, unsigned int n)
+{
+    uint8_t* tail = pbuf->data + pbuf->len;
+
+    if(sr_pbuf_tailroom(pbuf) < n)
+    { return 0; }
+    pbuf->len += n;
+    return tail;
+}
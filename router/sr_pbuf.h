@@ -0,0 +1,79 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_pbuf.h
+ *
+ * Description:
+ *
+ * Reference counted packet buffers.  A pbuf owns (or borrows) a block of
+ * storage and describes the frame inside it by data/len, leaving headroom
+ * in front for headers to be pushed and tailroom behind it.  The pbuf and
+ * its storage are one slab object (sr_slab.h) sized to the frame, so small
+ * control frames do not pin a full MTU buffer.  The pool is a handle that
+ * reserves slab memory up front and counts the buffers in use.
+ *
+ * Holding a pbuf (sr_pbuf_hold) takes a reference, so a packet can sit on
+ * the ARP queue and be transmitted later without being copied.  A pbuf
+ * made by sr_pbuf_wrap() only borrows memory that its owner will reuse
+ * once the current call returns; holding one copies the frame into a
+ * pooled buffer, which is the single copy on the receive path.  A
+ * transport that receives into memory it can keep lending (the AF_XDP
+ * UMEM, sr_xdp.h) instead hands the router owned pbufs describing its
+ * frames, with a release hook that takes the frame back once the last
+ * reference is put; holding those never copies.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef sr_PBUF_H
+#define sr_PBUF_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_PBUF_POOL_SZ  4096  /* full size buffers reserved per router */
+#define SR_PBUF_HEADROOM 64    /* room to push headers in front of a frame */
+#define SR_PBUF_DATA     1518  /* largest non-jumbo frame */
+
+#define SR_PBUF_BORROWED 0x1   /* memory belongs to someone else */
+
+struct sr_pbuf_pool;
+
+struct sr_pbuf
+{
+    uint8_t* data;              /* first byte of the frame */
+    unsigned int len;           /* bytes in the frame */
+    uint8_t* head;              /* start of the storage */
+    unsigned int size;          /* bytes of storage */
+    int refcnt;
+    int flags;                  /* SR_PBUF_* */
+    struct sr_pbuf_pool* pool;  /* where held copies and frees go */
+    struct sr_pbuf* next;       /* link for whoever holds the pbuf */
+    void (*release)(struct sr_pbuf*); /* storage not from the slab */
+    void* owner;                /* for release */
+};
+
+struct sr_pbuf_pool
+{
+    unsigned int count;         /* full size buffers reserved */
+    unsigned int in_use;        /* updated atomically */
+};
+
+int  sr_pbuf_pool_init(struct sr_pbuf_pool* pool, unsigned int count);
+void sr_pbuf_pool_destroy(struct sr_pbuf_pool* pool);
+
+struct sr_pbuf* sr_pbuf_alloc(struct sr_pbuf_pool* pool, unsigned int len);
+void sr_pbuf_wrap(struct sr_pbuf* pbuf, struct sr_pbuf_pool* pool,
+                  uint8_t* data, unsigned int len);
+struct sr_pbuf* sr_pbuf_hold(struct sr_pbuf* pbuf);
+void sr_pbuf_put(struct sr_pbuf* pbuf);
+
+unsigned int sr_pbuf_headroom(const struct sr_pbuf* pbuf);
+unsigned int sr_pbuf_tailroom(const struct sr_pbuf* pbuf);
+uint8_t* sr_pbuf_push(struct sr_pbuf* pbuf, unsigned int n);
+uint8_t* sr_pbuf_pull(struct sr_pbuf* pbuf, unsigned int n);
+uint8_t* sr_pbuf_append(struct sr_pbuf* pbuf, unsigned int n);
+
+#endif  /* --  sr_PBUF_H -- */
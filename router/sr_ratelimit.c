@@ -0,0 +1,191 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ratelimit.c
+ *
+ * Description:
+ *
+ * Lock-free token buckets for sr_ratelimit.h.  A bucket word holds, from
+ * the top, the 32 bit millisecond time tokens were last added, a 16 bit
+ * tag naming its owner and the token count in 1/256ths of a token.  A
+ * denied request never writes the word, so a flood that is being
+ * suppressed does not bounce its cache line between threads; only when
+ * the interface limit denies is the source's token written back.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <netinet/in.h>
+
+#include "sr_ratelimit.h"
+#include "sr_timer.h"
+
+#define RL_ONE      256U        /* one token */
+#define RL_RATE_MAX 1000000U
+
+static unsigned int sr_rl_clamp_burst(unsigned int rate, unsigned int burst)
+{
+    if(rate == 0)
+    { return 0; }
+    if(burst == 0)
+    { burst = 1; }
+    return (burst > SR_RL_BURST_MAX) ? SR_RL_BURST_MAX : burst;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_ratelimit_init(..)
+ * Scope:  Global
+ *
+ * Rates are tokens per second and bursts the tokens a bucket holds; a
+ * rate of 0 turns that limit off.  Returns 0 on success, -1 if out of
+ * memory.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_ratelimit_init(struct sr_ratelimit* rl,
+                      unsigned int src_rate, unsigned int src_burst,
+                      unsigned int if_rate, unsigned int if_burst)
+{
+    assert(rl);
+
+    rl->src_rate  = (src_rate > RL_RATE_MAX) ? RL_RATE_MAX : src_rate;
+    rl->if_rate   = (if_rate > RL_RATE_MAX) ? RL_RATE_MAX : if_rate;
+    rl->src_burst = sr_rl_clamp_burst(rl->src_rate, src_burst);
+    rl->if_burst  = sr_rl_clamp_burst(rl->if_rate, if_burst);
+
+    rl->src_slots = (uint64_t*)calloc(SR_RL_SRC_SLOTS, sizeof(uint64_t));
+    if(rl->src_slots == 0)
+    { return -1; }
+    memset(rl->if_slots, 0, sizeof(rl->if_slots));
+
+    rl->allowed        = 0;
+    rl->suppressed_src = 0;
+    rl->suppressed_if  = 0;
+    return 0;
+} /* -- sr_ratelimit_init -- */
+
+void sr_ratelimit_destroy(struct sr_ratelimit* rl)
+{
+    free(rl->src_slots);
+    rl->src_slots = 0;
+}
+
+/* -- take one token from the bucket at slot; 1 if there was one -- */
+static int sr_rl_take(uint64_t* slot, uint32_t tag, uint32_t now,
+                      unsigned int rate, unsigned int burst)
+{
+    uint32_t cap = burst * RL_ONE;
+    uint32_t stamp, tokens;
+    uint64_t old, new, add;
+
+    old = __atomic_load_n(slot, __ATOMIC_RELAXED);
+    do
+    {
+        stamp = (uint32_t)(old >> 32);
+        if(old == 0 || ((old >> 16) & 0xffff) != tag)
+        {
+            /* -- empty, or owned by another key: start full -- */
+            tokens = cap;
+            stamp  = now;
+        }
+        else
+        {
+            tokens = (uint32_t)(old & 0xffff);
+            add = (uint64_t)(uint32_t)(now - stamp) * rate * RL_ONE / 1000;
+            if(tokens + add >= cap)
+            {
+                tokens = cap;
+                stamp  = now;
+            }
+            else
+            {
+                /* -- advance only by the time the added tokens took -- */
+                tokens += (uint32_t)add;
+                stamp  += (uint32_t)(add * 1000 / ((uint64_t)rate * RL_ONE));
+            }
+        }
+
+        if(tokens < RL_ONE)
+        { return 0; }
+
+        new = ((uint64_t)stamp << 32) | ((uint64_t)tag << 16) | (tokens - RL_ONE);
+    } while(!__atomic_compare_exchange_n(slot, &old, new, 1,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return 1;
+} /* -- sr_rl_take -- */
+
+/* -- put back a token sr_rl_take() took, unless the slot changed owner -- */
+static void sr_rl_give(uint64_t* slot, uint32_t tag, unsigned int burst)
+{
+    uint32_t cap = burst * RL_ONE;
+    uint32_t tokens;
+    uint64_t old, new;
+
+    old = __atomic_load_n(slot, __ATOMIC_RELAXED);
+    do
+    {
+        if(old == 0 || ((old >> 16) & 0xffff) != tag)
+        { return; }
+        tokens = (uint32_t)(old & 0xffff) + RL_ONE;
+        if(tokens > cap)
+        { tokens = cap; }
+        new = (old & ~(uint64_t)0xffff) | tokens;
+    } while(!__atomic_compare_exchange_n(slot, &old, new, 1,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+} /* -- sr_rl_give -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_ratelimit_allow(..)
+ * Scope:  Global
+ *
+ * Decide whether an ICMP error to dst_ip (network byte order) leaving on
+ * interface ifindex may be sent.  Returns 1 and takes the tokens if so,
+ * 0 if the error should be suppressed.  A suppressed error leaves both
+ * buckets as they were, so errors the interface limit drops do not use
+ * up the source's budget.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_ratelimit_allow(struct sr_ratelimit* rl, uint32_t dst_ip,
+                       unsigned int ifindex)
+{
+    uint32_t now = (uint32_t)sr_timer_now_ms();
+    uint32_t hash = (ntohl(dst_ip) >> 8) * 0x9e3779b1U;
+    uint64_t* src_slot = 0;
+
+    if(rl->src_rate)
+    {
+        src_slot = &(rl->src_slots[(hash >> 20) & (SR_RL_SRC_SLOTS - 1)]);
+        if(!sr_rl_take(src_slot, hash & 0xffff, now, rl->src_rate, rl->src_burst))
+        {
+            __atomic_fetch_add(&(rl->suppressed_src), 1, __ATOMIC_RELAXED);
+            return 0;
+        }
+    }
+
+    if(rl->if_rate)
+    {
+        if(!sr_rl_take(&(rl->if_slots[ifindex % SR_RL_IF_SLOTS]),
+                       (ifindex + 1) & 0xffff, now, rl->if_rate, rl->if_burst))
+        {
+            if(src_slot)
+            { sr_rl_give(src_slot, hash & 0xffff, rl->src_burst); }
+            __atomic_fetch_add(&(rl->suppressed_if), 1, __ATOMIC_RELAXED);
+            return 0;
+        }
+    }
+
+    __atomic_fetch_add(&(rl->allowed), 1, __ATOMIC_RELAXED);
+    return 1;
+} /* -- sr_ratelimit_allow -- */
+
+void sr_ratelimit_print_stats(struct sr_ratelimit* rl, FILE* out)
+{
+    fprintf(out, "ICMP errors: %lu sent, %lu suppressed by source (%u/s burst %u), "
+            "%lu by interface (%u/s burst %u)\n",
+            __atomic_load_n(&(rl->allowed), __ATOMIC_RELAXED),
+            __atomic_load_n(&(rl->suppressed_src), __ATOMIC_RELAXED),
+            rl->src_rate, rl->src_burst,
+            __atomic_load_n(&(rl->suppressed_if), __ATOMIC_RELAXED),
+            rl->if_rate, rl->if_burst);
+}
@@ -0,0 +1,59 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_ratelimit.h
+ *
+ * Description:
+ *
+ * Token bucket limiter for the ICMP errors the router generates.  Every
+ * error has to get a token from the bucket of the /24 it is sent to and
+ * from the bucket of the interface it leaves on, so a scan or a routing
+ * loop costs at most a bounded number of errors per second.
+ *
+ * Each bucket is one 64 bit word updated with compare-and-swap, so
+ * forwarding threads never take a lock for it.  Source buckets live in a
+ * direct mapped table; a /24 that hashes to a slot owned by another
+ * prefix takes the slot over with a full bucket.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef sr_RATELIMIT_H
+#define sr_RATELIMIT_H
+
+#include <stdio.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_RL_SRC_SLOTS   4096  /* source prefix buckets, a power of two */
+#define SR_RL_IF_SLOTS    64    /* interface buckets, by ifindex */
+#define SR_RL_BURST_MAX   255   /* tokens a bucket holds at most */
+
+#define SR_RL_SRC_RATE    10    /* default errors per second per /24 */
+#define SR_RL_IF_RATE     1000  /* default errors per second per interface */
+
+struct sr_ratelimit
+{
+    unsigned int src_rate;      /* tokens per second, 0 for no limit */
+    unsigned int src_burst;
+    unsigned int if_rate;
+    unsigned int if_burst;
+    uint64_t* src_slots;        /* time ms : tag : tokens in 1/256 */
+    uint64_t if_slots[SR_RL_IF_SLOTS];
+    unsigned long allowed;
+    unsigned long suppressed_src;
+    unsigned long suppressed_if;
+};
+
+int  sr_ratelimit_init(struct sr_ratelimit* rl,
+                       unsigned int src_rate, unsigned int src_burst,
+                       unsigned int if_rate, unsigned int if_burst);
+void sr_ratelimit_destroy(struct sr_ratelimit* rl);
+int  sr_ratelimit_allow(struct sr_ratelimit* rl, uint32_t dst_ip,
+                        unsigned int ifindex);
+void sr_ratelimit_print_stats(struct sr_ratelimit* rl, FILE* out);
+
+#endif  /* --  sr_RATELIMIT_H -- */
@@ -0,0 +1,199 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_rcu.c
+ *
+ * Description:
+ *
+ * Epoch based reclamation for sr_rcu.h.  Each reader thread owns a slot in
+ * rcu->readers.  On entering a read-side critical section it records the
+ * current global epoch; on leaving it resets the slot to 0.  Retiring an
+ * object tags it with the current epoch and advances the global epoch, so
+ * the object is unreachable for every reader that enters afterwards.  It
+ * can be freed as soon as no slot holds an epoch at or below its tag.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+
+#include "sr_rcu.h"
+
+/* -- slot of the calling thread, assigned on first use -- */
+static __thread struct sr_rcu_reader* sr_rcu_self = 0;
+
+void sr_rcu_init(struct sr_rcu* rcu)
+{
+    assert(rcu);
+
+    memset(rcu->readers, 0, sizeof(rcu->readers));
+    rcu->epoch    = 1;
+    rcu->retired  = 0;
+    rcu->nretired = 0;
+    pthread_mutex_init(&(rcu->lock), 0);
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rcu_register(..)
+ * Scope:  Global
+ *
+ * Claim a reader slot for the calling thread.  Called implicitly by the
+ * first sr_rcu_read_lock() of a thread.  Returns 0 on success, -1 if all
+ * SR_RCU_MAX_READERS slots are taken.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_rcu_register(struct sr_rcu* rcu)
+{
+    int i;
+
+    if(sr_rcu_self)
+    { return 0; }
+
+    for(i = 0; i < SR_RCU_MAX_READERS; i++)
+    {
+        if(__sync_bool_compare_and_swap(&(rcu->readers[i].in_use), 0, 1))
+        {
+            rcu->readers[i].nesting = 0;
+            __atomic_store_n(&(rcu->readers[i].epoch), 0, __ATOMIC_RELEASE);
+            sr_rcu_self = &(rcu->readers[i]);
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "sr_rcu_register: out of reader slots\n");
+    return -1;
+} /* -- sr_rcu_register -- */
+
+void sr_rcu_unregister(struct sr_rcu* rcu)
+{
+    struct sr_rcu_reader* self = sr_rcu_self;
+
+    if(self == 0)
+    { return; }
+
+    assert(self->nesting == 0);
+    __atomic_store_n(&(self->epoch), 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&(self->in_use), 0, __ATOMIC_RELEASE);
+    sr_rcu_self = 0;
+}
+
+void sr_rcu_read_lock(struct sr_rcu* rcu)
+{
+    struct sr_rcu_reader* self = sr_rcu_self;
+
+    if(self == 0)
+    {
+        if(sr_rcu_register(rcu) != 0)
+        { abort(); }
+        self = sr_rcu_self;
+    }
+
+    if(self->nesting++ == 0)
+    {
+        __atomic_store_n(&(self->epoch),
+                         __atomic_load_n(&(rcu->epoch), __ATOMIC_ACQUIRE),
+                         __ATOMIC_RELAXED);
+        /* -- the announcement must be visible before any protected load -- */
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+}
+
+void sr_rcu_read_unlock(struct sr_rcu* rcu)
+{
+    struct sr_rcu_reader* self = sr_rcu_self;
+
+    assert(self && self->nesting > 0);
+
+    if(--self->nesting == 0)
+    { __atomic_store_n(&(self->epoch), 0, __ATOMIC_RELEASE); }
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rcu_retire(..)
+ * Scope:  Global
+ *
+ * Queue an object that has already been unpublished for deferred
+ * freeing, then try to reclaim whatever has become safe.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rcu_retire(struct sr_rcu* rcu, void* ptr, void (*free_fn)(void*))
+{
+    struct sr_rcu_retired* item;
+
+    if(ptr == 0)
+    { return; }
+
+    item = (struct sr_rcu_retired*)malloc(sizeof(struct sr_rcu_retired));
+    assert(item);
+    item->ptr     = ptr;
+    item->free_fn = free_fn;
+
+    /* -- order the unpublishing store before sampling the readers -- */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    pthread_mutex_lock(&(rcu->lock));
+    item->epoch = __atomic_fetch_add(&(rcu->epoch), 1, __ATOMIC_SEQ_CST);
+    item->next = rcu->retired;
+    rcu->retired = item;
+    rcu->nretired++;
+    pthread_mutex_unlock(&(rcu->lock));
+
+    sr_rcu_reclaim(rcu);
+} /* -- sr_rcu_retire -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rcu_reclaim(..)
+ * Scope:  Global
+ *
+ * Free every retired object no active reader can still reference.  Never
+ * blocks on readers; objects that are still in use are left for a later
+ * call.  Returns the number of objects freed.
+ *
+ *---------------------------------------------------------------------*/
+
+unsigned int sr_rcu_reclaim(struct sr_rcu* rcu)
+{
+    struct sr_rcu_retired** link;
+    struct sr_rcu_retired* item;
+    struct sr_rcu_retired* done = 0;
+    unsigned long oldest = (unsigned long)-1;
+    unsigned long e;
+    unsigned int freed = 0;
+    int i;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    for(i = 0; i < SR_RCU_MAX_READERS; i++)
+    {
+        e = __atomic_load_n(&(rcu->readers[i].epoch), __ATOMIC_ACQUIRE);
+        if(e != 0 && e < oldest)
+        { oldest = e; }
+    }
+
+    pthread_mutex_lock(&(rcu->lock));
+    link = &(rcu->retired);
+    while((item = *link) != 0)
+    {
+        if(item->epoch < oldest)
+        {
+            *link = item->next;
+            item->next = done;
+            done = item;
+            rcu->nretired--;
+        }
+        else
+        { link = &(item->next); }
+    }
+    pthread_mutex_unlock(&(rcu->lock));
+
+    while(done)
+    {
+        item = done;
+        done = done->next;
+        item->free_fn(item->ptr);
+        free(item);
+        freed++;
+    }
+    return freed;
+} /* -- sr_rcu_reclaim -- */
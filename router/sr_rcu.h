@@ -0,0 +1,58 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_rcu.h
+ *
+ * Description:
+ *
+ * Minimal read-copy-update with epoch based reclamation.  Writers publish a
+ * new immutable object with an atomic pointer store and hand the old one to
+ * sr_rcu_retire().  Readers bracket their accesses with sr_rcu_read_lock()
+ * and sr_rcu_read_unlock(), which never block and never take a mutex.  A
+ * retired object is freed once every reader that could have seen it has
+ * left its read-side critical section.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef sr_RCU_H
+#define sr_RCU_H
+
+#include <pthread.h>
+
+#define SR_RCU_MAX_READERS 64
+
+/* -- read a published pointer / publish a new one -- */
+#define sr_rcu_dereference(p)    __atomic_load_n(&(p), __ATOMIC_ACQUIRE)
+#define sr_rcu_assign(p, v)      __atomic_store_n(&(p), (v), __ATOMIC_RELEASE)
+
+struct sr_rcu_reader
+{
+    unsigned long epoch;   /* epoch observed on entry, 0 while quiescent */
+    unsigned int nesting;
+    int in_use;
+};
+
+struct sr_rcu_retired
+{
+    void* ptr;
+    void (*free_fn)(void*);
+    unsigned long epoch;   /* global epoch when the object was unpublished */
+    struct sr_rcu_retired* next;
+};
+
+struct sr_rcu
+{
+    unsigned long epoch;
+    struct sr_rcu_reader readers[SR_RCU_MAX_READERS];
+    struct sr_rcu_retired* retired;  /* protected by lock */
+    unsigned int nretired;
+    pthread_mutex_t lock;
+};
+
+void sr_rcu_init(struct sr_rcu* rcu);
+int  sr_rcu_register(struct sr_rcu* rcu);
+void sr_rcu_unregister(struct sr_rcu* rcu);
+void sr_rcu_read_lock(struct sr_rcu* rcu);
+void sr_rcu_read_unlock(struct sr_rcu* rcu);
+void sr_rcu_retire(struct sr_rcu* rcu, void* ptr, void (*free_fn)(void*));
+unsigned int sr_rcu_reclaim(struct sr_rcu* rcu);
+
+#endif  /* --  sr_RCU_H -- */
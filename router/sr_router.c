@@ -20,8 +20,61 @@
 #include "sr_protocol.h"
 #include "sr_arpcache.h"
 #include "sr_utils.h"
+#include "sr_cksum.h"
 #include "vnscommand.h"
 
+/*---------------------------------------------------------------------
+ * Method: sr_init_instance(..)
+ * Scope:  Global
+ *
+ * Zero out an instance: no interfaces or routes, the VNS transport and
+ * the default options, with its locks and buffers set up.  Used by
+ * sr_main.c and, through sr_bench_instance(), by the benchmarks.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_init_instance(struct sr_instance* sr)
+{
+    /* REQUIRES */
+    assert(sr);
+
+    sr->sockfd = -1;
+    sr->transport = &sr_vns_transport;
+    sr->transport_priv = 0;
+    sr->user[0] = 0;
+    sr->host[0] = 0;
+    sr->topo_id = 0;
+    sr->if_list = 0;
+    memset(&(sr->if_table), 0, sizeof(struct sr_if_table));
+    sr->if_cache = 0;
+    sr->routing_table = 0;
+    memset(&(sr->rt_index), 0, sizeof(struct sr_rt_index));
+    sr->fib = 0;
+    sr->fib_mode = SR_FIB_TRIE;
+    sr->rt_batch = 0;
+    sr->rt_dirty = 0;
+    memset(&(sr->rip), 0, sizeof(struct sr_rip));
+    sr->arpcache_sz = 0;
+    sr->nworkers = 0;
+    sr->fwd = 0;
+    sr->icmp_src_rate = SR_RL_SRC_RATE;
+    sr->icmp_if_rate = SR_RL_IF_RATE;
+    sr->icmp_rl.src_slots = 0;
+    sr->event_loop = 0;
+    pthread_mutex_init(&(sr->send_lock), 0);
+    memset(&(sr->txq), 0, sizeof(struct sr_txq));
+    sr->txq.buf = (uint8_t*)malloc(SR_TXQ_BYTES);
+    memset(&(sr->rx), 0, sizeof(struct sr_rxbuf));
+    sr->rx.buf = (uint8_t*)malloc(SR_RX_BYTES);
+    sr_rcu_init(&(sr->rcu));
+    sr->logfile = 0;
+
+    srand(time(NULL));
+    pthread_mutexattr_init(&(sr->rt_locker_attr));
+    pthread_mutexattr_settype(&(sr->rt_locker_attr), PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&(sr->rt_locker), &(sr->rt_locker_attr));
+} /* -- sr_init_instance -- */
+
 /*---------------------------------------------------------------------
  * Method: sr_init(void)
  * Scope:  Global
@@ -35,28 +88,60 @@ void sr_init(struct sr_instance* sr)
     /* REQUIRES */
     assert(sr);
 
-    /* Initialize cache and cache cleanup thread */
-    sr_arpcache_init(&(sr->cache));
+    /* Packet buffers used from receive to transmit */
+    sr_pbuf_pool_init(&(sr->pbufs), SR_PBUF_POOL_SZ);
 
-    pthread_attr_init(&(sr->attr));
-    pthread_attr_setdetachstate(&(sr->attr), PTHREAD_CREATE_JOINABLE);
-    pthread_attr_setscope(&(sr->attr), PTHREAD_SCOPE_SYSTEM);
-    pthread_attr_setscope(&(sr->attr), PTHREAD_SCOPE_SYSTEM);
-    pthread_t arp_thread;
+    /* Initialize cache and cache cleanup thread */
+    sr_arpcache_init(&(sr->cache), sr->arpcache_sz);
 
-    pthread_create(&arp_thread, &(sr->attr), sr_arpcache_timeout, sr);
-    
     srand(time(NULL));
     pthread_mutexattr_init(&(sr->rt_lock_attr));
     pthread_mutexattr_settype(&(sr->rt_lock_attr), PTHREAD_MUTEX_RECURSIVE);
     pthread_mutex_init(&(sr->rt_lock), &(sr->rt_lock_attr));
 
-    pthread_attr_init(&(sr->rt_attr));
-    pthread_attr_setdetachstate(&(sr->rt_attr), PTHREAD_CREATE_JOINABLE);
-    pthread_attr_setscope(&(sr->rt_attr), PTHREAD_SCOPE_SYSTEM);
-    pthread_attr_setscope(&(sr->rt_attr), PTHREAD_SCOPE_SYSTEM);
-    pthread_t rt_thread;
-    pthread_create(&rt_thread, &(sr->rt_attr), sr_rip_timeout, sr);
+    /* The event loop runs the ARP and RIP timers itself */
+    if(!sr->event_loop)
+    {
+        pthread_attr_init(&(sr->attr));
+        pthread_attr_setdetachstate(&(sr->attr), PTHREAD_CREATE_JOINABLE);
+        pthread_attr_setscope(&(sr->attr), PTHREAD_SCOPE_SYSTEM);
+        pthread_attr_setscope(&(sr->attr), PTHREAD_SCOPE_SYSTEM);
+        pthread_t arp_thread;
+
+        pthread_create(&arp_thread, &(sr->attr), sr_arpcache_timeout, sr);
+
+        pthread_attr_init(&(sr->rt_attr));
+        pthread_attr_setdetachstate(&(sr->rt_attr), PTHREAD_CREATE_JOINABLE);
+        pthread_attr_setscope(&(sr->rt_attr), PTHREAD_SCOPE_SYSTEM);
+        pthread_attr_setscope(&(sr->rt_attr), PTHREAD_SCOPE_SYSTEM);
+        pthread_t rt_thread;
+        pthread_create(&rt_thread, &(sr->rt_attr), sr_rip_timeout, sr);
+    }
+
+    /* Bound the ICMP errors we generate; a bucket holds two seconds' worth */
+    if(sr_ratelimit_init(&(sr->icmp_rl), sr->icmp_src_rate, 2 * sr->icmp_src_rate,
+                         sr->icmp_if_rate, 2 * sr->icmp_if_rate) != 0)
+    { fprintf(stderr,"Error allocating ICMP rate limiter\n"); }
+
+    /* Headers for generated ICMP and ARP frames; interfaces are known by now */
+    struct sr_if* if_iter;
+    for(if_iter = sr->if_list; if_iter != NULL; if_iter = if_iter->next)
+    { sr_if_build_templates(if_iter); }
+
+    /* Connected routes and the neighbours' tables, if we speak RIP */
+    if(sr->rip.enabled)
+    { sr_rip_init(sr); }
+
+    /* The table may have been loaded before its interfaces were known */
+    if(sr->routing_table)
+    {
+        sr_rt_bind_interfaces(sr);
+        sr_rt_publish(sr);
+    }
+
+    /* Start the forwarding workers, if any */
+    if(sr_fwd_start(sr, sr->nworkers) != 0)
+    { fprintf(stderr,"Error starting forwarding workers, forwarding inline\n"); }
     
     /* Add initialization code here! */
 
@@ -114,19 +199,14 @@ int validate_packet(uint8_t* packet_buffer,int packet_len){
 }
 
 
+/* longest prefix match on the current FIB snapshot. The returned route
+   belongs to the snapshot, so callers must be inside sr_rcu_read_lock() */
 struct sr_rt* longest_prefix_match(struct sr_instance* sr,uint32_t ip_adr){
-  struct sr_rt* longest_match_rt = NULL;
-  unsigned long max_len = 0; 
-
-  struct sr_rt* rt_iter;
-
-  for(rt_iter = sr->routing_table;rt_iter!=NULL;rt_iter=rt_iter->next){
-    if((rt_iter->dest.s_addr&rt_iter->mask.s_addr)==(ip_adr & rt_iter->mask.s_addr) && (rt_iter->mask.s_addr>=max_len)){
-      max_len = rt_iter->mask.s_addr;
-      longest_match_rt = rt_iter;
-    }
+  struct sr_fib* fib = sr_rcu_dereference(sr->fib);
+  if(fib==NULL){
+    return NULL;
   }
-  return longest_match_rt;
+  return sr_fib_lookup(fib,ip_adr);
 }
 
 /* DEPRECATED Maybe?*/
@@ -147,180 +227,166 @@ int send_ethernet_frame(struct sr_instance* sr,
   return 1;
 }
 
+/* Builds the Ethernet and IP headers of a locally generated ICMP datagram
+   from the source interface's template: only the fields that vary are
+   written, and the IP checksum is finished from the template's partial sum */
+static void sr_fill_ip_headers(const struct sr_if* iface,
+                               uint8_t* buf,
+                               unsigned int ip_len,
+                               uint16_t ip_id,
+                               uint32_t src_ip_adr,
+                               uint32_t dest_ip_adr,
+                               const uint8_t* ether_dhost)
+{
+  sr_ethernet_hdr_t* eth_header = (sr_ethernet_hdr_t*) buf;
+  sr_ip_hdr_t* ip_header = (sr_ip_hdr_t*)(buf+sizeof(sr_ethernet_hdr_t));
+  uint32_t sum;
+
+  memcpy(buf,iface->ip_tmpl,SR_IF_IP_TMPL_LEN);
+  memcpy(eth_header->ether_dhost,ether_dhost,ETHER_ADDR_LEN);
+  ip_header->ip_len = htons(ip_len);
+  ip_header->ip_id = ip_id;
+  ip_header->ip_src = src_ip_adr;
+  ip_header->ip_dst = dest_ip_adr;
+
+  sum = iface->ip_tmpl_sum + ip_header->ip_len + ip_header->ip_id;
+  ip_header->ip_sum = cksum_fold(cksum_partial(&ip_header->ip_src,8,sum));
+}
+
 int send_icmp_error_message(struct sr_instance* sr,
                             char* interface_name,
                             uint16_t ip_id,
                             uint8_t* payload_from_error_datagram_buffer, /* first 28 bytes */
                             uint32_t dest_ip_adr,
-                            uint32_t src_ip_adr,
+                            struct sr_if* src_iface, /* source MAC and IP */
                             uint8_t  ether_dhost[ETHER_ADDR_LEN],   /* destination ethernet address */
-                            uint8_t  ether_shost[ETHER_ADDR_LEN],  /* source ethernet address */
                             int icmp_error_msg_type /* ICMP Error Message Type, defined in sr_router.h */
 )
 {
 
-  /* construct ethernet frame */
-  uint32_t total_len;
-  if(icmp_error_msg_type==ICMP_TIME_EXCEEDED){
-    /* Type 11 hdr */
-    total_len = sizeof(sr_ethernet_hdr_t)+sizeof(sr_ip_hdr_t)+sizeof(sr_icmp_t11_hdr_t);
-  }else{
-    /* Type 3 hdr */
-    total_len = sizeof(sr_ethernet_hdr_t)+sizeof(sr_ip_hdr_t)+sizeof(sr_icmp_t3_hdr_t);
+  /* rate limit by destination prefix and outgoing interface before doing any work */
+  struct sr_if* out_iface = sr_get_interface(sr,interface_name);
+  if(out_iface && sr->icmp_rl.src_slots &&
+     !sr_ratelimit_allow(&(sr->icmp_rl),dest_ip_adr,out_iface->ifindex)){
+    return 0; /* suppressed, not a send failure */
   }
-  uint8_t* buf = (uint8_t*) malloc(total_len);
 
-  /*  set up ethernet frame header */
-  sr_ethernet_hdr_t* eth_header = (sr_ethernet_hdr_t*) buf;
-  memcpy(eth_header->ether_dhost,ether_dhost,ETHER_ADDR_LEN);
-  memcpy(eth_header->ether_shost,ether_shost,ETHER_ADDR_LEN);
-  eth_header->ether_type = htons(ethertype_ip);
+  /* construct ethernet frame; type 3 and type 11 messages have the same size */
+  uint32_t total_len = sizeof(sr_ethernet_hdr_t)+sizeof(sr_ip_hdr_t)+sizeof(sr_icmp_t3_hdr_t);
+  struct sr_pbuf* pbuf = sr_pbuf_alloc(&(sr->pbufs),total_len);
+  if(pbuf==NULL){
+    return -1;
+  }
+  uint8_t* buf = pbuf->data;
 
-  /* set up ip header */
-  sr_ip_hdr_t* ip_header = (sr_ip_hdr_t*)(buf+sizeof(sr_ethernet_hdr_t));
-  ip_header->ip_v = 4;
-  ip_header->ip_hl = 5; /* in 32-bit words */
-  ip_header->ip_tos = 0; 
-  ip_header->ip_len = htons(total_len - sizeof(sr_ethernet_hdr_t));
-  ip_header->ip_id = ip_id; 
-  ip_header->ip_off = htons(IP_DF);
-  ip_header->ip_ttl = 64;
-  ip_header->ip_p = ip_protocol_icmp;
-  ip_header->ip_src = src_ip_adr;
-  ip_header->ip_dst = dest_ip_adr;
-  ip_header->ip_sum = 0;
-  ip_header->ip_sum = cksum(ip_header,sizeof(sr_ip_hdr_t));
+  sr_fill_ip_headers(src_iface,buf,total_len-sizeof(sr_ethernet_hdr_t),ip_id,
+                     src_iface->ip,dest_ip_adr,ether_dhost);
 
   /* set ICMP header */
-  if(icmp_error_msg_type==ICMP_TIME_EXCEEDED){
-    sr_icmp_t11_hdr_t* icmp_header = (sr_icmp_t11_hdr_t*) (buf+sizeof(sr_ethernet_hdr_t)+sizeof(sr_ip_hdr_t));
-    icmp_header->icmp_type = 11;
-    icmp_header->icmp_code = 0;
-    icmp_header->icmp_sum = 0;
-    memcpy(icmp_header->data,payload_from_error_datagram_buffer,ICMP_DATA_SIZE);
-    icmp_header->icmp_sum = cksum(icmp_header,sizeof(sr_icmp_t11_hdr_t));
-  }else{
-    sr_icmp_t3_hdr_t* icmp_header = (sr_icmp_t3_hdr_t*) (buf+sizeof(sr_ethernet_hdr_t)+sizeof(sr_ip_hdr_t));
-    icmp_header->icmp_type = 3;
-    switch (icmp_error_msg_type)
-    {
-      case ICMP_DESTINATION_NET_UNREACHABLE:
-        icmp_header->icmp_code = 0;
-        break;
-      case ICMP_DESTINATION_HOST_UNREACHABLE:
-        icmp_header->icmp_code = 1;
-        break;
-      case ICMP_PORT_UNREACHABLE:
-        icmp_header->icmp_code = 3;
-        break;
-      default:
-        break;
-    }
-    icmp_header->icmp_sum = 0;
-    memcpy(icmp_header->data,payload_from_error_datagram_buffer,ICMP_DATA_SIZE);
-    icmp_header->icmp_sum = cksum(icmp_header,sizeof(sr_icmp_t3_hdr_t));
+  sr_icmp_t3_hdr_t* icmp_header = (sr_icmp_t3_hdr_t*) (buf+sizeof(sr_ethernet_hdr_t)+sizeof(sr_ip_hdr_t));
+  icmp_header->icmp_code = 0;
+  switch (icmp_error_msg_type)
+  {
+    case ICMP_TIME_EXCEEDED:
+      icmp_header->icmp_type = 11;
+      break;
+    case ICMP_DESTINATION_NET_UNREACHABLE:
+      icmp_header->icmp_type = 3;
+      break;
+    case ICMP_DESTINATION_HOST_UNREACHABLE:
+      icmp_header->icmp_type = 3;
+      icmp_header->icmp_code = 1;
+      break;
+    case ICMP_PORT_UNREACHABLE:
+      icmp_header->icmp_type = 3;
+      icmp_header->icmp_code = 3;
+      break;
+    default:
+      icmp_header->icmp_type = 3;
+      break;
   }
+  icmp_header->icmp_sum = 0;
+  icmp_header->unused = 0;
+  icmp_header->next_mtu = 0;
+  memcpy(icmp_header->data,payload_from_error_datagram_buffer,ICMP_DATA_SIZE);
+  icmp_header->icmp_sum = cksum(icmp_header,sizeof(sr_icmp_t3_hdr_t));
   
   /* send ethernet frame */
   int is_success = sr_send_packet(sr,buf,total_len,interface_name); /* 0 is success, -1 is failure */
-  free(buf);
+  sr_pbuf_put(pbuf);
   return is_success;
   
 }
 
 
-/* return 1 if sent successfully, 0 if error.  */
+/* return 1 if sent successfully, 0 if error.
+   The reply carries the request's ICMP message back with only the type
+   changed, so its checksum is patched rather than recomputed */
 int send_icmp_echo_reply(struct sr_instance* sr,
                          struct sr_if* iface,
                          uint16_t ip_id,
-                         uint8_t* additional_data_buffer,
-                         uint32_t additional_data_len,
+                         sr_icmp_hdr_t* request, /* ICMP part of the echo request */
+                         uint32_t icmp_len,
                          uint32_t dest_ip_adr,
                          uint32_t src_ip_adr,                      
-                         uint8_t  ether_dhost[ETHER_ADDR_LEN],   /* destination ethernet address */
-                         uint8_t  ether_shost[ETHER_ADDR_LEN]  /* source ethernet address */
+                         uint8_t  ether_dhost[ETHER_ADDR_LEN]   /* destination ethernet address */
 )
 {
 
     /* construct ethernet frame */
-    uint32_t total_len = sizeof(sr_ethernet_hdr_t)+sizeof(sr_ip_hdr_t)+sizeof(sr_icmp_hdr_t)+additional_data_len; /* leave last 4 bytes empty */
-    uint8_t* buf = (uint8_t*) malloc(total_len);
-
-   /*  set up ethernet frame header */
-    sr_ethernet_hdr_t* eth_header = (sr_ethernet_hdr_t*) buf;
-    memcpy(eth_header->ether_dhost,ether_dhost,ETHER_ADDR_LEN);
-    memcpy(eth_header->ether_shost,ether_shost,ETHER_ADDR_LEN);
-    eth_header->ether_type = htons(ethertype_ip);
-
-    /* print_hdr_eth((uint8_t*)eth_header); */
-    /* set up ip header */
-    sr_ip_hdr_t* ip_header = (sr_ip_hdr_t*)(buf+sizeof(sr_ethernet_hdr_t));
-    ip_header->ip_v = 4;
-    ip_header->ip_hl = 5; /* in 32-bit words */
-    ip_header->ip_tos = 0; 
-    ip_header->ip_len = htons(sizeof(sr_ip_hdr_t) + additional_data_len+sizeof(sr_icmp_hdr_t));
-    ip_header->ip_id = ip_id; 
-    ip_header->ip_off = htons(IP_DF);
-    ip_header->ip_ttl = 64;
-    ip_header->ip_p = ip_protocol_icmp;
-    ip_header->ip_src = src_ip_adr;
-    ip_header->ip_dst = dest_ip_adr;
-    ip_header->ip_sum = 0;
-    ip_header->ip_sum = cksum(ip_header,sizeof(sr_ip_hdr_t));
-    /* print_hdr_ip((uint8_t *)ip_header); */
-
-    /* set ICMP header */
+    uint32_t total_len = sizeof(sr_ethernet_hdr_t)+sizeof(sr_ip_hdr_t)+icmp_len;
+    struct sr_pbuf* pbuf = sr_pbuf_alloc(&(sr->pbufs),total_len);
+    if(pbuf==NULL){
+      return -1;
+    }
+    uint8_t* buf = pbuf->data;
+
+    sr_fill_ip_headers(iface,buf,sizeof(sr_ip_hdr_t)+icmp_len,ip_id,
+                       src_ip_adr,dest_ip_adr,ether_dhost);
+
+    /* set ICMP header and data: the request's, with type 0 */
     sr_icmp_hdr_t* icmp_header = (sr_icmp_hdr_t*) (buf+sizeof(sr_ethernet_hdr_t)+sizeof(sr_ip_hdr_t));
-    icmp_header->icmp_type = 0;
-    icmp_header->icmp_code = 0;
-    
+    uint16_t old_word, new_word;
 
-    /* Fill in section after the header (including seq id and data section)*/
-    uint8_t* ptr = ((uint8_t*) icmp_header) + sizeof(sr_icmp_hdr_t);
-    memcpy(ptr,additional_data_buffer,additional_data_len);
-    icmp_header->icmp_sum = 0;
-    icmp_header->icmp_sum = cksum(icmp_header,sizeof(sr_icmp_hdr_t)+additional_data_len);
-    
+    memcpy(icmp_header,request,icmp_len);
+    memcpy(&old_word,icmp_header,2);
+    icmp_header->icmp_type = 0;
+    memcpy(&new_word,icmp_header,2);
+    icmp_header->icmp_sum = cksum_update16(request->icmp_sum,old_word,new_word);
   
     int is_success = sr_send_packet(sr,buf,total_len,iface->name); /* 0 is success, -1 is failure */
+    sr_pbuf_put(pbuf);
     
     return is_success;
 }
 
 /* return 1 if sent successfully, 0 if error.  */
 int send_arp_reply(struct sr_instance* sr,
-                  char* name,
+                  struct sr_if* iface,
                   uint32_t target_ip_adr,
-                  uint32_t sender_ip_adr,
-                  uint8_t  ether_dhost[ETHER_ADDR_LEN],   /* destination ethernet address */
-                  uint8_t  ether_shost[ETHER_ADDR_LEN]  /* source ethernet address */
+                  uint8_t  ether_dhost[ETHER_ADDR_LEN]   /* destination ethernet address */
 )
 {
-  /* construct ethernet frame */
-  uint32_t total_len = sizeof(sr_ethernet_hdr_t)+sizeof(sr_arp_hdr_t);
-  uint8_t* buf = (uint8_t*) malloc(total_len);
+  /* construct ethernet frame from the interface's ARP request template */
+  uint32_t total_len = SR_IF_ARP_TMPL_LEN;
+  struct sr_pbuf* pbuf = sr_pbuf_alloc(&(sr->pbufs),total_len);
+  if(pbuf==NULL){
+    return -1;
+  }
+  uint8_t* buf = pbuf->data;
+  memcpy(buf,iface->arp_tmpl,SR_IF_ARP_TMPL_LEN);
 
-  /*  set up ethernet frame header */
   sr_ethernet_hdr_t* eth_header = (sr_ethernet_hdr_t*) buf;
   memcpy(eth_header->ether_dhost,ether_dhost,ETHER_ADDR_LEN);
-  memcpy(eth_header->ether_shost,ether_shost,ETHER_ADDR_LEN);
-  eth_header->ether_type = htons(ethertype_arp);
 
-  /* set up arp header */
   sr_arp_hdr_t* arp_header = (sr_arp_hdr_t*)(buf+sizeof(sr_ethernet_hdr_t));
-  arp_header->ar_hrd = htons(arp_hrd_ethernet);
-  arp_header->ar_pro = htons(ethertype_ip);
-  arp_header->ar_hln = ETHER_ADDR_LEN;
-  arp_header->ar_pln = sizeof(uint32_t); /* 4 bytes */
   arp_header->ar_op = htons(arp_op_reply);
-  memcpy(arp_header->ar_sha,ether_shost,ETHER_ADDR_LEN);
   memcpy(arp_header->ar_tha,ether_dhost,ETHER_ADDR_LEN);
-  arp_header->ar_sip = sender_ip_adr;
   arp_header->ar_tip = target_ip_adr;
 
   
-  int is_success = sr_send_packet(sr,buf,total_len,name); /* 0 is success, -1 is failure */
-  free(buf);
+  int is_success = sr_send_packet(sr,buf,total_len,iface->name); /* 0 is success, -1 is failure */
+  sr_pbuf_put(pbuf);
   
   return is_success;
 
@@ -333,36 +399,30 @@ int send_arp_request(struct sr_instance* sr,
 {
 
   /* Gather necessary information */
+  sr_rcu_read_lock(&(sr->rcu));
   struct sr_rt* matched_rt = longest_prefix_match(sr,target_ip_adr);
-  struct sr_if* out_iface = sr_get_interface(sr,matched_rt->interface);
-  /* TODO: WHAT IF matched_rt is NULL */
-
+  struct sr_if* out_iface = matched_rt ? sr_get_interface_by_index(sr,matched_rt->ifindex) : NULL;
+  sr_rcu_read_unlock(&(sr->rcu));
+  if(out_iface==NULL){
+    return -1; /* the link went down since the packet was queued */
+  }
 
-  /* construct ethernet frame */
-  uint32_t total_len = sizeof(sr_ethernet_hdr_t)+sizeof(sr_arp_hdr_t);
-  uint8_t* buf = (uint8_t*) malloc(total_len);
 
-  /*  set up ethernet frame header */
-  sr_ethernet_hdr_t* eth_header = (sr_ethernet_hdr_t*) buf;
-  memset(eth_header->ether_dhost,255,ETHER_ADDR_LEN); /* Broadcast address, all bits set to 1 */
-  memcpy(eth_header->ether_shost,out_iface->addr,ETHER_ADDR_LEN);
-  eth_header->ether_type = htons(ethertype_arp);
+  /* construct ethernet frame: the template is a broadcast request */
+  uint32_t total_len = SR_IF_ARP_TMPL_LEN;
+  struct sr_pbuf* pbuf = sr_pbuf_alloc(&(sr->pbufs),total_len);
+  if(pbuf==NULL){
+    return -1;
+  }
+  uint8_t* buf = pbuf->data;
+  memcpy(buf,out_iface->arp_tmpl,SR_IF_ARP_TMPL_LEN);
 
-  /* set up arp header */
   sr_arp_hdr_t* arp_header = (sr_arp_hdr_t*)(buf+sizeof(sr_ethernet_hdr_t));
-  arp_header->ar_hrd = htons(arp_hrd_ethernet);
-  arp_header->ar_pro = htons(ethertype_ip);
-  arp_header->ar_hln = ETHER_ADDR_LEN;
-  arp_header->ar_pln = sizeof(uint32_t); /* 4 bytes */
-  arp_header->ar_op = htons(arp_op_request);
-  memcpy(arp_header->ar_sha,out_iface->addr,ETHER_ADDR_LEN);
-  memset(arp_header->ar_tha,0,ETHER_ADDR_LEN); /* target hardware address leave it 00:00:00:00:00:00 */
-  arp_header->ar_sip = out_iface->ip;
   arp_header->ar_tip = target_ip_adr;
 
   
   int is_success = sr_send_packet(sr,buf,total_len,out_iface->name); /* 0 is success, -1 is failure */
-  free(buf);
+  sr_pbuf_put(pbuf);
   
   return is_success;
 }
@@ -381,220 +441,445 @@ int compare_two_name(char* a, char* b,int len){
   return 1;
 }
 
-/*---------------------------------------------------------------------
- * Method: sr_handlepacket(uint8_t* p,char* interface)
- * Scope:  Global
- *
- * This method is called each time the router receives a packet on the
- * interface.  The packet buffer, the packet length and the receiving
- * interface are passed in as parameters. The packet is complete with
- * ethernet headers.
- *
- * Note: Both the packet buffer and the character's memory are handled
- * by sr_vns_comm.c that means do NOT delete either.  Make a copy of the
- * packet instead if you intend to keep it around beyond the scope of
- * the method call.
- *
- *---------------------------------------------------------------------*/
+/* Decrement the TTL and patch the header checksum to match (RFC 1624)
+   instead of recomputing it over the whole header */
+static void sr_ip_decrement_ttl(sr_ip_hdr_t* ip_header){
+  uint16_t old_word, new_word;
 
-void sr_handlepacket(struct sr_instance* sr,
-        uint8_t * packet/* lent */,
-        unsigned int len,
-        char* interface/* lent */)
+  /* TTL is the high byte of the 16 bit word it shares with the protocol */
+  memcpy(&old_word,&ip_header->ip_ttl,2);
+  ip_header->ip_ttl--;
+  memcpy(&new_word,&ip_header->ip_ttl,2);
+  ip_header->ip_sum = cksum_update16(ip_header->ip_sum,old_word,new_word);
+}
+
+/* return 1 if the frame is for the router at the link layer: sent to a
+   group address or to the MAC of one of its interfaces */
+static int sr_frame_is_ours(struct sr_instance* sr, sr_ethernet_hdr_t* eth_header){
+  return (eth_header->ether_dhost[0] & 1) ||
+         sr_get_interface_by_addr(sr,eth_header->ether_dhost)!=NULL;
+}
+
+/* return 1 if the datagram is UDP to the RIP port */
+static int sr_is_rip(sr_ip_hdr_t* ip_header, unsigned int ip_len){
+  sr_udp_hdr_t* udp_header;
+
+  if(ip_header->ip_p!=ip_protocol_udp || ip_len<ip_header->ip_hl*4+sizeof(sr_udp_hdr_t)){
+    return 0;
+  }
+  udp_header = (sr_udp_hdr_t*) ((uint8_t*)ip_header+ip_header->ip_hl*4);
+  return udp_header->port_dst==htons(SR_RIP_PORT);
+}
+
+/* Per-packet processing. Runs inside an RCU read-side critical section,
+   see sr_handlepacket(). The frame is modified in place; anything that
+   keeps it takes its own reference */
+static void sr_process_packet(struct sr_instance* sr,
+        struct sr_pbuf * pbuf/* lent */,
+        unsigned int ifindex)
 {
   /* REQUIRES */
   assert(sr);
-  assert(packet);
-  assert(interface);
+  assert(pbuf);
+
+  uint8_t* packet = pbuf->data;
+  unsigned int len = pbuf->len;
+  struct sr_if* iface = sr_get_interface_by_index(sr,ifindex); /* incoming interface */
 
   printf("*** -> Received packet of length %d \n",len);
 
   /* sanity check the package */
-  if(!validate_packet(packet,len)){
+  if(iface==NULL || !validate_packet(packet,len)){
     return;
   }
 
   sr_ethernet_hdr_t *eth_header = (sr_ethernet_hdr_t*) packet;
+  if(!sr_frame_is_ours(sr,eth_header)){
+    return;
+  }
+
   if(eth_header->ether_type == htons(ethertype_ip)){
     /* IP packet */
     sr_ip_hdr_t * ip_header = (sr_ip_hdr_t*) (packet+sizeof(sr_ethernet_hdr_t));
-    struct sr_if* if_iter;
+    int dst_class = sr_if_classify(sr,ip_header->ip_dst,NULL);
 
-    int is_own = 0; /* bool flag for if destinatino IP is router's own interface */
-    for(if_iter = sr->if_list;if_iter!=NULL;if_iter = if_iter->next){
-      if(if_iter->ip==ip_header->ip_dst){
-        is_own = 1;
-        /* sent to one of router's own interfaces */
-        /* find incoming interface */
-        struct sr_if* iface;
-        for(if_iter = sr->if_list;if_iter!=NULL;if_iter = if_iter->next){
-          if(compare_two_name((char*)if_iter->addr,(char*)eth_header->ether_dhost,ETHER_ADDR_LEN)){
-            iface = if_iter;
-            break;
-          }
-        }
-        if(ip_header->ip_p==ip_protocol_icmp){
-          /* ICMP packet */
-          sr_icmp_hdr_t * icmp_header = (sr_icmp_hdr_t*) (packet+sizeof(sr_ethernet_hdr_t)+sizeof(sr_ip_hdr_t));
-          if(icmp_header->icmp_type==8){
-            /* ICMP echo request, need to process explicitly */
-            /* checksum is valid as validated before */
-
-            
-            /* send an ICMP echo reply to the sending hosts */
-            send_icmp_echo_reply(
-              sr,
-              iface,
-              ip_header->ip_id,
-              ((uint8_t*) icmp_header) + 4,
-              len - sizeof(sr_ip_hdr_t)-sizeof(sr_icmp_hdr_t)-sizeof(sr_ethernet_hdr_t),
-              ip_header->ip_src,
-              ip_header->ip_dst,
-              eth_header->ether_shost,
-              eth_header->ether_dhost
-            );
-            
-          }
-        }else{
-          /* Not an ICMP packet */
-          send_icmp_error_message(
-              sr,
-              if_iter->name,
-              ip_header->ip_id,
-              (uint8_t*)ip_header,
-              ip_header->ip_src,
-              iface->ip,
-              eth_header->ether_shost,
-              iface->addr,
-              ICMP_PORT_UNREACHABLE
-            );
-
-        }
-        break;
-      }
+    if(sr->rip.enabled && (dst_class==SR_DST_LOCAL || dst_class==SR_DST_BROADCAST) &&
+       sr_is_rip(ip_header,len-sizeof(sr_ethernet_hdr_t))){
+      /* RIP, to us or to the RIP group */
+      sr_rip_input(sr,packet,len,ifindex);
+      return;
+    }
+    if(dst_class==SR_DST_BROADCAST){
+      /* never forwarded, and never answered with an ICMP error (RFC 1812) */
+      return;
     }
+    if(dst_class==SR_DST_LOCAL){
+      /* sent to one of router's own interfaces */
+      if(ip_header->ip_p==ip_protocol_icmp){
+        /* ICMP packet */
+        sr_icmp_hdr_t * icmp_header = (sr_icmp_hdr_t*) (packet+sizeof(sr_ethernet_hdr_t)+sizeof(sr_ip_hdr_t));
+        if(icmp_header->icmp_type==8){
+          /* ICMP echo request, need to process explicitly */
+          /* checksum is valid as validated before */
 
-    if(!is_own){
-      /* Forwarding logic */
-      /* find incoming interface */
-        struct sr_if* iface;
-        for(if_iter = sr->if_list;if_iter!=NULL;if_iter = if_iter->next){
-          if(compare_two_name((char*)if_iter->addr,(char*)eth_header->ether_dhost,ETHER_ADDR_LEN)){
-            iface = if_iter;
-            break;
-          }
+          
+          /* send an ICMP echo reply to the sending hosts */
+          send_icmp_echo_reply(
+            sr,
+            iface,
+            ip_header->ip_id,
+            icmp_header,
+            len - sizeof(sr_ip_hdr_t)-sizeof(sr_ethernet_hdr_t),
+            ip_header->ip_src,
+            ip_header->ip_dst,
+            eth_header->ether_shost
+          );
+          
         }
-      if(ip_header->ip_ttl==1){
-        /* TTL ==1, send time exceeded back to sender */
-        send_icmp_error_message(
-          sr,
-          if_iter->name,
-          ip_header->ip_id,
-          (uint8_t*)ip_header,
-          ip_header->ip_src,
-          iface->ip,
-          eth_header->ether_shost,
-          iface->addr,
-          ICMP_TIME_EXCEEDED
-        );
       }else{
-        struct sr_rt* matched_rt = longest_prefix_match(sr,ip_header->ip_dst);
-        if(matched_rt==NULL){
-          /*TODO: send ICMP net unreachable */
-          matched_rt = longest_prefix_match(sr,ip_header->ip_src);
-          send_icmp_error_message(
+        /* Not an ICMP packet */
+        send_icmp_error_message(
             sr,
-            matched_rt->interface,
+            iface->name,
             ip_header->ip_id,
             (uint8_t*)ip_header,
             ip_header->ip_src,
-            iface->ip,
+            iface,
             eth_header->ether_shost,
-            iface->addr,
-            ICMP_DESTINATION_NET_UNREACHABLE
+            ICMP_PORT_UNREACHABLE
           );
-          return;
-        }
-        /* Need to forward package */
-        ip_header->ip_ttl--;
-        ip_header->ip_sum = 0;
-        ip_header->ip_sum = cksum(ip_header,sizeof(sr_ip_hdr_t));
-        
-        struct sr_arpentry* cached_arp_entry=NULL;
-	      cached_arp_entry = sr_arpcache_lookup(&sr->cache, ip_header->ip_dst);
-
-        /* Copy the source MAC first to packet */
-        memcpy(eth_header->ether_shost, sr_get_interface(sr,matched_rt->interface)->addr, ETHER_ADDR_LEN);
-
-        if(cached_arp_entry!=NULL){
-          /* Can Send immediately*/
-          
-		      memcpy(eth_header->ether_dhost, cached_arp_entry->mac, ETHER_ADDR_LEN);
-
-          int is_success = sr_send_packet(sr,packet,len,matched_rt->interface);
-          fprintf(stderr, "forwarded packet\n");
-          free(cached_arp_entry);
-          return;
-        }else{
-          /* Cache Miss*/
-          fprintf(stderr, "cache miss\n");
-          struct sr_arpreq *req;
-          req = sr_arpcache_queuereq(&sr->cache, ip_header->ip_dst, packet, len, matched_rt->interface);
-          handle_arpreq(sr,req);         
-          return;
-        }
+
       }
+      return;
+    }
 
+    /* Forwarding logic */
+    if(ip_header->ip_ttl==1){
+      /* TTL ==1, send time exceeded back to sender */
+      send_icmp_error_message(
+        sr,
+        iface->name,
+        ip_header->ip_id,
+        (uint8_t*)ip_header,
+        ip_header->ip_src,
+        iface,
+        eth_header->ether_shost,
+        ICMP_TIME_EXCEEDED
+      );
+      return;
     }
 
-  
+    struct sr_rt* matched_rt = longest_prefix_match(sr,ip_header->ip_dst);
+    struct sr_if* out_iface = matched_rt ? sr_get_interface_by_index(sr,matched_rt->ifindex) : NULL;
+    if(out_iface==NULL){
+      /* no route: tell the sender, on the link it came from */
+      send_icmp_error_message(
+        sr,
+        iface->name,
+        ip_header->ip_id,
+        (uint8_t*)ip_header,
+        ip_header->ip_src,
+        iface,
+        eth_header->ether_shost,
+        ICMP_DESTINATION_NET_UNREACHABLE
+      );
+      return;
+    }
+    /* Need to forward package, to the gateway if the route has one */
+    uint32_t next_hop = matched_rt->gw.s_addr ? matched_rt->gw.s_addr : ip_header->ip_dst;
+    sr_ip_decrement_ttl(ip_header);
+    
+    /* Copy the source MAC first to packet */
+    memcpy(eth_header->ether_shost, out_iface->addr, ETHER_ADDR_LEN);
+
+    /* On a hit the next hop MAC is written straight into the frame */
+    if(sr_arpcache_lookup(&sr->cache, next_hop, eth_header->ether_dhost)){
+      /* Can Send immediately*/
+      sr_send_packet(sr,packet,len,out_iface->name);
+      fprintf(stderr, "forwarded packet\n");
+    }else{
+      /* Cache Miss*/
+      fprintf(stderr, "cache miss\n");
+      sr_arpcache_queue_send(sr, next_hop, pbuf, out_iface->ifindex);
+    }
 
   }else if(eth_header->ether_type == htons(ethertype_arp)){
     /* got an ARP message*/
     sr_arp_hdr_t* arp_header = (sr_arp_hdr_t*) (packet+sizeof(sr_ethernet_hdr_t));
     
-    struct sr_if* if_iter;
-    for(if_iter = sr->if_list;if_iter!=NULL;if_iter = if_iter->next){
-      if(if_iter->ip==arp_header->ar_tip){ /* Only process if this is destined towards one of router interface's address */
-        if(arp_header->ar_op==htons(arp_op_request)){
-          /* receive ARP request */
-          send_arp_reply(sr,
-                         if_iter->name,
-                         arp_header->ar_sip,
-                         arp_header->ar_tip,
-                         arp_header->ar_sha,
-                         if_iter->addr);/* send ARP reply to sender */
-        fprintf(stderr,"client MAC from arp request:");
-        print_addr_eth(arp_header->ar_sha);
-
-        }else{
-          /* receive ARP reply*/
-          fprintf(stderr, "Received ARP reply\n");
-          struct sr_arpreq *req;
-          req = sr_arpcache_insert(&sr->cache, arp_header->ar_sha, arp_header->ar_sip);
-
-          /* If pending requests, send all packets  */
-          if(req){
-            fprintf(stderr, "Pending Requests\n");
-            /* Send all packets on pending lists */
-            struct sr_packet *packets_iter;
-            packets_iter = req->packets;
-            while(packets_iter!=NULL){
-              /* Loop through the linked list */
-              sr_ethernet_hdr_t* pac_eth_header = (sr_ethernet_hdr_t*) packets_iter->buf;
-              memcpy(pac_eth_header->ether_dhost, arp_header->ar_sha, ETHER_ADDR_LEN); /* Use the newly received MAC address */
-              int is_success = sr_send_packet(sr,packets_iter->buf,packets_iter->len,packets_iter->iface);
-              packets_iter = packets_iter->next;
-            }
-            sr_arpreq_destroy(&(sr->cache), req);
+    /* Only process if this is destined towards one of router interface's address */
+    struct sr_if* target;
+    if(sr_if_classify(sr,arp_header->ar_tip,&target)!=SR_DST_LOCAL){
+      return;
+    }
+    if(arp_header->ar_op==htons(arp_op_request)){
+      /* receive ARP request */
+      send_arp_reply(sr,
+                     target,
+                     arp_header->ar_sip,
+                     arp_header->ar_sha);/* send ARP reply to sender */
+      fprintf(stderr,"client MAC from arp request:");
+      print_addr_eth(arp_header->ar_sha);
+
+    }else{
+      /* receive ARP reply*/
+      fprintf(stderr, "Received ARP reply\n");
+      struct sr_arpreq *req;
+      req = sr_arpcache_insert(&sr->cache, arp_header->ar_sha, arp_header->ar_sip);
+
+      /* If pending requests, send all packets  */
+      if(req){
+        fprintf(stderr, "Pending Requests\n");
+        /* Send all packets on pending lists */
+        struct sr_packet *packets_iter;
+        packets_iter = req->packets;
+        while(packets_iter!=NULL){
+          /* Loop through the linked list */
+          sr_ethernet_hdr_t* pac_eth_header = (sr_ethernet_hdr_t*) packets_iter->buf;
+          struct sr_if* out_iface = sr_get_interface_by_index(sr,packets_iter->ifindex);
+          memcpy(pac_eth_header->ether_dhost, arp_header->ar_sha, ETHER_ADDR_LEN); /* Use the newly received MAC address */
+          if(out_iface){
+            sr_send_packet(sr,packets_iter->buf,packets_iter->len,out_iface->name);
           }
+          packets_iter = packets_iter->next;
         }
-
+        sr_arpreq_destroy(&(sr->cache), req);
       }
-
     }
 
   }
   
 
 }/* end sr_ForwardPacket */
+
+/* One distinct destination of a burst: resolved once, shared by every
+   packet of the burst that goes there */
+struct sr_burst_dest {
+  uint32_t ip;
+  uint32_t next_hop; /* the route's gateway, or ip */
+  struct sr_rt* rt;
+  struct sr_if* out_iface;
+  int have_mac;
+  unsigned char mac[ETHER_ADDR_LEN];
+};
+
+/* return 1 if the packet is IP, to be forwarded (see sr_if_classify()) and
+   still has TTL to spare, i.e. it can take the fast path of sr_handlepacket_burst() */
+static int sr_burst_is_transit(struct sr_instance* sr, uint8_t* packet, unsigned int len){
+  sr_ip_hdr_t* ip_header;
+
+  if(ethertype(packet)!=ethertype_ip || !sr_frame_is_ours(sr,(sr_ethernet_hdr_t*)packet)){
+    return 0;
+  }
+  ip_header = (sr_ip_hdr_t*) (packet+sizeof(sr_ethernet_hdr_t));
+  if(ip_header->ip_ttl<=1){
+    return 0;
+  }
+  switch(sr_if_classify(sr,ip_header->ip_dst,NULL)){
+    case SR_DST_FORWARD:
+    case SR_DST_CONNECTED:
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_handlepacket(uint8_t* p,unsigned int ifindex)
+ * Scope:  Global
+ *
+ * This method is called each time the router receives a packet on the
+ * interface.  The packet buffer, the packet length and the ifindex of
+ * the receiving interface are passed in as parameters. The packet is
+ * complete with ethernet headers.
+ *
+ * Note: The packet buffer is handled by the transport (sr_vns_comm.c,
+ * sr_afpacket.c, ...) that means do NOT delete it.  Make a copy of the
+ * packet instead if you intend to keep it around beyond the scope of
+ * the method call.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_handlepacket(struct sr_instance* sr,
+        uint8_t * packet/* lent */,
+        unsigned int len,
+        unsigned int ifindex)
+{
+  struct sr_pbuf pbuf;
+
+  /* REQUIRES */
+  assert(sr);
+
+  /* The frame is only lent: whatever keeps it copies it once, on hold */
+  sr_pbuf_wrap(&pbuf,&(sr->pbufs),packet,len);
+  sr_receive_pbuf(sr,&pbuf,ifindex);
+}/* end sr_handlepacket */
+
+/*---------------------------------------------------------------------
+ * Method: sr_receive_pbuf(struct sr_pbuf* p,unsigned int ifindex)
+ * Scope:  Global
+ *
+ * Like sr_handlepacket() for a transport that lends the router a pbuf
+ * of its own (sr_xdp.c hands over its UMEM frames this way).  The
+ * caller keeps its reference; workers and the ARP queue take their own.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_receive_pbuf(struct sr_instance* sr,
+        struct sr_pbuf * pbuf/* lent */,
+        unsigned int ifindex)
+{
+  /* Hand the packet to the worker owning its flow, if there are workers */
+  if(sr->fwd){
+    sr_fwd_dispatch(sr->fwd,pbuf,ifindex);
+    return;
+  }
+  sr_handlepacket_pbuf(sr,pbuf,ifindex);
+}/* end sr_receive_pbuf */
+
+/*---------------------------------------------------------------------
+ * Method: sr_handlepacket_burst(..)
+ * Scope:  Global
+ *
+ * Process n packets in one go, with the same result as calling
+ * sr_handlepacket_pbuf() on each of them; packets to the same
+ * destination keep their relative order. Transit packets are
+ * grouped by destination: the route, outgoing interface and ARP entry
+ * are looked up once per destination, and the packets leaving through
+ * the same interface are handed to sr_send_packet_burst() together.
+ * Everything else (local delivery, ARP, expired TTL, no route) takes
+ * the regular per-packet path.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_handlepacket_burst(struct sr_instance* sr,
+        struct sr_pbuf** pbufs/* lent */,
+        const unsigned int* ifindexes,
+        unsigned int n)
+{
+  struct sr_burst_dest dests[SR_BURST_MAX];
+  int dest_of[SR_BURST_MAX];
+  uint8_t* packets[SR_BURST_MAX];
+  unsigned int lens[SR_BURST_MAX];
+  uint8_t* tx_bufs[SR_BURST_MAX];
+  unsigned int tx_lens[SR_BURST_MAX];
+  unsigned int ndests = 0;
+  unsigned int i, j, ntx;
+
+  /* REQUIRES */
+  assert(sr);
+
+  if(n>SR_BURST_MAX){
+    sr_handlepacket_burst(sr,pbufs,ifindexes,SR_BURST_MAX);
+    sr_handlepacket_burst(sr,pbufs+SR_BURST_MAX,ifindexes+SR_BURST_MAX,n-SR_BURST_MAX);
+    return;
+  }
+  for(i=0;i<n;i++){
+    packets[i] = pbufs[i]->data;
+    lens[i] = pbufs[i]->len;
+  }
+
+  sr_rcu_read_lock(&(sr->rcu));
+
+  /* Stage 1: validate and find each transit packet's destination group */
+  for(i=0;i<n;i++){
+    uint32_t ip_dst;
+
+    dest_of[i] = -1;
+    if(!validate_packet(packets[i],lens[i]) || !sr_burst_is_transit(sr,packets[i],lens[i])){
+      continue;
+    }
+    ip_dst = ((sr_ip_hdr_t*) (packets[i]+sizeof(sr_ethernet_hdr_t)))->ip_dst;
+    for(j=0;j<ndests;j++){
+      if(dests[j].ip==ip_dst){
+        break;
+      }
+    }
+    if(j==ndests){
+      dests[j].ip = ip_dst;
+      dests[j].rt = NULL;
+      ndests++;
+    }
+    dest_of[i] = j;
+  }
+
+  /* Stage 2: one route, interface and ARP lookup per destination */
+  for(j=0;j<ndests;j++){
+    dests[j].rt = longest_prefix_match(sr,dests[j].ip);
+    dests[j].out_iface = dests[j].rt ? sr_get_interface_by_index(sr,dests[j].rt->ifindex) : NULL;
+    dests[j].have_mac = 0;
+    if(dests[j].out_iface==NULL){
+      continue;
+    }
+    dests[j].next_hop = dests[j].rt->gw.s_addr ? dests[j].rt->gw.s_addr : dests[j].ip;
+    dests[j].have_mac = sr_arpcache_lookup(&sr->cache, dests[j].next_hop, dests[j].mac);
+  }
+
+  /* Stage 3: rewrite headers; resolved packets wait in tx_bufs, the rest
+     go through the regular path in arrival order */
+  for(i=0;i<n;i++){
+    struct sr_burst_dest* dest;
+    sr_ethernet_hdr_t* eth_header;
+    sr_ip_hdr_t* ip_header;
+
+    if(dest_of[i]<0 || dests[dest_of[i]].out_iface==NULL){
+      sr_process_packet(sr,pbufs[i],ifindexes[i]);
+      continue;
+    }
+    dest = &dests[dest_of[i]];
+    eth_header = (sr_ethernet_hdr_t*) packets[i];
+    ip_header = (sr_ip_hdr_t*) (packets[i]+sizeof(sr_ethernet_hdr_t));
+
+    sr_ip_decrement_ttl(ip_header);
+    memcpy(eth_header->ether_shost, dest->out_iface->addr, ETHER_ADDR_LEN);
+
+    if(!dest->have_mac){
+      sr_arpcache_queue_send(sr, dest->next_hop, pbufs[i], dest->out_iface->ifindex);
+      dest_of[i] = -1;
+      continue;
+    }
+    memcpy(eth_header->ether_dhost, dest->mac, ETHER_ADDR_LEN);
+  }
+
+  /* Stage 4: one transmit call per outgoing interface */
+  for(i=0;i<n;i++){
+    struct sr_if* out_iface;
+
+    if(dest_of[i]<0 || !dests[dest_of[i]].have_mac){
+      continue;
+    }
+    out_iface = dests[dest_of[i]].out_iface;
+    ntx = 0;
+    for(j=i;j<n;j++){
+      if(dest_of[j]>=0 && dests[dest_of[j]].have_mac && dests[dest_of[j]].out_iface==out_iface){
+        tx_bufs[ntx] = packets[j];
+        tx_lens[ntx] = lens[j];
+        ntx++;
+        dest_of[j] = -1;
+      }
+    }
+    sr_send_packet_burst(sr,tx_bufs,tx_lens,ntx,out_iface->name);
+  }
+
+  sr_rcu_read_unlock(&(sr->rcu));
+}/* end sr_handlepacket_burst */
+
+/*---------------------------------------------------------------------
+ * Method: sr_handlepacket_pbuf(struct sr_pbuf* p,unsigned int ifindex)
+ * Scope:  Global
+ *
+ * Process a packet buffer on the calling thread. Used by sr_receive_pbuf()
+ * when forwarding inline and by the forwarding workers (see sr_fwd.h).
+ * The caller keeps its reference to pbuf.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_handlepacket_pbuf(struct sr_instance* sr,
+        struct sr_pbuf * pbuf/* lent */,
+        unsigned int ifindex)
+{
+  /* Routes returned by longest_prefix_match() stay valid until unlock */
+  sr_rcu_read_lock(&(sr->rcu));
+  sr_process_packet(sr,pbuf,ifindex);
+  sr_rcu_read_unlock(&(sr->rcu));
+}/* end sr_handlepacket_pbuf */
@@ -12,7 +12,15 @@
 #include <stdio.h>
 
 #include "sr_protocol.h"
+#include "sr_if.h"
+#include "sr_rt.h"
 #include "sr_arpcache.h"
+#include "sr_pbuf.h"
+#include "sr_fib.h"
+#include "sr_rcu.h"
+#include "sr_fwd.h"
+#include "sr_ratelimit.h"
+#include "sr_transport.h"
 
 /* we dont like this debug , but what to do for varargs ? */
 #ifdef _DEBUG_
@@ -26,12 +34,56 @@
 #endif
 
 #define INIT_TTL 255
+#define SR_BURST_MAX 32  /* packets handled per sr_handlepacket_burst() pass */
 #define PACKET_DUMP_SIZE 1024
 
+#define SR_TXQ_BYTES      65536 /* VNS messages coalesced into one write */
+#define SR_TXQ_LATENCY_MS 1     /* longest a queued frame waits for company */
+
+#define SR_RX_BYTES   (256 * 1024) /* receive buffer for messages from the server */
+#define SR_RX_MSG_MAX 10000        /* longest message the server sends */
+
 /* forward declare */
 struct sr_if;
 struct sr_rt;
 
+/* ----------------------------------------------------------------------------
+ * struct sr_rxbuf
+ *
+ * Bytes received from the server; [head, tail) is not handled yet.  Only
+ * the thread reading from the server touches it.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_rxbuf
+{
+    uint8_t* buf;             /* SR_RX_BYTES */
+    unsigned int head;
+    unsigned int tail;
+    unsigned long recvs;      /* recv() calls that returned data */
+    unsigned long msgs;       /* messages handled */
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_txq
+ *
+ * Frames on their way to the server.  sr_send_packet() appends a VNSPACKET
+ * message and the whole queue goes out in one write when it is full, when
+ * its oldest frame is SR_TXQ_LATENCY_MS old, or on sr_flush_packets(),
+ * which every reader of packets calls once it has handled what it read.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_txq
+{
+    uint8_t* buf;             /* messages back to back, 0 to send unqueued */
+    unsigned int len;
+    unsigned int nframes;
+    uint64_t first_ms;        /* when the oldest queued frame was queued */
+    unsigned long frames;     /* frames sent */
+    unsigned long writes;     /* system calls that sent them */
+};
+
 /* ----------------------------------------------------------------------------
  * struct sr_instance
  *
@@ -42,45 +94,74 @@ struct sr_rt;
 struct sr_instance
 {
     int  sockfd;   /* socket to server */
+    const struct sr_transport_ops* transport; /* VNS unless -b says otherwise */
+    void* transport_priv;
     char user[32]; /* user name */
     char host[32]; /* host name */ 
     char template[30]; /* template name if any */
     unsigned short topo_id;
     struct sockaddr_in sr_addr; /* address to server */
     struct sr_if* if_list; /* list of interfaces */
+    struct sr_if_table if_table; /* the same, by ifindex, name, MAC and IP */
     struct sr_rt* routing_table; /* routing table */
+    struct sr_rt_index rt_index; /* the same, by dest and mask */
+    struct sr_fib* fib; /* FIB snapshot of routing_table, RCU protected */
+    int fib_mode; /* SR_FIB_TRIE or SR_FIB_DIR24 */
+    unsigned int rt_batch; /* >0 while a table update defers publishing */
+    int rt_dirty; /* the table changed since the FIB was published */
+    struct sr_rip rip; /* RIP state, under rt_locker */
+    struct sr_rcu rcu; /* reclaims FIB snapshots */
     struct sr_if_status_cache * if_cache; /* interfaces' status cache*/
     pthread_mutex_t rt_lock; 
     pthread_mutexattr_t rt_lock_attr;
     pthread_mutex_t rt_locker;
     pthread_mutexattr_t rt_locker_attr;
+    struct sr_pbuf_pool pbufs;  /* packet buffers, see sr_pbuf.h */
     struct sr_arpcache cache;   /* ARP cache */
+    unsigned int arpcache_sz;   /* ARP cache capacity, 0 for the default */
     pthread_attr_t attr;
     pthread_attr_t rt_attr;
+    unsigned int nworkers; /* forwarding threads, 0 to forward inline */
+    struct sr_fwd* fwd;    /* forwarding engine, 0 when inline */
+    pthread_mutex_t send_lock; /* serializes writes to sockfd */
+    struct sr_txq txq;         /* protected by send_lock */
+    struct sr_rxbuf rx;        /* messages read from sockfd */
+    unsigned int icmp_src_rate; /* ICMP errors per second per /24, 0 for no limit */
+    unsigned int icmp_if_rate;  /* ICMP errors per second per interface */
+    struct sr_ratelimit icmp_rl;
+    int event_loop;        /* 1 to run single threaded, see sr_event.h */
     FILE* logfile;
 };
 
-/* -- sr_main.c -- */
-int sr_verify_routing_table(struct sr_instance* sr);
-
 /* -- sr_vns_comm.c -- */
 int sr_send_packet(struct sr_instance* , uint8_t* , unsigned int , const char*);
+int sr_send_packet_burst(struct sr_instance* , uint8_t** , unsigned int* , unsigned int , const char*);
+int sr_flush_packets(struct sr_instance* );
 int sr_connect_to_server(struct sr_instance* ,unsigned short , char* );
 int sr_read_from_server(struct sr_instance* );
 
 /* -- sr_router.c -- */
+void sr_init_instance(struct sr_instance* );
 void sr_init(struct sr_instance* );
-void sr_handlepacket(struct sr_instance* , uint8_t * , unsigned int , char* );
+void sr_handlepacket(struct sr_instance* , uint8_t * , unsigned int , unsigned int );
+void sr_receive_pbuf(struct sr_instance* , struct sr_pbuf* , unsigned int );
+void sr_handlepacket_pbuf(struct sr_instance* , struct sr_pbuf* , unsigned int );
+void sr_handlepacket_burst(struct sr_instance* , struct sr_pbuf** , const unsigned int* , unsigned int );
+struct sr_rt* longest_prefix_match(struct sr_instance* sr, uint32_t ip_adr);
 int send_arp_request(struct sr_instance* sr, uint32_t target_ip_adr);
+int send_arp_reply(struct sr_instance* sr, struct sr_if* iface,
+                   uint32_t target_ip_adr, uint8_t ether_dhost[ETHER_ADDR_LEN]);
+int send_icmp_echo_reply(struct sr_instance* sr, struct sr_if* iface, uint16_t ip_id,
+                         sr_icmp_hdr_t* request, uint32_t icmp_len, uint32_t dest_ip_adr,
+                         uint32_t src_ip_adr, uint8_t ether_dhost[ETHER_ADDR_LEN]);
 int compare_two_name(char* a, char* b,int len);
 int send_icmp_error_message(struct sr_instance* sr,
                             char* interface_name,
                             uint16_t ip_id,
                             uint8_t* payload_from_error_datagram_buffer, /* first 28 bytes */
                             uint32_t dest_ip_adr,
-                            uint32_t src_ip_adr,
+                            struct sr_if* src_iface, /* source MAC and IP */
                             uint8_t  ether_dhost[ETHER_ADDR_LEN],   /* destination ethernet address */
-                            uint8_t  ether_shost[ETHER_ADDR_LEN],  /* source ethernet address */
                             int icmp_error_msg_type /* ICMP Error Message Type, defined in sr_router.h */
 );
 void handle_arpreq(struct sr_instance *sr, struct sr_arpreq* req);
@@ -21,13 +21,107 @@
 #include "sr_if.h"
 #include "sr_utils.h"
 #include "sr_router.h"
+#include "sr_cksum.h"
+
+static struct sr_rt* sr_rt_append(struct sr_instance*, struct in_addr, struct in_addr,
+                                  struct in_addr, uint32_t, const char*);
+static struct sr_rt* sr_rt_find(struct sr_instance*, uint32_t, uint32_t);
+static void sr_rt_index_insert(struct sr_rt_index*, struct sr_rt*);
+static void sr_rt_index_remove(struct sr_rt_index*, struct sr_rt*);
+static void sr_rt_clear(struct sr_instance*);
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_publish(..)
+ * Scope:  Global
+ *
+ * Snapshot sr->routing_table into a new FIB, atomically make it the one
+ * used by the data plane and retire the previous snapshot.  Routes with
+ * metric INFINITY stay in the table but not in the FIB.  Forwarding
+ * threads never block on this; they keep using the old snapshot until
+ * they leave their read-side critical section.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rt_publish(struct sr_instance* sr)
+{
+    struct sr_fib* fib;
+    struct sr_fib* old;
+
+    /* -- REQUIRES -- */
+    assert(sr);
+
+    pthread_mutex_lock(&(sr->rt_locker));
+    fib = sr_fib_create(sr->fib_mode, sr->routing_table);
+    if(fib == 0)
+    {
+        fprintf(stderr, "Error building FIB, keeping the previous one\n");
+        pthread_mutex_unlock(&(sr->rt_locker));
+        return;
+    }
+    old = sr->fib;
+    sr_rcu_assign(sr->fib, fib);
+    sr->rt_dirty = 0;
+    pthread_mutex_unlock(&(sr->rt_locker));
+
+    sr_rcu_retire(&(sr->rcu), old, (void (*)(void*))sr_fib_destroy);
+} /* -- sr_rt_publish -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_bind_interfaces(..)
+ * Scope:  Global
+ *
+ * Resolve every route's ifindex from its interface name.  Routes get
+ * theirs when they are added; this is for a table loaded before its
+ * interfaces were known.  The next publish makes the result visible.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rt_bind_interfaces(struct sr_instance* sr)
+{
+    struct sr_rt* rt;
+    struct sr_if* iface;
+
+    pthread_mutex_lock(&(sr->rt_locker));
+    for(rt = sr->routing_table; rt; rt = rt->next)
+    {
+        iface = sr_get_interface(sr, rt->interface);
+        rt->ifindex = iface ? iface->ifindex : SR_IF_NONE;
+    }
+    sr->rt_dirty = 1;
+    pthread_mutex_unlock(&(sr->rt_locker));
+} /* -- sr_rt_bind_interfaces -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_batch_begin(..) / sr_rt_batch_end(..)
+ * Scope:  Global
+ *
+ * Group several routing table changes into a single FIB publish, made
+ * only if one of them set rt_dirty.  The table lock is held for the
+ * whole batch.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rt_batch_begin(struct sr_instance* sr)
+{
+    pthread_mutex_lock(&(sr->rt_locker));
+    sr->rt_batch++;
+}
+
+void sr_rt_batch_end(struct sr_instance* sr)
+{
+    assert(sr->rt_batch > 0);
+
+    if(--sr->rt_batch == 0 && sr->rt_dirty)
+    { sr_rt_publish(sr); }
+    pthread_mutex_unlock(&(sr->rt_locker));
+}
 
 /*---------------------------------------------------------------------
  * Method:
  *
  *---------------------------------------------------------------------*/
 
-int sr_load_rt(struct sr_instance* sr,const char* filename)
+static int sr_load_rt_entries(struct sr_instance* sr,const char* filename)
 {
     FILE* fp;
     char  line[BUFSIZ];
@@ -76,15 +170,77 @@ int sr_load_rt(struct sr_instance* sr,const char* filename)
         }
         if( clear_routing_table == 0 ){
             printf("Loading routing table from server, clear local routing table.\n");
-            sr->routing_table = 0;
+            sr_rt_clear(sr);
             clear_routing_table = 1;
         }
         sr_add_rt_entry(sr,dest_addr,gw_addr,mask_addr,(uint32_t)0,iface);
     } /* -- while -- */
 
     return 0; /* -- success -- */
+} /* -- sr_load_rt_entries -- */
+
+int sr_load_rt(struct sr_instance* sr,const char* filename)
+{
+    int ret;
+
+    sr_rt_batch_begin(sr);
+    ret = sr_load_rt_entries(sr, filename);
+    sr_rt_batch_end(sr);
+
+    return ret;
 } /* -- sr_load_rt -- */
 
+/*-----------------------------------------------------------------------------
+ * Method: sr_verify_routing_table()
+ * Scope: Global
+ *
+ * make sure the routing table is consistent with the interface list by
+ * verifying that all interfaces used in the routing table actually exist
+ * in the hardware.
+ *
+ * RETURN VALUES:
+ *
+ *  0 on success
+ *  something other than zero on error
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_verify_routing_table(struct sr_instance* sr)
+{
+    struct sr_rt* rt_walker = 0;
+    struct sr_if* if_walker = 0;
+    int ret = 0;
+
+    /* -- REQUIRES --*/
+    assert(sr);
+
+    if( (sr->if_list == 0) || (sr->routing_table == 0))
+    {
+        return 999; /* doh! */
+    }
+
+    rt_walker = sr->routing_table;
+
+    while(rt_walker)
+    {
+        /* -- check to see if interface exists -- */
+        if_walker = sr->if_list;
+        while(if_walker)
+        {
+            if( strncmp(if_walker->name,rt_walker->interface,sr_IFACE_NAMELEN)
+                    == 0)
+            { break; }
+            if_walker = if_walker->next;
+        }
+        if(if_walker == 0)
+        { ret++; } /* -- interface not found! -- */
+
+        rt_walker = rt_walker->next;
+    } /* -- while -- */
+
+    return ret;
+} /* -- sr_verify_routing_table -- */
+
 /*---------------------------------------------------------------------
  * Method:
  *
@@ -96,68 +252,185 @@ int sr_build_rt(struct sr_instance* sr){
     struct in_addr gw_addr;
     struct in_addr mask_addr;
 
+    sr_rt_batch_begin(sr);
     while (interface){
         dest_addr.s_addr = (interface->ip & interface->mask);
         gw_addr.s_addr = 0;
         mask_addr.s_addr = interface->mask;
         strcpy(iface, interface->name);
-        sr_add_rt_entry(sr, dest_addr, gw_addr, mask_addr, (uint32_t)0, iface);
+        /* -- a table from file may already have it -- */
+        if(sr_rt_find(sr, dest_addr.s_addr, mask_addr.s_addr) == 0)
+        { sr_add_rt_entry(sr, dest_addr, gw_addr, mask_addr, (uint32_t)0, iface); }
         interface = interface->next;
     }
+    sr_rt_batch_end(sr);
     return 0;
 }
 
 void sr_add_rt_entry(struct sr_instance* sr, struct in_addr dest,
 struct in_addr gw, struct in_addr mask, uint32_t metric, char* if_name)
 {   
-    struct sr_rt* rt_walker = 0;
-
     /* -- REQUIRES -- */
     assert(if_name);
     assert(sr);
 
     pthread_mutex_lock(&(sr->rt_locker));
-    /* -- empty list special case -- */
-    if(sr->routing_table == 0)
+    sr_rt_append(sr, dest, gw, mask, metric, if_name);
+    sr->rt_dirty = 1;
+    if(sr->rt_batch == 0)
+    { sr_rt_publish(sr); }
+    pthread_mutex_unlock(&(sr->rt_locker));
+} /* -- sr_add_entry -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_append(..)
+ * Scope:  Local
+ *
+ * Add a route at the end of the table and to its index, bound to its
+ * interface if that is known, without publishing it.  The caller holds
+ * rt_locker.
+ *
+ *---------------------------------------------------------------------*/
+
+static struct sr_rt* sr_rt_append(struct sr_instance* sr, struct in_addr dest,
+        struct in_addr gw, struct in_addr mask, uint32_t metric, const char* if_name)
+{
+    struct sr_rt* rt;
+    struct sr_if* iface;
+
+    rt = (struct sr_rt*)calloc(1, sizeof(struct sr_rt));
+    assert(rt);
+    rt->dest = dest;
+    rt->gw   = gw;
+    rt->mask = mask;
+    strncpy(rt->interface, if_name, sr_IFACE_NAMELEN);
+    /* -- the data plane goes by ifindex; see sr_rt_bind_interfaces() -- */
+    iface = sr_get_interface(sr, if_name);
+    rt->ifindex = iface ? iface->ifindex : SR_IF_NONE;
+    rt->metric = metric;
+    time(&(rt->updated_time));
+
+    if(sr->rt_index.tail)
+    { sr->rt_index.tail->next = rt; }
+    else
+    { sr->routing_table = rt; }
+    sr->rt_index.tail = rt;
+    sr_rt_index_insert(&(sr->rt_index), rt);
+
+    return rt;
+} /* -- sr_rt_append -- */
+
+/* -- FNV-1a over the destination and the mask -- */
+static unsigned int sr_rt_hash(uint32_t dest, uint32_t mask, unsigned int nbuckets)
+{
+    uint32_t key[2];
+    const unsigned char* p = (const unsigned char*)key;
+    uint32_t h = 2166136261U;
+    unsigned int i;
+
+    key[0] = dest;
+    key[1] = mask;
+    for(i = 0; i < sizeof(key); i++)
     {
-        sr->routing_table = (struct sr_rt*)malloc(sizeof(struct sr_rt));
-        assert(sr->routing_table);
-        sr->routing_table->next = 0;
-        sr->routing_table->dest = dest;
-        sr->routing_table->gw   = gw;
-        sr->routing_table->mask = mask;
-        strncpy(sr->routing_table->interface,if_name,sr_IFACE_NAMELEN);
-        sr->routing_table->metric = metric;
-        time_t now;
-        time(&now);
-        sr->routing_table->updated_time = now;
+        h ^= p[i];
+        h *= 16777619U;
+    }
+    return h & (nbuckets - 1);
+}
 
-        pthread_mutex_unlock(&(sr->rt_locker));
-        return;
+/*---------------------------------------------------------------------
+ * Method: sr_rt_index_insert(..) / sr_rt_index_remove(..)
+ * Scope:  Local
+ *
+ * Keep the index in step with the list.  The bucket array doubles when
+ * there are as many routes as buckets, so chains stay short.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_rt_index_insert(struct sr_rt_index* idx, struct sr_rt* rt)
+{
+    struct sr_rt** buckets;
+    struct sr_rt* walker;
+    unsigned int nbuckets, i, h;
+
+    if(idx->nroutes >= idx->nbuckets)
+    {
+        nbuckets = idx->nbuckets ? 2 * idx->nbuckets : SR_RT_HASH_MIN;
+        buckets = (struct sr_rt**)calloc(nbuckets, sizeof(struct sr_rt*));
+        assert(buckets);
+        for(i = 0; i < idx->nbuckets; i++)
+        {
+            while((walker = idx->buckets[i]) != 0)
+            {
+                idx->buckets[i] = walker->hash_next;
+                h = sr_rt_hash(walker->dest.s_addr, walker->mask.s_addr, nbuckets);
+                walker->hash_next = buckets[h];
+                buckets[h] = walker;
+            }
+        }
+        free(idx->buckets);
+        idx->buckets = buckets;
+        idx->nbuckets = nbuckets;
     }
 
-    /* -- find the end of the list -- */
-    rt_walker = sr->routing_table;
-    while(rt_walker->next){
-      rt_walker = rt_walker->next; 
+    h = sr_rt_hash(rt->dest.s_addr, rt->mask.s_addr, idx->nbuckets);
+    rt->hash_next = idx->buckets[h];
+    idx->buckets[h] = rt;
+    idx->nroutes++;
+} /* -- sr_rt_index_insert -- */
+
+static void sr_rt_index_remove(struct sr_rt_index* idx, struct sr_rt* rt)
+{
+    struct sr_rt** link;
+
+    link = &(idx->buckets[sr_rt_hash(rt->dest.s_addr, rt->mask.s_addr, idx->nbuckets)]);
+    while(*link && *link != rt)
+    { link = &((*link)->hash_next); }
+    if(*link)
+    {
+        *link = rt->hash_next;
+        idx->nroutes--;
     }
+} /* -- sr_rt_index_remove -- */
 
-    rt_walker->next = (struct sr_rt*)malloc(sizeof(struct sr_rt));
-    assert(rt_walker->next);
-    rt_walker = rt_walker->next;
+/* -- drop every route; the FIB keeps its own copies -- */
+static void sr_rt_clear(struct sr_instance* sr)
+{
+    struct sr_rt* rt;
 
-    rt_walker->next = 0;
-    rt_walker->dest = dest;
-    rt_walker->gw   = gw;
-    rt_walker->mask = mask;
-    strncpy(rt_walker->interface,if_name,sr_IFACE_NAMELEN);
-    rt_walker->metric = metric;
-    time_t now;
-    time(&now);
-    rt_walker->updated_time = now;
-    
-     pthread_mutex_unlock(&(sr->rt_locker));
-} /* -- sr_add_entry -- */
+    while((rt = sr->routing_table) != 0)
+    {
+        sr->routing_table = rt->next;
+        free(rt);
+    }
+    free(sr->rt_index.buckets);
+    memset(&(sr->rt_index), 0, sizeof(struct sr_rt_index));
+    sr->rt_dirty = 1;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rt_find(..)
+ * Scope:  Local
+ *
+ * The route for exactly dest/mask (network byte order), or 0.  The
+ * caller holds rt_locker.
+ *
+ *---------------------------------------------------------------------*/
+
+static struct sr_rt* sr_rt_find(struct sr_instance* sr, uint32_t dest, uint32_t mask)
+{
+    struct sr_rt* rt;
+
+    if(sr->rt_index.nbuckets == 0)
+    { return 0; }
+    rt = sr->rt_index.buckets[sr_rt_hash(dest, mask, sr->rt_index.nbuckets)];
+    for(; rt; rt = rt->hash_next)
+    {
+        if(rt->dest.s_addr == dest && rt->mask.s_addr == mask)
+        { return rt; }
+    }
+    return 0;
+} /* -- sr_rt_find -- */
 
 /*---------------------------------------------------------------------
  * Method:
@@ -165,30 +438,33 @@ struct in_addr gw, struct in_addr mask, uint32_t metric, char* if_name)
  *---------------------------------------------------------------------*/
 
 void sr_print_routing_table(struct sr_instance* sr)
+{ sr_fprint_routing_table(sr, stdout); }
+
+void sr_fprint_routing_table(struct sr_instance* sr, FILE* out)
 {
     pthread_mutex_lock(&(sr->rt_locker));
     struct sr_rt* rt_walker = 0;
 
     if(sr->routing_table == 0)
     {
-        printf(" *warning* Routing table empty \n");
+        fprintf(out, " *warning* Routing table empty \n");
         pthread_mutex_unlock(&(sr->rt_locker));
         return;
     }
-    printf("  <---------- Router Table ---------->\n");
-    printf("Destination\tGateway\t\tMask\t\tIface\tMetric\tUpdate_Time\n");
+    fprintf(out, "  <---------- Router Table ---------->\n");
+    fprintf(out, "Destination\tGateway\t\tMask\t\tIface\tMetric\tUpdate_Time\n");
 
     rt_walker = sr->routing_table;
     
     while(rt_walker){
         if (rt_walker->metric < INFINITY)
-            sr_print_routing_entry(rt_walker);
+            sr_fprint_routing_entry(rt_walker, out);
         rt_walker = rt_walker->next;
     }
     pthread_mutex_unlock(&(sr->rt_locker));
 
 
-} /* -- sr_print_routing_table -- */
+} /* -- sr_fprint_routing_table -- */
 
 /*---------------------------------------------------------------------
  * Method:
@@ -196,6 +472,9 @@ void sr_print_routing_table(struct sr_instance* sr)
  *---------------------------------------------------------------------*/
 
 void sr_print_routing_entry(struct sr_rt* entry)
+{ sr_fprint_routing_entry(entry, stdout); }
+
+void sr_fprint_routing_entry(struct sr_rt* entry, FILE* out)
 {
     /* -- REQUIRES --*/
     assert(entry);
@@ -204,37 +483,655 @@ void sr_print_routing_entry(struct sr_rt* entry)
     char buff[20];
     struct tm* timenow = localtime(&(entry->updated_time));
     strftime(buff, sizeof(buff), "%H:%M:%S", timenow);
-    printf("%s\t",inet_ntoa(entry->dest));
-    printf("%s\t",inet_ntoa(entry->gw));
-    printf("%s\t",inet_ntoa(entry->mask));
-    printf("%s\t",entry->interface);
-    printf("%d\t",entry->metric);
-    printf("%s\n", buff);
+    fprintf(out, "%s\t",inet_ntoa(entry->dest));
+    fprintf(out, "%s\t",inet_ntoa(entry->gw));
+    fprintf(out, "%s\t",inet_ntoa(entry->mask));
+    fprintf(out, "%s\t",entry->interface);
+    fprintf(out, "%d\t",entry->metric);
+    fprintf(out, "%s\n", buff);
 
-} /* -- sr_print_routing_entry -- */
+} /* -- sr_fprint_routing_entry -- */
 
 
-void *sr_rip_timeout(void *sr_ptr) {
-    struct sr_instance *sr = sr_ptr;
-    while (1) {
-        sleep(5);
-        pthread_mutex_lock(&(sr->rt_locker));
-        pthread_mutex_unlock(&(sr->rt_locker));
+/*---------------------------------------------------------------------
+ * RIPv2 (RFC 2453)
+ *
+ * Everything below runs with rt_locker held.  A response only touches
+ * the entries it changes and marks the table dirty when a change is
+ * visible to the data plane (a route appears, moves or becomes
+ * unreachable), not for the refreshes that make up most periodic
+ * updates.  The FIB is rebuilt by the next sr_rip_tick(), so however
+ * many responses a flap takes, it is published at most once a tick and
+ * never on the packet path.
+ *
+ *---------------------------------------------------------------------*/
+
+#define SR_RIP_HDR_LEN   4   /* command, version, unused */
+#define SR_RIP_RTE_LEN   20
+#define SR_RIP_FRAME_MAX (sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + \
+                          sizeof(sr_udp_hdr_t) + sizeof(sr_rip_pkt_t))
+
+static const uint8_t sr_rip_group_mac[ETHER_ADDR_LEN] =
+    { 0x01, 0x00, 0x5e, 0x00, 0x00, 0x09 };
+
+/* -- a RIP message being filled in, to one destination out of one interface -- */
+struct sr_rip_msg
+{
+    struct sr_if* iface;
+    uint32_t dst_ip;                  /* network byte order */
+    uint16_t dst_port;                /* network byte order */
+    uint8_t dst_mac[ETHER_ADDR_LEN];
+    unsigned int nrtes;
+    uint8_t frame[SR_RIP_FRAME_MAX];
+};
+
+static sr_rip_pkt_t* sr_rip_msg_body(struct sr_rip_msg* m)
+{ return (sr_rip_pkt_t*)(m->frame + sizeof(sr_ethernet_hdr_t) +
+                         sizeof(sr_ip_hdr_t) + sizeof(sr_udp_hdr_t)); }
+
+static void sr_rip_msg_init(struct sr_rip_msg* m, struct sr_if* iface, uint8_t command,
+                            uint32_t dst_ip, uint16_t dst_port, const uint8_t* dst_mac)
+{
+    sr_rip_pkt_t* rip = sr_rip_msg_body(m);
+
+    m->iface = iface;
+    m->dst_ip = dst_ip;
+    m->dst_port = dst_port;
+    memcpy(m->dst_mac, dst_mac, ETHER_ADDR_LEN);
+    m->nrtes = 0;
+    rip->command = command;
+    rip->version = SR_RIP_VERSION;
+    rip->unused = 0;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_msg_send(..)
+ * Scope:  Local
+ *
+ * Put the Ethernet, IP and UDP headers in front of the entries added so
+ * far, send the frame and start over with an empty message.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_rip_msg_send(struct sr_instance* sr, struct sr_rip_msg* m)
+{
+    sr_ethernet_hdr_t* eth = (sr_ethernet_hdr_t*)m->frame;
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*)(m->frame + sizeof(sr_ethernet_hdr_t));
+    sr_udp_hdr_t* udp = (sr_udp_hdr_t*)(ip + 1);
+    unsigned int udp_len = sizeof(sr_udp_hdr_t) + SR_RIP_HDR_LEN + m->nrtes * SR_RIP_RTE_LEN;
+    uint32_t sum;
+
+    memcpy(eth->ether_dhost, m->dst_mac, ETHER_ADDR_LEN);
+    memcpy(eth->ether_shost, m->iface->addr, ETHER_ADDR_LEN);
+    eth->ether_type = htons(ethertype_ip);
+
+    memset(ip, 0, sizeof(sr_ip_hdr_t));
+    ip->ip_v = 4;
+    ip->ip_hl = sizeof(sr_ip_hdr_t) / 4;
+    ip->ip_len = htons(sizeof(sr_ip_hdr_t) + udp_len);
+    ip->ip_ttl = 1;  /* for neighbours only */
+    ip->ip_p = ip_protocol_udp;
+    ip->ip_src = m->iface->ip;
+    ip->ip_dst = m->dst_ip;
+    ip->ip_sum = cksum(ip, sizeof(sr_ip_hdr_t));
+
+    udp->port_src = htons(SR_RIP_PORT);
+    udp->port_dst = m->dst_port;
+    udp->udp_len = htons(udp_len);
+    udp->udp_sum = 0;
+    /* -- pseudo header: addresses, protocol and UDP length -- */
+    sum = cksum_partial(&(ip->ip_src), 8, htons(ip_protocol_udp) + udp->udp_len);
+    udp->udp_sum = cksum_fold(cksum_partial(udp, udp_len, sum));
+
+    sr_send_packet(sr, m->frame, sizeof(sr_ethernet_hdr_t) + sizeof(sr_ip_hdr_t) + udp_len,
+                   m->iface->name);
+    sr->rip.tx_packets++;
+    m->nrtes = 0;
+} /* -- sr_rip_msg_send -- */
+
+static void sr_rip_msg_add(struct sr_instance* sr, struct sr_rip_msg* m,
+                           uint32_t dest, uint32_t mask, uint32_t metric)
+{
+    sr_rip_pkt_t* rip = sr_rip_msg_body(m);
+    unsigned int n = m->nrtes;
+
+    rip->entries[n].afi = htons(SR_RIP_AFI_INET);
+    rip->entries[n].tag = 0;
+    rip->entries[n].address = dest;
+    rip->entries[n].mask = mask;
+    rip->entries[n].next_hop = 0;
+    rip->entries[n].metric = htonl(metric);
+    if(++m->nrtes == MAX_NUM_ENTRIES)
+    { sr_rip_msg_send(sr, m); }
+}
+
+/* -- the metric rt is advertised with out of iface: split horizon with
+      poisoned reverse for the routes learned through iface -- */
+static uint32_t sr_rip_metric_out(const struct sr_rt* rt, const struct sr_if* iface)
+{
+    if(rt->learned && rt->ifindex == iface->ifindex)
+    { return INFINITY; }
+    return rt->metric ? rt->metric : 1;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_send_routes(..)
+ * Scope:  Local
+ *
+ * Send the routing table, or only its changed routes, out of iface in
+ * as many responses as it takes.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_rip_send_routes(struct sr_instance* sr, struct sr_if* iface,
+                               uint32_t dst_ip, uint16_t dst_port,
+                               const uint8_t* dst_mac, int changed_only)
+{
+    struct sr_rip_msg m;
+    struct sr_rt* rt;
+
+    sr_rip_msg_init(&m, iface, SR_RIP_RESPONSE, dst_ip, dst_port, dst_mac);
+    for(rt = sr->routing_table; rt; rt = rt->next)
+    {
+        if(changed_only && !rt->changed)
+        { continue; }
+        sr_rip_msg_add(sr, &m, rt->dest.s_addr, rt->mask.s_addr, sr_rip_metric_out(rt, iface));
     }
-    return NULL;
+    if(m.nrtes)
+    { sr_rip_msg_send(sr, &m); }
+} /* -- sr_rip_send_routes -- */
+
+/* -- an update to the RIP group on every interface that is up -- */
+static void sr_rip_update_all(struct sr_instance* sr, int changed_only)
+{
+    struct sr_if* iface;
+    struct sr_rt* rt;
+
+    for(iface = sr->if_list; iface; iface = iface->next)
+    {
+        if(iface->status)
+        {
+            sr_rip_send_routes(sr, iface, htonl(SR_RIP_GROUP), htons(SR_RIP_PORT),
+                               sr_rip_group_mac, changed_only);
+        }
+    }
+    for(rt = sr->routing_table; rt; rt = rt->next)
+    { rt->changed = 0; }
+    sr->rip.triggered = 0;
+}
+
+static void sr_rip_send_triggered(struct sr_instance* sr, time_t now)
+{
+    sr_rip_update_all(sr, 1);
+    sr->rip.tx_triggered++;
+    sr->rip.next_triggered = now + SR_RIP_TRIGGER_S + rand() % 5;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_trigger(..)
+ * Scope:  Local
+ *
+ * Some routes are marked changed: send them now, unless a triggered
+ * update went out less than 1 to 5 seconds ago, in which case the next
+ * tick that is allowed to sends them together with whatever changes in
+ * the meantime (RFC 2453 3.10.1).
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_rip_trigger(struct sr_instance* sr, time_t now)
+{
+    if(!sr->rip.enabled)
+    { return; }
+    sr->rip.triggered = 1;
+    if(now >= sr->rip.next_triggered)
+    { sr_rip_send_triggered(sr, now); }
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_check(..)
+ * Scope:  Local
+ *
+ * Validate a RIP packet received on iface and return its UDP header, or
+ * 0 to drop it.  nrtes is set to the number of route entries.
+ *
+ *---------------------------------------------------------------------*/
+
+static sr_udp_hdr_t* sr_rip_check(struct sr_instance* sr, uint8_t* packet, unsigned int len,
+                                   struct sr_if* iface, unsigned int* nrtes)
+{
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t));
+    unsigned int ip_hl = ip->ip_hl * 4;
+    sr_udp_hdr_t* udp;
+    unsigned int udp_len;
+    uint32_t sum;
+
+    if(!sr->rip.enabled || iface == 0 || !iface->status || ip_hl < sizeof(sr_ip_hdr_t) ||
+       len < sizeof(sr_ethernet_hdr_t) + ip_hl + sizeof(sr_udp_hdr_t) + SR_RIP_HDR_LEN)
+    { return 0; }
+
+    udp = (sr_udp_hdr_t*)((uint8_t*)ip + ip_hl);
+    udp_len = ntohs(udp->udp_len);
+    if(udp_len < sizeof(sr_udp_hdr_t) + SR_RIP_HDR_LEN ||
+       udp_len > len - sizeof(sr_ethernet_hdr_t) - ip_hl)
+    { return 0; }
+    if(udp->udp_sum)
+    {
+        sum = cksum_partial(&(ip->ip_src), 8, htons(ip_protocol_udp) + udp->udp_len);
+        if(cksum_fold(cksum_partial(udp, udp_len, sum)) != 0xffff)
+        { return 0; }
+    }
+
+    /* -- never listen to ourselves -- */
+    if(((sr_rip_pkt_t*)(udp + 1))->version == 0 ||
+       sr_if_classify(sr, ip->ip_src, 0) == SR_DST_LOCAL)
+    { return 0; }
+
+    *nrtes = (udp_len - sizeof(sr_udp_hdr_t) - SR_RIP_HDR_LEN) / SR_RIP_RTE_LEN;
+    if(*nrtes > MAX_NUM_ENTRIES)
+    { *nrtes = MAX_NUM_ENTRIES; }
+    return udp;
+} /* -- sr_rip_check -- */
+
+/* -- return 1 if dest/mask (network byte order) may be learned: a
+      contiguous mask, no host bits, and a unicast network -- */
+static int sr_rip_dest_ok(uint32_t dest, uint32_t mask)
+{
+    uint32_t d = ntohl(dest);
+    uint32_t host = ~ntohl(mask);
+
+    if((host & (host + 1)) != 0 || (d & host) != 0)
+    { return 0; }
+    if(d >= 0xe0000000 || (d >> 24) == 127 || ((d >> 24) == 0 && d != 0))
+    { return 0; }
+    return 1;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_response(..)
+ * Scope:  Local
+ *
+ * Learn from a response received on iface (RFC 2453 3.9.2).  Connected
+ * and static routes always win over learned ones.  A learned route
+ * follows whatever its current next hop says, and moves to another next
+ * hop that offers a lower metric, or the same metric once the current
+ * one has not been heard of for half the timeout.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_rip_response(struct sr_instance* sr, uint8_t* packet, sr_udp_hdr_t* udp,
+                            unsigned int nrtes, struct sr_if* iface)
+{
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t));
+    sr_rip_pkt_t* rip = (sr_rip_pkt_t*)(udp + 1);
+    struct sr_if* src_if;
+    struct sr_rt* rt;
+    struct in_addr dest, gw, mask;
+    uint32_t metric;
+    uint32_t subnet = iface->ip & iface->mask;
+    unsigned int i;
+    int changed = 0;
+    time_t now;
+
+    /* -- from port 520 of a neighbour on the link it came in on -- */
+    if(udp->port_src != htons(SR_RIP_PORT) || rip->version < SR_RIP_VERSION ||
+       sr_if_classify(sr, ip->ip_src, &src_if) != SR_DST_CONNECTED || src_if != iface)
+    {
+        sr->rip.rx_dropped++;
+        return;
+    }
+    sr->rip.rx_responses++;
+    time(&now);
+
+    for(i = 0; i < nrtes; i++)
+    {
+        metric = ntohl(rip->entries[i].metric);
+        if(ntohs(rip->entries[i].afi) != SR_RIP_AFI_INET || metric < 1 || metric > INFINITY ||
+           !sr_rip_dest_ok(rip->entries[i].address, rip->entries[i].mask))
+        {
+            sr->rip.rx_bad_rtes++;
+            continue;
+        }
+        if(++metric > INFINITY)
+        { metric = INFINITY; }
+
+        dest.s_addr = rip->entries[i].address;
+        mask.s_addr = rip->entries[i].mask;
+        /* -- a next hop off the link, or ourselves, means the sender -- */
+        gw.s_addr = rip->entries[i].next_hop;
+        if(gw.s_addr == 0 || (gw.s_addr & iface->mask) != subnet ||
+           sr_if_classify(sr, gw.s_addr, 0) == SR_DST_LOCAL)
+        { gw.s_addr = ip->ip_src; }
+
+        rt = sr_rt_find(sr, dest.s_addr, mask.s_addr);
+        if(rt == 0)
+        {
+            if(metric == INFINITY)
+            { continue; }
+            rt = sr_rt_append(sr, dest, gw, mask, metric, iface->name);
+            rt->learned = 1;
+            rt->changed = 1;
+            sr->rt_dirty = 1;
+        }
+        else if(!rt->learned)
+        { continue; }
+        else if(rt->gw.s_addr == gw.s_addr && rt->ifindex == iface->ifindex)
+        {
+            if(metric < INFINITY)
+            { rt->updated_time = now; }
+            if(metric == rt->metric)
+            { continue; }
+            if(metric == INFINITY)
+            {
+                rt->gc_time = now + SR_RIP_GC_S;
+                sr->rt_dirty = 1;
+            }
+            else if(rt->metric >= INFINITY)
+            { sr->rt_dirty = 1; }
+            rt->metric = metric;
+            rt->changed = 1;
+        }
+        else if(metric < rt->metric ||
+                (metric == rt->metric && metric < INFINITY &&
+                 now - rt->updated_time >= SR_RIP_TIMEOUT_S / 2))
+        {
+            rt->gw = gw;
+            strncpy(rt->interface, iface->name, sr_IFACE_NAMELEN);
+            rt->ifindex = iface->ifindex;
+            rt->metric = metric;
+            rt->updated_time = now;
+            rt->changed = 1;
+            sr->rt_dirty = 1;
+        }
+        else
+        { continue; }
+        sr->rip.rt_changes++;
+        changed = 1;
+    }
+    if(changed)
+    { sr_rip_trigger(sr, now); }
+} /* -- sr_rip_response -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_request(..)
+ * Scope:  Local
+ *
+ * Answer a request received on iface, straight to the requester: a
+ * request for the whole table gets what an update on iface would carry,
+ * one for some routes gets their metrics (RFC 2453 3.9.1).
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_rip_request(struct sr_instance* sr, uint8_t* packet, sr_udp_hdr_t* udp,
+                           unsigned int nrtes, struct sr_if* iface)
+{
+    sr_ethernet_hdr_t* eth = (sr_ethernet_hdr_t*)packet;
+    sr_ip_hdr_t* ip = (sr_ip_hdr_t*)(packet + sizeof(sr_ethernet_hdr_t));
+    sr_rip_pkt_t* rip = (sr_rip_pkt_t*)(udp + 1);
+    struct sr_rip_msg m;
+    struct sr_rt* rt;
+    unsigned int i;
+
+    sr->rip.rx_requests++;
+    if(nrtes == 1 && rip->entries[0].afi == 0 && ntohl(rip->entries[0].metric) == INFINITY)
+    {
+        sr_rip_send_routes(sr, iface, ip->ip_src, udp->port_src, eth->ether_shost, 0);
+        return;
+    }
+
+    sr_rip_msg_init(&m, iface, SR_RIP_RESPONSE, ip->ip_src, udp->port_src, eth->ether_shost);
+    for(i = 0; i < nrtes; i++)
+    {
+        rt = sr_rt_find(sr, rip->entries[i].address, rip->entries[i].mask);
+        sr_rip_msg_add(sr, &m, rip->entries[i].address, rip->entries[i].mask,
+                       rt ? (rt->metric ? rt->metric : 1) : INFINITY);
+    }
+    if(m.nrtes)
+    { sr_rip_msg_send(sr, &m); }
+} /* -- sr_rip_request -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_input(..)
+ * Scope:  Global
+ *
+ * Handle a UDP datagram to the RIP port, received on ifindex and sent
+ * to one of our addresses or to a group.  packet is the whole frame,
+ * with a valid IP header.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rip_input(struct sr_instance *sr, uint8_t *packet, unsigned int len, unsigned int ifindex)
+{
+    struct sr_if* iface = sr_get_interface_by_index(sr, ifindex);
+    sr_udp_hdr_t* udp;
+    unsigned int nrtes;
+
+    pthread_mutex_lock(&(sr->rt_locker));
+    udp = sr_rip_check(sr, packet, len, iface, &nrtes);
+    if(udp == 0)
+    { sr->rip.rx_dropped++; }
+    else if(((sr_rip_pkt_t*)(udp + 1))->command == SR_RIP_REQUEST)
+    { sr_rip_request(sr, packet, udp, nrtes, iface); }
+    else if(((sr_rip_pkt_t*)(udp + 1))->command == SR_RIP_RESPONSE)
+    { sr_rip_response(sr, packet, udp, nrtes, iface); }
+    else
+    { sr->rip.rx_dropped++; }
+    pthread_mutex_unlock(&(sr->rt_locker));
+} /* -- sr_rip_input -- */
+
+/*---------------------------------------------------------------------
+ * Method: update_route_table(..)
+ * Scope:  Global
+ *
+ * Learn from a RIP response received on ifindex; anything else is
+ * dropped.  See sr_rip_input() for the arguments.
+ *
+ *---------------------------------------------------------------------*/
+
+void update_route_table(struct sr_instance *sr, uint8_t *packet, unsigned int len, unsigned int ifindex)
+{
+    struct sr_if* iface = sr_get_interface_by_index(sr, ifindex);
+    sr_udp_hdr_t* udp;
+    unsigned int nrtes;
+
+    pthread_mutex_lock(&(sr->rt_locker));
+    udp = sr_rip_check(sr, packet, len, iface, &nrtes);
+    if(udp && ((sr_rip_pkt_t*)(udp + 1))->command == SR_RIP_RESPONSE)
+    { sr_rip_response(sr, packet, udp, nrtes, iface); }
+    else
+    { sr->rip.rx_dropped++; }
+    pthread_mutex_unlock(&(sr->rt_locker));
+} /* -- update_route_table -- */
+
+/* -- a request for the whole table out of iface -- */
+static void sr_rip_request_on(struct sr_instance* sr, struct sr_if* iface)
+{
+    struct sr_rip_msg m;
+
+    sr_rip_msg_init(&m, iface, SR_RIP_REQUEST, htonl(SR_RIP_GROUP), htons(SR_RIP_PORT),
+                    sr_rip_group_mac);
+    sr_rip_msg_add(sr, &m, 0, 0, INFINITY);
+    sr_rip_msg_body(&m)->entries[0].afi = 0;
+    sr_rip_msg_send(sr, &m);
 }
 
 void send_rip_request(struct sr_instance *sr){
+    struct sr_if* iface;
+
     pthread_mutex_lock(&(sr->rt_locker));
+    for(iface = sr->if_list; iface; iface = iface->next)
+    {
+        if(iface->status)
+        { sr_rip_request_on(sr, iface); }
+    }
     pthread_mutex_unlock(&(sr->rt_locker));
 }
 
+/* Full update on every interface; schedules the next one */
 void send_rip_response(struct sr_instance *sr){
+    time_t now;
+
     pthread_mutex_lock(&(sr->rt_locker));
+    time(&now);
+    sr_rip_update_all(sr, 0);
+    sr->rip.tx_updates++;
+    sr->rip.next_update = now + SR_RIP_UPDATE_S - 5 + rand() % 11;
     pthread_mutex_unlock(&(sr->rt_locker));
 }
 
-void update_route_table(struct sr_instance *sr, uint8_t *packet, unsigned int len, char *interface){
+/*---------------------------------------------------------------------
+ * Method: sr_rip_init(..)
+ * Scope:  Global
+ *
+ * Start speaking RIP: add the connected routes the table lacks, ask the
+ * neighbours for their tables and have the first tick send ours.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rip_init(struct sr_instance *sr)
+{
+    sr_build_rt(sr);
+
     pthread_mutex_lock(&(sr->rt_locker));
+    time(&(sr->rip.next_update));
+    sr->rip.next_triggered = sr->rip.next_update;
+    send_rip_request(sr);
     pthread_mutex_unlock(&(sr->rt_locker));
-}
\ No newline at end of file
+} /* -- sr_rip_init -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_link_changed(..)
+ * Scope:  Global
+ *
+ * Interface ifindex went down or came back up.  Down, every route
+ * through it becomes unreachable; up, its connected and static routes
+ * come back and the neighbours on it are asked for their tables.
+ * Either way the change goes out as a triggered update, and reaches
+ * the FIB on the next tick.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rip_link_changed(struct sr_instance *sr, unsigned int ifindex, int up)
+{
+    struct sr_if* iface = sr_get_interface_by_index(sr, ifindex);
+    struct sr_rt* rt;
+    time_t now;
+
+    if(iface == 0)
+    { return; }
+
+    pthread_mutex_lock(&(sr->rt_locker));
+    if(iface->status == (uint32_t)(up != 0))
+    {
+        pthread_mutex_unlock(&(sr->rt_locker));
+        return;
+    }
+    iface->status = (up != 0);
+    sr_update_interface_status(sr, iface->status, iface->name);
+    time(&now);
+
+    for(rt = sr->routing_table; rt; rt = rt->next)
+    {
+        if(rt->ifindex != ifindex)
+        { continue; }
+        if(!up && rt->metric < INFINITY)
+        {
+            rt->metric = INFINITY;
+            if(rt->learned)
+            { rt->gc_time = now + SR_RIP_GC_S; }
+        }
+        else if(up && !rt->learned && rt->metric >= INFINITY)
+        { rt->metric = 0; }
+        else
+        { continue; }
+        rt->changed = 1;
+        sr->rt_dirty = 1;
+        sr->rip.rt_changes++;
+    }
+
+    if(up && sr->rip.enabled)
+    { sr_rip_request_on(sr, iface); }
+    sr_rip_trigger(sr, now);
+    pthread_mutex_unlock(&(sr->rt_locker));
+} /* -- sr_rip_link_changed -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_rip_tick(..)
+ * Scope:  Global
+ *
+ * Periodic work, every SR_RIP_TICK_MS: time out learned routes that
+ * were not refreshed, delete those whose garbage collection time is up,
+ * send the full update when it is due or a held back triggered one, and
+ * publish the FIB if the table changed since the last tick.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_rip_tick(struct sr_instance *sr) {
+    struct sr_rt** link;
+    struct sr_rt* rt;
+    struct sr_rt* prev = 0;
+    time_t now;
+
+    pthread_mutex_lock(&(sr->rt_locker));
+    if(sr->rip.enabled)
+    {
+        time(&now);
+        link = &(sr->routing_table);
+        while((rt = *link) != 0)
+        {
+            if(rt->learned && rt->metric < INFINITY &&
+               now - rt->updated_time >= SR_RIP_TIMEOUT_S)
+            {
+                rt->metric = INFINITY;
+                rt->gc_time = now + SR_RIP_GC_S;
+                rt->changed = 1;
+                sr->rt_dirty = 1;
+                sr->rip.rt_changes++;
+                sr->rip.triggered = 1;
+            }
+            else if(rt->learned && rt->metric >= INFINITY && now >= rt->gc_time)
+            {
+                /* -- not in the FIB, nothing else points at it -- */
+                *link = rt->next;
+                if(sr->rt_index.tail == rt)
+                { sr->rt_index.tail = prev; }
+                sr_rt_index_remove(&(sr->rt_index), rt);
+                free(rt);
+                continue;
+            }
+            prev = rt;
+            link = &(rt->next);
+        }
+
+        if(now >= sr->rip.next_update)
+        { send_rip_response(sr); }
+        else if(sr->rip.triggered && now >= sr->rip.next_triggered)
+        { sr_rip_send_triggered(sr, now); }
+    }
+    /* -- everything that changed since the last tick, in one FIB -- */
+    if(sr->rt_dirty)
+    { sr_rt_publish(sr); }
+    pthread_mutex_unlock(&(sr->rt_locker));
+    sr_flush_packets(sr);
+    sr_rcu_reclaim(&(sr->rcu));
+} /* -- sr_rip_tick -- */
+
+void *sr_rip_timeout(void *sr_ptr) {
+    struct sr_instance *sr = sr_ptr;
+    while (1) {
+        usleep(SR_RIP_TICK_MS * 1000);
+        sr_rip_tick(sr);
+    }
+    return NULL;
+}
+
+void sr_rip_print_stats(struct sr_instance *sr, FILE* out)
+{
+    pthread_mutex_lock(&(sr->rt_locker));
+    fprintf(out, "rip: %s, responses in %lu, requests in %lu, dropped %lu, bad entries %lu\n",
+            sr->rip.enabled ? "on" : "off", sr->rip.rx_responses, sr->rip.rx_requests,
+            sr->rip.rx_dropped, sr->rip.rx_bad_rtes);
+    fprintf(out, "rip: route changes %lu, updates %lu, triggered %lu, packets out %lu\n",
+            sr->rip.rt_changes, sr->rip.tx_updates, sr->rip.tx_triggered,
+            sr->rip.tx_packets);
+    pthread_mutex_unlock(&(sr->rt_locker));
+}
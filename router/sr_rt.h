@@ -15,10 +15,27 @@
 #endif
 
 #define INFINITY 16
+#include <stdio.h>
+#include <time.h>
 #include <netinet/in.h>
 
 #include "sr_if.h"
 #include "sr_protocol.h"
+
+#define SR_RIP_PORT       520
+#define SR_RIP_GROUP      0xe0000009  /* 224.0.0.9, host byte order */
+#define SR_RIP_VERSION    2
+#define SR_RIP_REQUEST    1
+#define SR_RIP_RESPONSE   2
+#define SR_RIP_AFI_INET   2
+#define SR_RIP_TICK_MS    1000  /* timer period, see sr_rip_tick() */
+#define SR_RIP_UPDATE_S   30    /* full update period, jittered by up to 5 s */
+#define SR_RIP_TIMEOUT_S  180   /* a learned route not refreshed this long is unreachable */
+#define SR_RIP_GC_S       120   /* and is deleted this long after that */
+#define SR_RIP_TRIGGER_S  1     /* triggered updates are 1 to 5 s apart */
+
+#define SR_RT_HASH_MIN    64    /* buckets of the route index, doubled as it fills */
+
 /* ----------------------------------------------------------------------------
  * struct sr_rt
  *
@@ -32,20 +49,80 @@ struct sr_rt
     struct in_addr gw;
     struct in_addr mask;
     char   interface[sr_IFACE_NAMELEN];
+    unsigned int ifindex; /* of interface, set by sr_rt_publish */
     uint32_t metric;
-    time_t updated_time;
+    time_t updated_time;  /* last heard of, for routes learned by RIP */
+    time_t gc_time;       /* when an unreachable learned route is deleted */
+    uint8_t learned;      /* 1 if learned by RIP, 0 for connected and static routes */
+    uint8_t changed;      /* goes out in the next triggered update */
     struct sr_rt* next;
+    struct sr_rt* hash_next; /* sr_rt_index chain; stale in FIB copies */
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_rt_index
+ *
+ * The routing table list by exact destination and mask, chained through
+ * hash_next, plus the last node of the list, so that adding a route or
+ * finding the one a RIP entry or a table line refers to does not walk
+ * the list.  Protected by rt_locker.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_rt_index
+{
+    struct sr_rt** buckets;
+    unsigned int nbuckets;    /* a power of two, 0 until the first route */
+    unsigned int nroutes;
+    struct sr_rt* tail;       /* last node of sr->routing_table */
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_rip
+ *
+ * RIPv2 (RFC 2453) state, protected by rt_locker like the table itself.
+ * Connected and static routes are kept with metric 0 and advertised with
+ * metric 1; learned routes hold the metric as received plus one.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_rip
+{
+    int enabled;                /* -P */
+    time_t next_update;         /* next full update */
+    time_t next_triggered;      /* earliest next triggered update */
+    int triggered;              /* routes changed since the last update */
+    unsigned long rx_responses;
+    unsigned long rx_requests;
+    unsigned long rx_dropped;   /* packets failing validation */
+    unsigned long rx_bad_rtes;  /* entries failing validation */
+    unsigned long rt_changes;   /* routes added, moved or poisoned */
+    unsigned long tx_updates;   /* full updates */
+    unsigned long tx_triggered; /* triggered updates */
+    unsigned long tx_packets;
 };
 
 int sr_build_rt(struct sr_instance*);
+void sr_rt_publish(struct sr_instance*);
+void sr_rt_bind_interfaces(struct sr_instance*);
+void sr_rt_batch_begin(struct sr_instance*);
+void sr_rt_batch_end(struct sr_instance*);
 int sr_load_rt(struct sr_instance*,const char*);
+int sr_verify_routing_table(struct sr_instance* sr);
 void sr_add_rt_entry(struct sr_instance*, struct in_addr,struct in_addr,
                   struct in_addr, uint32_t metric, char*);
 void sr_print_routing_table(struct sr_instance* sr);
 void sr_print_routing_entry(struct sr_rt* entry);
+void sr_fprint_routing_table(struct sr_instance* sr, FILE* out);
+void sr_fprint_routing_entry(struct sr_rt* entry, FILE* out);
 
 void *sr_rip_timeout(void *sr_ptr);
+void sr_rip_tick(struct sr_instance *sr);
+void sr_rip_init(struct sr_instance *sr);
+void sr_rip_input(struct sr_instance *sr, uint8_t *packet, unsigned int len, unsigned int ifindex);
+void sr_rip_link_changed(struct sr_instance *sr, unsigned int ifindex, int up);
+void sr_rip_print_stats(struct sr_instance *sr, FILE* out);
 void send_rip_request(struct sr_instance *sr);
 void send_rip_response(struct sr_instance *sr);
-void update_route_table(struct sr_instance *sr, uint8_t *packet, unsigned int len, char *interface);
+void update_route_table(struct sr_instance *sr, uint8_t *packet, unsigned int len, unsigned int ifindex);
 #endif  /* --  sr_RT_H -- */
@@ -0,0 +1,371 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_slab.c
+ *
+ * Description:
+ *
+ * Size class slab allocator for sr_slab.h.  Every object is preceded by a
+ * 16 byte header naming its class, so sr_slab_free() needs no size.  Free
+ * objects are linked through their first word.  Per-thread counters are
+ * folded into the depot whenever the thread refills or spills, which is
+ * when it takes the depot lock anyway.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#include "sr_slab.h"
+
+#define SLAB_MAGIC      0x51ab51abU
+#define SLAB_CHUNK      (64 * 1024)   /* minimum bytes carved at once */
+#define MALLOC_CLASS    SR_SLAB_NCLASSES
+
+static const size_t sr_slab_sizes[SR_SLAB_NCLASSES] = { 64, 128, 256, 2048, 10240 };
+
+struct sr_slab_hdr
+{
+    uint32_t cls;
+    uint32_t magic;
+    uint64_t size;             /* requested size, malloc class only */
+};
+
+struct sr_slab_obj
+{
+    struct sr_slab_obj* next;
+};
+
+struct sr_slab_depot
+{
+    pthread_mutex_t lock;
+    struct sr_slab_obj* free;
+    unsigned long nfree;
+    struct sr_slab_stats stats;
+};
+
+/* -- per-thread free lists and counters not yet folded into the depot -- */
+struct sr_slab_cache
+{
+    struct sr_slab_obj* free[SR_SLAB_NCLASSES];
+    unsigned int count[SR_SLAB_NCLASSES];
+    unsigned long allocs[SR_SLAB_NCLASSES];
+    unsigned long hits[SR_SLAB_NCLASSES];
+    unsigned long frees[SR_SLAB_NCLASSES];
+    int registered;
+};
+
+static struct sr_slab_depot sr_slab_depots[SR_SLAB_NCLASSES + 1];
+static pthread_once_t sr_slab_once = PTHREAD_ONCE_INIT;
+static pthread_key_t sr_slab_key;
+static __thread struct sr_slab_cache sr_slab_tc;
+
+#define HDR(ptr) ((struct sr_slab_hdr*)(ptr) - 1)
+
+static void sr_slab_thread_exit(void* arg);
+
+static void sr_slab_setup(void)
+{
+    int i;
+
+    for(i = 0; i <= SR_SLAB_NCLASSES; i++)
+    {
+        pthread_mutex_init(&(sr_slab_depots[i].lock), 0);
+        sr_slab_depots[i].free  = 0;
+        sr_slab_depots[i].nfree = 0;
+        memset(&(sr_slab_depots[i].stats), 0, sizeof(struct sr_slab_stats));
+        sr_slab_depots[i].stats.size = (i < SR_SLAB_NCLASSES) ? sr_slab_sizes[i] : 0;
+    }
+    pthread_key_create(&sr_slab_key, sr_slab_thread_exit);
+}
+
+static int sr_slab_class(size_t size)
+{
+    int cls;
+
+    for(cls = 0; cls < SR_SLAB_NCLASSES; cls++)
+    {
+        if(size <= sr_slab_sizes[cls])
+        { return cls; }
+    }
+    return MALLOC_CLASS;
+}
+
+/* -- carve a new chunk into the depot; depot lock held -- */
+static int sr_slab_grow(struct sr_slab_depot* depot, int cls)
+{
+    size_t slot = sizeof(struct sr_slab_hdr) + sr_slab_sizes[cls];
+    size_t n = SLAB_CHUNK / slot;
+    struct sr_slab_hdr* hdr;
+    uint8_t* chunk;
+    size_t i;
+
+    if(n < SR_SLAB_BATCH)
+    { n = SR_SLAB_BATCH; }
+
+    chunk = (uint8_t*)malloc(n * slot);
+    if(chunk == 0)
+    { return -1; }
+
+    for(i = 0; i < n; i++)
+    {
+        hdr = (struct sr_slab_hdr*)(chunk + i * slot);
+        hdr->cls   = cls;
+        hdr->magic = SLAB_MAGIC;
+        hdr->size  = sr_slab_sizes[cls];
+        ((struct sr_slab_obj*)(hdr + 1))->next = depot->free;
+        depot->free = (struct sr_slab_obj*)(hdr + 1);
+    }
+    depot->nfree += n;
+    depot->stats.grows++;
+    return 0;
+}
+
+/* -- fold this thread's counters for cls into the depot; lock held -- */
+static void sr_slab_fold(struct sr_slab_depot* depot, int cls)
+{
+    depot->stats.allocs += sr_slab_tc.allocs[cls];
+    depot->stats.hits   += sr_slab_tc.hits[cls];
+    depot->stats.frees  += sr_slab_tc.frees[cls];
+    sr_slab_tc.allocs[cls] = 0;
+    sr_slab_tc.hits[cls]   = 0;
+    sr_slab_tc.frees[cls]  = 0;
+}
+
+/* -- move up to n objects from the depot to this thread -- */
+static void sr_slab_refill(int cls, unsigned int n)
+{
+    struct sr_slab_depot* depot = &(sr_slab_depots[cls]);
+    struct sr_slab_obj* obj;
+    unsigned int moved = 0;
+
+    pthread_mutex_lock(&(depot->lock));
+    if(depot->nfree < n)
+    { sr_slab_grow(depot, cls); }
+
+    while(moved < n && depot->free)
+    {
+        obj = depot->free;
+        depot->free = obj->next;
+        obj->next = sr_slab_tc.free[cls];
+        sr_slab_tc.free[cls] = obj;
+        moved++;
+    }
+    depot->nfree -= moved;
+    sr_slab_tc.count[cls] += moved;
+
+    depot->stats.outstanding += moved;
+    if(depot->stats.outstanding > depot->stats.high_water)
+    { depot->stats.high_water = depot->stats.outstanding; }
+    sr_slab_fold(depot, cls);
+    pthread_mutex_unlock(&(depot->lock));
+}
+
+/* -- hand up to n of this thread's free objects back to the depot -- */
+static void sr_slab_spill(int cls, unsigned int n)
+{
+    struct sr_slab_depot* depot = &(sr_slab_depots[cls]);
+    struct sr_slab_obj* obj;
+    unsigned int moved = 0;
+
+    pthread_mutex_lock(&(depot->lock));
+    while(moved < n && sr_slab_tc.free[cls])
+    {
+        obj = sr_slab_tc.free[cls];
+        sr_slab_tc.free[cls] = obj->next;
+        obj->next = depot->free;
+        depot->free = obj;
+        moved++;
+    }
+    depot->nfree += moved;
+    sr_slab_tc.count[cls] -= moved;
+    depot->stats.outstanding -= moved;
+    sr_slab_fold(depot, cls);
+    pthread_mutex_unlock(&(depot->lock));
+}
+
+static void sr_slab_thread_exit(void* arg)
+{
+    int cls;
+
+    for(cls = 0; cls < SR_SLAB_NCLASSES; cls++)
+    { sr_slab_spill(cls, sr_slab_tc.count[cls]); }
+    sr_slab_tc.registered = 0;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_slab_alloc(..)
+ * Scope:  Global
+ *
+ * Return size bytes aligned to 16, or 0 if out of memory.  Lock free
+ * unless the thread cache for the class is empty.
+ *
+ *---------------------------------------------------------------------*/
+
+void* sr_slab_alloc(size_t size)
+{
+    struct sr_slab_obj* obj;
+    struct sr_slab_hdr* hdr;
+    int cls;
+
+    pthread_once(&sr_slab_once, sr_slab_setup);
+
+    cls = sr_slab_class(size);
+    if(cls == MALLOC_CLASS)
+    {
+        struct sr_slab_depot* depot = &(sr_slab_depots[MALLOC_CLASS]);
+
+        hdr = (struct sr_slab_hdr*)malloc(sizeof(struct sr_slab_hdr) + size);
+        if(hdr == 0)
+        { return 0; }
+        hdr->cls   = MALLOC_CLASS;
+        hdr->magic = SLAB_MAGIC;
+        hdr->size  = size;
+
+        pthread_mutex_lock(&(depot->lock));
+        depot->stats.allocs++;
+        depot->stats.outstanding++;
+        if(depot->stats.outstanding > depot->stats.high_water)
+        { depot->stats.high_water = depot->stats.outstanding; }
+        pthread_mutex_unlock(&(depot->lock));
+        return hdr + 1;
+    }
+
+    if(!sr_slab_tc.registered)
+    {
+        sr_slab_tc.registered = 1;
+        pthread_setspecific(sr_slab_key, &sr_slab_tc);
+    }
+
+    sr_slab_tc.allocs[cls]++;
+    if(sr_slab_tc.free[cls])
+    { sr_slab_tc.hits[cls]++; }
+    else
+    {
+        sr_slab_refill(cls, SR_SLAB_BATCH);
+        if(sr_slab_tc.free[cls] == 0)
+        { return 0; }
+    }
+
+    obj = sr_slab_tc.free[cls];
+    sr_slab_tc.free[cls] = obj->next;
+    sr_slab_tc.count[cls]--;
+    return obj;
+} /* -- sr_slab_alloc -- */
+
+void sr_slab_free(void* ptr)
+{
+    struct sr_slab_hdr* hdr;
+    struct sr_slab_obj* obj = (struct sr_slab_obj*)ptr;
+    int cls;
+
+    if(ptr == 0)
+    { return; }
+
+    hdr = HDR(ptr);
+    assert(hdr->magic == SLAB_MAGIC);
+    cls = hdr->cls;
+
+    if(cls == MALLOC_CLASS)
+    {
+        struct sr_slab_depot* depot = &(sr_slab_depots[MALLOC_CLASS]);
+
+        pthread_mutex_lock(&(depot->lock));
+        depot->stats.frees++;
+        depot->stats.outstanding--;
+        pthread_mutex_unlock(&(depot->lock));
+        free(hdr);
+        return;
+    }
+
+    if(!sr_slab_tc.registered)
+    {
+        sr_slab_tc.registered = 1;
+        pthread_setspecific(sr_slab_key, &sr_slab_tc);
+    }
+
+    obj->next = sr_slab_tc.free[cls];
+    sr_slab_tc.free[cls] = obj;
+    sr_slab_tc.count[cls]++;
+    sr_slab_tc.frees[cls]++;
+
+    if(sr_slab_tc.count[cls] > SR_SLAB_CACHE_MAX)
+    { sr_slab_spill(cls, SR_SLAB_BATCH); }
+} /* -- sr_slab_free -- */
+
+/* -- bytes the caller may use at ptr, at least what it asked for -- */
+size_t sr_slab_usable(const void* ptr)
+{
+    return (size_t)((const struct sr_slab_hdr*)ptr - 1)->size;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_slab_reserve(..)
+ * Scope:  Global
+ *
+ * Carve chunks until the depot for size holds at least count free
+ * objects, so that start-up rather than the first packets pays for it.
+ * Returns 0 on success, -1 if out of memory or size has no class.
+ *
+ *---------------------------------------------------------------------*/
+
+int sr_slab_reserve(size_t size, unsigned int count)
+{
+    struct sr_slab_depot* depot;
+    int cls;
+    int ret = 0;
+
+    pthread_once(&sr_slab_once, sr_slab_setup);
+
+    cls = sr_slab_class(size);
+    if(cls == MALLOC_CLASS)
+    { return -1; }
+
+    depot = &(sr_slab_depots[cls]);
+    pthread_mutex_lock(&(depot->lock));
+    while(ret == 0 && depot->nfree < count)
+    { ret = sr_slab_grow(depot, cls); }
+    pthread_mutex_unlock(&(depot->lock));
+
+    return ret;
+} /* -- sr_slab_reserve -- */
+
+void sr_slab_get_stats(unsigned int cls, struct sr_slab_stats* stats)
+{
+    assert(cls <= SR_SLAB_NCLASSES);
+
+    pthread_once(&sr_slab_once, sr_slab_setup);
+
+    pthread_mutex_lock(&(sr_slab_depots[cls].lock));
+    if(cls < SR_SLAB_NCLASSES)
+    { sr_slab_fold(&(sr_slab_depots[cls]), cls); }
+    memcpy(stats, &(sr_slab_depots[cls].stats), sizeof(struct sr_slab_stats));
+    pthread_mutex_unlock(&(sr_slab_depots[cls].lock));
+}
+
+void sr_slab_print_stats(FILE* out)
+{
+    struct sr_slab_stats st;
+    unsigned int cls;
+
+    fprintf(out, "class      allocs      hit%%       frees  chunks  outstanding  high water\n");
+    for(cls = 0; cls <= SR_SLAB_NCLASSES; cls++)
+    {
+        sr_slab_get_stats(cls, &st);
+        if(cls < SR_SLAB_NCLASSES)
+        { fprintf(out, "%6lu", (unsigned long)st.size); }
+        else
+        { fprintf(out, "malloc"); }
+        fprintf(out, " %11lu %8.2f %11lu %7lu %12lu %11lu\n",
+                st.allocs, st.allocs ? 100.0 * st.hits / st.allocs : 0.0,
+                st.frees, st.grows, st.outstanding, st.high_water);
+    }
+}
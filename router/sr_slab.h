@@ -0,0 +1,56 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_slab.h
+ *
+ * Description:
+ *
+ * Slab allocator for the data plane.  Objects come in a few size classes
+ * and are carved out of large chunks.  Every thread keeps a small cache of
+ * free objects per class and only goes to the shared depot, under a
+ * mutex, to refill or spill SR_SLAB_BATCH objects at a time.  Objects may
+ * be freed by a different thread than the one that allocated them.
+ *
+ * Requests larger than the biggest class go to malloc and are counted as
+ * such, so the stats show whether the data plane ever touches the heap.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef sr_SLAB_H
+#define sr_SLAB_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* -- payload sizes of the classes --
+ *   64      sr_packet nodes, minimum size frames
+ *   128     sr_arpreq nodes, ARP frames in a pbuf
+ *   256     ICMP error and small echo replies in a pbuf
+ *   2048    full 1518 byte frames in a pbuf
+ *   10240   9000 byte jumbo frames in a pbuf
+ */
+#define SR_SLAB_NCLASSES 5
+#define SR_SLAB_MAX      10240
+
+#define SR_SLAB_BATCH     32   /* objects moved between a thread and the depot */
+#define SR_SLAB_CACHE_MAX 128  /* a thread spills a batch above this */
+
+struct sr_slab_stats
+{
+    size_t size;               /* payload bytes, 0 for the malloc class */
+    unsigned long allocs;
+    unsigned long hits;        /* served from the thread cache */
+    unsigned long frees;
+    unsigned long grows;       /* chunks carved */
+    unsigned long outstanding; /* handed to threads, cached or in use */
+    unsigned long high_water;  /* highest outstanding seen */
+};
+
+void*  sr_slab_alloc(size_t size);
+void   sr_slab_free(void* ptr);
+size_t sr_slab_usable(const void* ptr);
+int    sr_slab_reserve(size_t size, unsigned int count);
+
+/* -- cls in [0, SR_SLAB_NCLASSES]; the last one is the malloc class -- */
+void sr_slab_get_stats(unsigned int cls, struct sr_slab_stats* stats);
+void sr_slab_print_stats(FILE* out);
+
+#endif  /* --  sr_SLAB_H -- */
@@ -0,0 +1,245 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_timer.c
+ *
+ * Description:
+ *
+ * Timing wheel in the style of the classic BSD/Linux kernel timers.  A
+ * timer due within SR_TIMER_L0_SIZE ticks lives in level 0, indexed by its
+ * expiry tick.  Later timers live in a coarser level, indexed by the
+ * matching bits of the expiry tick, and are cascaded down one level each
+ * time the level below wraps around.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <time.h>
+
+#include "sr_timer.h"
+
+#define L0_MASK (SR_TIMER_L0_SIZE - 1)
+#define LN_MASK (SR_TIMER_LN_SIZE - 1)
+
+/* -- first tick bit used to index level n (n >= 1) -- */
+#define LN_SHIFT(n) (SR_TIMER_L0_BITS + ((n) - 1) * SR_TIMER_LN_BITS)
+
+/* -- longest delay the wheel can represent, in ticks -- */
+#define MAX_TICKS ((((uint64_t)1) << LN_SHIFT(SR_TIMER_LEVELS)) - 1)
+
+uint64_t sr_timer_now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void sr_timer_list_init(struct sr_timer* head)
+{
+    head->next = head;
+    head->prev = head;
+}
+
+static void sr_timer_link(struct sr_timer* head, struct sr_timer* timer)
+{
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+static void sr_timer_unlink(struct sr_timer* timer)
+{
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = 0;
+    timer->prev = 0;
+}
+
+/* -- file a timer into the slot matching its expiry tick -- */
+static void sr_timer_place(struct sr_timer_wheel* wheel, struct sr_timer* timer)
+{
+    uint64_t delta = timer->expires - wheel->now;
+    int level;
+
+    if(delta < SR_TIMER_L0_SIZE)
+    {
+        sr_timer_link(&(wheel->l0[timer->expires & L0_MASK]), timer);
+        return;
+    }
+
+    for(level = 1; level < SR_TIMER_LEVELS - 1; level++)
+    {
+        if(delta < ((uint64_t)1 << LN_SHIFT(level + 1)))
+        { break; }
+    }
+    sr_timer_link(&(wheel->ln[level - 1][(timer->expires >> LN_SHIFT(level)) & LN_MASK]),
+                  timer);
+}
+
+/* -- move one slot of a coarse level down; returns the slot index -- */
+static unsigned int sr_timer_cascade(struct sr_timer_wheel* wheel, int level)
+{
+    unsigned int index = (wheel->now >> LN_SHIFT(level)) & LN_MASK;
+    struct sr_timer* head = &(wheel->ln[level - 1][index]);
+    struct sr_timer* timer;
+
+    while(head->next != head)
+    {
+        timer = head->next;
+        sr_timer_unlink(timer);
+        sr_timer_place(wheel, timer);
+    }
+    return index;
+}
+
+void sr_timer_wheel_init(struct sr_timer_wheel* wheel, unsigned int tick_ms)
+{
+    int i, j;
+
+    assert(wheel);
+    assert(tick_ms > 0);
+
+    wheel->now      = 0;
+    wheel->start_ms = sr_timer_now_ms();
+    wheel->tick_ms  = tick_ms;
+    wheel->pending  = 0;
+    for(i = 0; i < SR_TIMER_L0_SIZE; i++)
+    { sr_timer_list_init(&(wheel->l0[i])); }
+    for(i = 0; i < SR_TIMER_LEVELS - 1; i++)
+    {
+        for(j = 0; j < SR_TIMER_LN_SIZE; j++)
+        { sr_timer_list_init(&(wheel->ln[i][j])); }
+    }
+}
+
+void sr_timer_init(struct sr_timer* timer, sr_timer_fn fn, void* arg)
+{
+    assert(timer);
+
+    timer->next    = 0;
+    timer->prev    = 0;
+    timer->expires = 0;
+    timer->fn      = fn;
+    timer->arg     = arg;
+}
+
+int sr_timer_pending(const struct sr_timer* timer)
+{
+    return timer->next != 0;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_add(..)
+ * Scope:  Global
+ *
+ * Arm (or re-arm) a timer to fire delay_ms from now, rounded up to the
+ * next tick.  The timer never fires early, even if the wheel has not been
+ * advanced for a while.
+ *
+ *---------------------------------------------------------------------*/
+
+void sr_timer_add(struct sr_timer_wheel* wheel, struct sr_timer* timer,
+                  unsigned int delay_ms)
+{
+    uint64_t expires;
+
+    assert(wheel);
+    assert(timer && timer->fn);
+
+    if(sr_timer_pending(timer))
+    { sr_timer_del(wheel, timer); }
+
+    expires = (sr_timer_now_ms() - wheel->start_ms + delay_ms + wheel->tick_ms - 1)
+              / wheel->tick_ms;
+    if(expires <= wheel->now)
+    { expires = wheel->now + 1; }
+    if(expires - wheel->now > MAX_TICKS)
+    { expires = wheel->now + MAX_TICKS; }
+
+    timer->expires = expires;
+    sr_timer_place(wheel, timer);
+    wheel->pending++;
+} /* -- sr_timer_add -- */
+
+void sr_timer_del(struct sr_timer_wheel* wheel, struct sr_timer* timer)
+{
+    if(!sr_timer_pending(timer))
+    { return; }
+
+    sr_timer_unlink(timer);
+    wheel->pending--;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_wheel_advance(..)
+ * Scope:  Global
+ *
+ * Process every tick up to the current time and run the timers that are
+ * due, passing ctx to their callbacks.  Callbacks may add or delete any
+ * timer, including their own.  Returns the number of timers fired.
+ *
+ *---------------------------------------------------------------------*/
+
+unsigned int sr_timer_wheel_advance(struct sr_timer_wheel* wheel, void* ctx)
+{
+    struct sr_timer expired;
+    struct sr_timer* timer;
+    uint64_t target;
+    unsigned int fired = 0;
+    int level;
+
+    target = (sr_timer_now_ms() - wheel->start_ms) / wheel->tick_ms;
+
+    while(wheel->now < target)
+    {
+        wheel->now++;
+
+        if((wheel->now & L0_MASK) == 0)
+        {
+            for(level = 1; level < SR_TIMER_LEVELS; level++)
+            {
+                if(sr_timer_cascade(wheel, level) != 0)
+                { break; }
+            }
+        }
+
+        /* -- detach the slot first so callbacks can re-arm freely -- */
+        sr_timer_list_init(&expired);
+        while(wheel->l0[wheel->now & L0_MASK].next != &(wheel->l0[wheel->now & L0_MASK]))
+        {
+            timer = wheel->l0[wheel->now & L0_MASK].next;
+            sr_timer_unlink(timer);
+            sr_timer_link(&expired, timer);
+        }
+
+        while(expired.next != &expired)
+        {
+            timer = expired.next;
+            sr_timer_unlink(timer);
+            wheel->pending--;
+            timer->fn(ctx, timer);
+            fired++;
+        }
+    }
+
+    return fired;
+} /* -- sr_timer_wheel_advance -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_timer_wheel_next_ms(..)
+ * Scope:  Global
+ *
+ * Milliseconds until the next tick is due, 0 if it already is.  Used
+ * by callers that sleep between calls to sr_timer_wheel_advance().
+ *
+ *---------------------------------------------------------------------*/
+
+unsigned int sr_timer_wheel_next_ms(const struct sr_timer_wheel* wheel)
+{
+    uint64_t due = wheel->start_ms + (wheel->now + 1) * wheel->tick_ms;
+    uint64_t now = sr_timer_now_ms();
+
+    return (due > now) ? (unsigned int)(due - now) : 0;
+}
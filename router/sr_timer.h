@@ -0,0 +1,75 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_timer.h
+ *
+ * Description:
+ *
+ * Hierarchical timing wheel.  Timers are embedded in the objects they
+ * belong to and cost O(1) to add or cancel.  Advancing the wheel only
+ * touches the slots for the ticks that elapsed plus an occasional
+ * cascade from a coarser level, so the work per tick is proportional to
+ * the number of timers that are due rather than the number armed.
+ *
+ * The wheel is not thread safe; its owner serializes access.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef sr_TIMER_H
+#define sr_TIMER_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+#define SR_TIMER_L0_BITS 8     /* 256 slots of one tick */
+#define SR_TIMER_LN_BITS 6     /* 64 slots per coarser level */
+#define SR_TIMER_LEVELS  4
+
+#define SR_TIMER_L0_SIZE (1 << SR_TIMER_L0_BITS)
+#define SR_TIMER_LN_SIZE (1 << SR_TIMER_LN_BITS)
+
+struct sr_timer;
+
+typedef void (*sr_timer_fn)(void* ctx, struct sr_timer* timer);
+
+/* ----------------------------------------------------------------------------
+ * struct sr_timer
+ *
+ * A timer is pending while it is linked into a wheel slot.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_timer
+{
+    struct sr_timer* next;
+    struct sr_timer* prev;
+    uint64_t expires;      /* tick at which the timer fires */
+    sr_timer_fn fn;
+    void* arg;
+};
+
+struct sr_timer_wheel
+{
+    uint64_t now;          /* last tick processed */
+    uint64_t start_ms;     /* monotonic time of tick 0 */
+    unsigned int tick_ms;
+    unsigned int pending;
+    struct sr_timer l0[SR_TIMER_L0_SIZE];                   /* list heads */
+    struct sr_timer ln[SR_TIMER_LEVELS - 1][SR_TIMER_LN_SIZE];
+};
+
+uint64_t sr_timer_now_ms(void);
+
+void sr_timer_wheel_init(struct sr_timer_wheel* wheel, unsigned int tick_ms);
+void sr_timer_init(struct sr_timer* timer, sr_timer_fn fn, void* arg);
+void sr_timer_add(struct sr_timer_wheel* wheel, struct sr_timer* timer,
+                  unsigned int delay_ms);
+void sr_timer_del(struct sr_timer_wheel* wheel, struct sr_timer* timer);
+int  sr_timer_pending(const struct sr_timer* timer);
+unsigned int sr_timer_wheel_advance(struct sr_timer_wheel* wheel, void* ctx);
+unsigned int sr_timer_wheel_next_ms(const struct sr_timer_wheel* wheel);
+
+#endif  /* --  sr_TIMER_H -- */
@@ -0,0 +1,66 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_transport.h
+ *
+ * Description:
+ *
+ * How frames get in and out of the router.  sr_read_from_server(),
+ * sr_send_packet() and sr_flush_packets() go through sr->transport, so
+ * the router code above them does not know whether frames are tunnelled
+ * through the VNS server (sr_vns_comm.c, the default) or read straight
+ * off Linux interfaces (sr_afpacket.c).
+ *
+ * A transport makes sr->sockfd a descriptor that polls readable when
+ * read() has work, so the event loop can watch it.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef sr_TRANSPORT_H
+#define sr_TRANSPORT_H
+
+#include <stdio.h>
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#ifdef _DARWIN_
+#include <inttypes.h>
+#endif /* _DARWIN_ */
+
+struct sr_instance;
+
+struct sr_transport_ops
+{
+    const char* name;
+
+    /* Attach to the network and fill in sr->if_list; arg is whatever
+       followed the name in -b.  0 on success.  The VNS transport is
+       opened by sr_connect_to_server() instead. */
+    int (*open)(struct sr_instance* sr, const char* arg);
+
+    /* Wait for frames and hand each to sr_handlepacket().  1 to keep
+       going, 0 if the network went away, -1 on error.  With
+       sr->event_loop set it is only called once sr->sockfd is readable
+       and must not block: one pass, then 1 even if no frame was handled,
+       so that the loop's timers and control socket keep running. */
+    int (*read)(struct sr_instance* sr);
+
+    /* Queue or send one frame out of iface.  Called with sr->send_lock
+       held; buf is not referenced after return. */
+    int (*send)(struct sr_instance* sr, uint8_t* buf, unsigned int len,
+                const char* iface);
+
+    /* Send everything send() queued.  Called with sr->send_lock held. */
+    int (*flush)(struct sr_instance* sr);
+
+    void (*close)(struct sr_instance* sr);
+
+    /* Frame and system call counts, for the control socket and exit. */
+    void (*print_stats)(struct sr_instance* sr, FILE* out);
+};
+
+extern const struct sr_transport_ops sr_vns_transport;
+extern const struct sr_transport_ops sr_afpacket_transport;
+extern const struct sr_transport_ops sr_xdp_transport;
+
+#endif  /* --  sr_TRANSPORT_H -- */
@@ -19,6 +19,7 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 
 #include "sr_dumper.h"
 #include "sr_router.h"
@@ -27,6 +28,8 @@
 #include "sr_rt.h"
 #include "sha1.h"
 #include "sr_utils.h"
+#include "sr_timer.h"
+#include "sr_transport.h"
 #include "vnscommand.h"
 
 static void sr_log_packet(struct sr_instance* , uint8_t* , int );
@@ -35,6 +38,23 @@ static int  sr_arp_req_not_for_us(struct sr_instance* sr,
                                   unsigned int len,
                                   char* interface  /* lent */);
 int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expected_cmd);
+static int  sr_vns_read(struct sr_instance* sr);
+static int  sr_flush_locked(struct sr_instance* sr);
+static int  sr_send_packet_locked(struct sr_instance* sr, uint8_t* buf,
+                                  unsigned int len, const char* iface);
+static void sr_vns_close(struct sr_instance* sr);
+static void sr_vns_print_stats(struct sr_instance* sr, FILE* out);
+
+const struct sr_transport_ops sr_vns_transport =
+{
+    "vns",
+    0,                          /* opened by sr_connect_to_server() */
+    sr_vns_read,
+    sr_send_packet_locked,
+    sr_flush_locked,
+    sr_vns_close,
+    sr_vns_print_stats
+};
 
 /*-----------------------------------------------------------------------------
  * Method: sr_session_closed_help(..)
@@ -106,24 +126,239 @@ int sr_handle_auth_status(struct sr_instance* sr, c_auth_status* status) {
  * Method: sr_read_from_server(..)
  * Scope: global
  *
- * Houses main while loop for communicating with the virtual router server.
+ * Houses main while loop for communicating with the virtual router server,
+ * or with whatever network sr->transport is attached to.
  *
  *---------------------------------------------------------------------------*/
 
 int sr_read_from_server(struct sr_instance* sr /* borrowed */)
+{
+    return sr->transport->read(sr);
+}
+
+static int sr_vns_read(struct sr_instance* sr /* borrowed */)
 {
     return sr_read_from_server_expect(sr, 0);
 }
 
-int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expected_cmd)
+static void sr_vns_close(struct sr_instance* sr /* borrowed */)
 {
-    
-    int command, len;
-    unsigned char *buf = 0;
-    c_packet_ethernet_header* sr_pkt = 0;
-    int ret = 0, bytes_read = 0;
+    if(sr->sockfd >= 0)
+    { close(sr->sockfd); }
+    sr->sockfd = -1;
+}
 
-    
+static void sr_vns_print_stats(struct sr_instance* sr /* borrowed */, FILE* out)
+{
+    fprintf(out, "sent %lu frames in %lu writes\n",
+            sr->txq.frames, sr->txq.writes);
+    fprintf(out, "received %lu messages in %lu reads\n",
+            sr->rx.msgs, sr->rx.recvs);
+}
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_dispatch_message(..)
+ * Scope: Local
+ *
+ * Handle one complete message from the server.  msg points into the
+ * receive ring and is only valid until this returns; the header fields
+ * are still in network byte order.  Returns 1 to keep going, 0 if the
+ * server closed the session and -1 on error.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_dispatch_message(struct sr_instance* sr /* borrowed */,
+                               uint8_t* msg /* lent */,
+                               int len,
+                               int expected_cmd)
+{
+    int command = ntohl(((c_base*)msg)->mType);
+    int ret = 1;
+    struct sr_if* iface;
+
+    /* make sure the command is what we expected if we were expecting something */
+    if(expected_cmd && command!=expected_cmd) {
+        if(command != VNSCLOSE) { /* VNSCLOSE is always ok */
+            fprintf(stderr, "Error: expected command %d but got %d\n", expected_cmd, command);
+            return -1;
+        }
+    }
+
+    switch (command)
+    {
+        /* -------------        VNSPACKET     -------------------- */
+
+        case VNSPACKET:
+            /* -- check if it is an ARP to another router if so drop   -- */
+            if ( sr_arp_req_not_for_us(sr,
+                        (msg+sizeof(c_packet_header)),
+                        len - sizeof(c_packet_header),
+                        (char*)(msg + sizeof(c_base))) )
+            { break; }
+
+            /* -- log packet -- */
+            sr_log_packet(sr, msg + sizeof(c_packet_header),
+                    len - sizeof(c_packet_header));
+
+            /* -- pass to router, the frame stays in the ring -- */
+            iface = sr_get_interface(sr, (char*)(msg + sizeof(c_base)));
+            if(iface == 0)
+            {
+                fprintf(stderr, "Dropping packet on unknown interface %.*s\n",
+                        (int)sizeof(((c_packet_header*)msg)->mInterfaceName),
+                        (char*)(msg + sizeof(c_base)));
+                break;
+            }
+            sr_handlepacket(sr,
+                    (msg+sizeof(c_packet_header)),
+                    len - sizeof(c_packet_header),
+                    iface->ifindex);
+
+            break;
+
+            /* -------------        VNSCLOSE      -------------------- */
+
+        case VNSCLOSE:
+            fprintf(stderr,"VNS server closed session.\n");
+            fprintf(stderr,"Reason: %s\n",((c_close*)msg)->mErrorMessage);
+            sr_session_closed_help();
+            return 0;
+
+            /* -------------        VNSBANNER      -------------------- */
+
+        case VNSBANNER:
+            fprintf(stderr,"%s",((c_banner*)msg)->mBannerMessage);
+            break;
+
+            /* -------------     VNSHWINFO     -------------------- */
+
+        case VNSHWINFO:
+            sr_handle_hwinfo(sr,(c_hwinfo*)msg);
+            if(sr_verify_routing_table(sr) != 0)
+            {
+                fprintf(stderr,"Routing table not consistent with hardware\n");
+                return -1;
+            }
+            printf(" <-- Ready to process packets --> \n");
+            break;
+
+            /* ---------------- VNS_RTABLE ---------------- */
+        case VNS_RTABLE:
+            if(!sr_handle_rtable(sr, (c_rtable*)msg))
+                ret = -1;
+            break;
+
+            /* ------------- VNS_AUTH_REQUEST ------------- */
+        case VNS_AUTH_REQUEST:
+            if(!sr_handle_auth_request(sr, (c_auth_request*)msg))
+                ret = -1;
+            break;
+
+            /* ------------- VNS_AUTH_STATUS -------------- */
+        case VNS_AUTH_STATUS:
+            if(!sr_handle_auth_status(sr, (c_auth_status*)msg))
+                ret = -1;
+            break;
+
+        default:
+            Debug("unknown command: %d\n", command);
+            break;
+    }/* -- switch -- */
+
+    return ret;
+} /* -- sr_dispatch_message -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_read_from_server_expect(..)
+ * Scope: Global
+ *
+ * Messages are received into sr->rx, a reusable buffer, with one recv()
+ * taking whatever the socket has.  Every complete message is then handled
+ * in place, so a packet costs neither an allocation nor a recv() of its
+ * own.  A partial message stays at the front of the buffer until the rest
+ * arrives; it is moved down only when too little room is left behind it.
+ *
+ * With expected_cmd set exactly one message is handled (and must be of
+ * that type), since the handshake answers each message before the next.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_read_from_server_expect(struct sr_instance* sr /* borrowed */, int expected_cmd)
+{
+    struct sr_rxbuf* rx = &(sr->rx);
+    uint8_t* msg;
+    unsigned int avail;
+    int len, ret;
+    int handled = 0;
+
+    /* REQUIRES */
+    assert(sr);
+
+    if(rx->buf == 0)
+    {
+        fprintf(stderr,"Error: no receive buffer (sr_read_from_server)\n");
+        return -1;
+    }
+
+    while(1)
+    {
+        /* -- handle whatever is complete -- */
+        while((avail = rx->tail - rx->head) >= sizeof(c_base))
+        {
+            msg = rx->buf + rx->head;
+            len = ntohl(((c_base*)msg)->mLen);
+
+            if ( len > SR_RX_MSG_MAX || len < (int)sizeof(c_base) )
+            {
+                fprintf(stderr,"Error: command length to large %d\n",len);
+                close(sr->sockfd);
+                return -1;
+            }
+            if ( (unsigned int)len > avail )
+            { break; }
+
+            rx->head += len;
+            rx->msgs++;
+            ret = sr_dispatch_message(sr, msg, len, expected_cmd);
+            if(ret != 1)
+            { return ret; }
+            handled++;
+
+            if(expected_cmd)
+            { return 1; }
+        }
+
+        if(handled)
+        { return 1; }
+
+        /* -- make room for at least one whole message behind the data -- */
+        if(rx->head == rx->tail)
+        { rx->head = rx->tail = 0; }
+        else if(SR_RX_BYTES - rx->tail < SR_RX_MSG_MAX)
+        {
+            memmove(rx->buf, rx->buf + rx->head, rx->tail - rx->head);
+            rx->tail -= rx->head;
+            rx->head = 0;
+        }
+
+        do
+        { /* -- just in case SIGALRM breaks recv -- */
+            ret = recv(sr->sockfd, rx->buf + rx->tail, SR_RX_BYTES - rx->tail, 0);
+        } while ( ret == -1 && errno == EINTR ); /* be mindful of signals */
+
+        if ( ret == -1 )
+        {
+            perror("recv(..):sr_client.c::sr_read_from_server");
+            return -1;
+        }
+        if ( ret == 0 )
+        {
+            fprintf(stderr,"Error: connection to server closed\n");
+            return -1;
+        }
+        rx->tail += ret;
+        rx->recvs++;
+    }
 }/* -- sr_read_from_server -- */
 
 /*-----------------------------------------------------------------------------
@@ -147,12 +382,151 @@ sr_ether_addrs_match_interface( struct sr_instance* sr, /* borrowed */
 
 } /* -- sr_ether_addrs_match_interface -- */
 
+/*-----------------------------------------------------------------------------
+ * Method: sr_write_all(..)
+ * Scope: Local
+ *
+ * writev() the iovecs completely, resuming after short writes.  Returns 0
+ * on success, -1 on error.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_write_all(struct sr_instance* sr, struct iovec* iov, int iovcnt)
+{
+    ssize_t n;
+
+    while(iovcnt > 0)
+    {
+        n = writev(sr->sockfd, iov, iovcnt);
+        if(n < 0)
+        {
+            if(errno == EINTR)
+            { continue; }
+            perror("writev(..):sr_vns_comm.c::sr_write_all");
+            return -1;
+        }
+        sr->txq.writes++;
+
+        while(iovcnt > 0 && (size_t)n >= iov->iov_len)
+        {
+            n -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if(iovcnt > 0)
+        {
+            iov->iov_base = (uint8_t*)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+} /* -- sr_write_all -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_flush_locked(..)
+ * Scope: Local
+ *
+ * Write out the transmit queue.  Caller holds sr->send_lock.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_flush_locked(struct sr_instance* sr)
+{
+    struct iovec iov;
+    int ret;
+
+    if(sr->txq.nframes == 0)
+    { return 0; }
+
+    iov.iov_base = sr->txq.buf;
+    iov.iov_len  = sr->txq.len;
+    ret = sr_write_all(sr, &iov, 1);
+
+    sr->txq.frames += sr->txq.nframes;
+    sr->txq.len = 0;
+    sr->txq.nframes = 0;
+    return ret;
+} /* -- sr_flush_locked -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_packet_locked(..)
+ * Scope: Local
+ *
+ * Queue one packet for the server, or write it straight away if it does
+ * not fit the queue.  Caller holds sr->send_lock.
+ *
+ *---------------------------------------------------------------------------*/
+
+static int sr_send_packet_locked(struct sr_instance* sr /* borrowed */,
+                                 uint8_t* buf /* borrowed */ ,
+                                 unsigned int len,
+                                 const char* iface /* borrowed */)
+{
+    c_packet_header hdr;
+    unsigned int total_len = len + sizeof(c_packet_header);
+    struct sr_txq* txq = &(sr->txq);
+    struct iovec iov[2];
+    uint64_t now;
+
+    /* REQUIRES */
+    assert(sr);
+    assert(buf);
+    assert(iface);
+
+    /* don't waste my time ... */
+    if ( len < sizeof(struct sr_ethernet_hdr) ) {
+        fprintf(stderr , "** Error: packet is wayy to short \n");
+        return -1;
+    }
+
+    /* -- ensure valid ethernet addresses -- */
+    if ( ! sr_ether_addrs_match_interface( sr, buf, iface) ) {
+        fprintf( stderr, "*** Error: problem with ethernet header, check log\n");
+        return -1;
+    }
+
+    /* -- log packet -- */
+    sr_log_packet(sr,buf,len);
+
+    hdr.mLen  = htonl(total_len);
+    hdr.mType = htonl(VNSPACKET);
+    strncpy(hdr.mInterfaceName,iface,16);
+
+    /* -- no queue, or a frame it cannot hold: header and frame in one writev -- */
+    if ( txq->buf == 0 || total_len > SR_TXQ_BYTES ) {
+        if ( sr_flush_locked(sr) != 0 )
+        { return -1; }
+        iov[0].iov_base = &hdr;
+        iov[0].iov_len  = sizeof(c_packet_header);
+        iov[1].iov_base = buf;
+        iov[1].iov_len  = len;
+        txq->frames++;
+        return sr_write_all(sr, iov, 2);
+    }
+
+    if ( txq->len + total_len > SR_TXQ_BYTES && sr_flush_locked(sr) != 0 )
+    { return -1; }
+
+    memcpy(txq->buf + txq->len, &hdr, sizeof(c_packet_header));
+    memcpy(txq->buf + txq->len + sizeof(c_packet_header), buf, len);
+    txq->len += total_len;
+
+    now = sr_timer_now_ms();
+    if ( txq->nframes++ == 0 )
+    { txq->first_ms = now; }
+    else if ( now - txq->first_ms >= SR_TXQ_LATENCY_MS )
+    { return sr_flush_locked(sr); }
+
+    return 0;
+} /* -- sr_send_packet_locked -- */
+
 /*-----------------------------------------------------------------------------
  * Method: sr_send_packet(..)
  * Scope: Global
  *
  * Send a packet (ethernet header included!) of length 'len' to the server
- * to be injected onto the wire.
+ * to be injected onto the wire.  The packet may sit in the transmit queue
+ * until the next sr_flush_packets(); buf is not referenced after return.
  *
  *---------------------------------------------------------------------------*/
 
@@ -161,10 +535,69 @@ int sr_send_packet(struct sr_instance* sr /* borrowed */,
                          unsigned int len,
                          const char* iface /* borrowed */)
 {
-    
-    return 0;
+    int ret;
+
+    /* -- forwarding workers send concurrently, keep frames whole -- */
+    pthread_mutex_lock(&(sr->send_lock));
+    ret = sr->transport->send(sr, buf, len, iface);
+    pthread_mutex_unlock(&(sr->send_lock));
+
+    return ret;
 } /* -- sr_send_packet -- */
 
+/*-----------------------------------------------------------------------------
+ * Method: sr_send_packet_burst(..)
+ * Scope: Global
+ *
+ * Send n packets out of the same interface, taking the send lock once.
+ * Returns 0 if all were sent, -1 if any failed.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_send_packet_burst(struct sr_instance* sr /* borrowed */,
+                         uint8_t** bufs /* borrowed */ ,
+                         unsigned int* lens,
+                         unsigned int n,
+                         const char* iface /* borrowed */)
+{
+    unsigned int i;
+    int ret = 0;
+
+    pthread_mutex_lock(&(sr->send_lock));
+    for(i = 0; i < n; i++)
+    {
+        if(sr->transport->send(sr, bufs[i], lens[i], iface) != 0)
+        { ret = -1; }
+    }
+    pthread_mutex_unlock(&(sr->send_lock));
+
+    return ret;
+} /* -- sr_send_packet_burst -- */
+
+/*-----------------------------------------------------------------------------
+ * Method: sr_flush_packets(..)
+ * Scope: Global
+ *
+ * Write everything in the transmit queue to the server (or out of the
+ * interfaces, for other transports).  Returns 0 on success, -1 on error.
+ *
+ *---------------------------------------------------------------------------*/
+
+int sr_flush_packets(struct sr_instance* sr /* borrowed */)
+{
+    int ret;
+
+    /* -- cheap check first, nothing to do most of the time -- */
+    if(__atomic_load_n(&(sr->txq.nframes), __ATOMIC_RELAXED) == 0)
+    { return 0; }
+
+    pthread_mutex_lock(&(sr->send_lock));
+    ret = sr->transport->flush(sr);
+    pthread_mutex_unlock(&(sr->send_lock));
+
+    return ret;
+} /* -- sr_flush_packets -- */
+
 /*-----------------------------------------------------------------------------
  * Method: sr_log_packet()
  * Scope: Local
@@ -0,0 +1,919 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_xdp.c
+ *
+ * Description:
+ *
+ * AF_XDP transport, see sr_xdp.h.  The XDP program is loaded with the
+ * bpf() system call directly, so no BPF library is needed.  Linux only;
+ * elsewhere opening it fails.
+ *
+ *---------------------------------------------------------------------------*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stddef.h>
+
+#include "sr_xdp.h"
+#include "sr_afpacket.h"
+#include "sr_transport.h"
+#include "sr_router.h"
+#include "sr_if.h"
+#include "sr_timer.h"
+
+#ifdef _LINUX_
+
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <net/if.h>
+#include <linux/if_xdp.h>
+#include <linux/if_link.h>
+#include <linux/bpf.h>
+#include <linux/ethtool.h>
+#include <linux/sockios.h>
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+#define SR_XDP_NO_FRAME   (~(uint64_t)0)
+#define SR_XDP_FRAME(a)   ((a) & ~(uint64_t)(SR_XDP_FRAME_SIZE - 1))
+#define SR_XDP_KICK_TRIES (SR_XDP_RING / 32 + 2) /* the kernel sends 32 per kick */
+
+static struct sr_xdp* sr_xdp(struct sr_instance* sr)
+{ return (struct sr_xdp*)sr->transport_priv; }
+
+static int sr_bpf(int cmd, union bpf_attr* attr)
+{ return (int)syscall(__NR_bpf, cmd, attr, sizeof(*attr)); }
+
+/* -- entries the producer may add / the consumer may take -- */
+static uint32_t sr_xdp_ring_free(struct sr_xdp_ring* r)
+{
+    return SR_XDP_RING - (*(r->producer) -
+                          __atomic_load_n(r->consumer, __ATOMIC_ACQUIRE));
+}
+
+static uint32_t sr_xdp_ring_avail(struct sr_xdp_ring* r)
+{ return __atomic_load_n(r->producer, __ATOMIC_ACQUIRE) - *(r->consumer); }
+
+/* -- free stack of UMEM frames; callers hold sr->send_lock -- */
+static void sr_xdp_push(struct sr_xdp* x, uint64_t addr)
+{ x->free_frames[x->nfree++] = SR_XDP_FRAME(addr); }
+
+static uint64_t sr_xdp_pop(struct sr_xdp* x)
+{ return x->nfree ? x->free_frames[--x->nfree] : SR_XDP_NO_FRAME; }
+
+/* -- the pbuf describing the frame holding UMEM offset addr -- */
+static struct sr_pbuf* sr_xdp_frame(struct sr_xdp* x, uint64_t addr)
+{ return &(x->frames[addr / SR_XDP_FRAME_SIZE]); }
+
+/* -- drop one reference to a frame, 1 if it was the last -- */
+static int sr_xdp_unref(struct sr_xdp* x, uint64_t addr)
+{
+    return __atomic_sub_fetch(&(sr_xdp_frame(x, addr)->refcnt), 1,
+                              __ATOMIC_ACQ_REL) == 0;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_xdp_release(..)
+ * Scope:  Local
+ *
+ * Release hook of the frame pbufs: the last reference was put outside
+ * the transport (a worker or the ARP queue dropped the frame), so the
+ * frame goes back on the free stack.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_xdp_release(struct sr_pbuf* pbuf)
+{
+    struct sr_instance* sr = (struct sr_instance*)pbuf->owner;
+    struct sr_xdp* x = sr_xdp(sr);
+
+    if(x == 0)
+    { return; }
+    pthread_mutex_lock(&(sr->send_lock));
+    sr_xdp_push(x, (uint64_t)(pbuf->head - x->umem));
+    pthread_mutex_unlock(&(sr->send_lock));
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_xdp_fill(..)
+ * Scope:  Local
+ *
+ * Give up to n frames to the kernel to receive into.  Returns how many
+ * went on the fill ring.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int sr_xdp_fill(struct sr_xdp_q* q, uint64_t* addrs,
+                                unsigned int n)
+{
+    uint32_t prod = *(q->fill.producer);
+    uint32_t room = sr_xdp_ring_free(&(q->fill));
+    unsigned int i;
+
+    if(n > room)
+    { n = room; }
+    for(i = 0; i < n; i++)
+    { ((uint64_t*)q->fill.descs)[(prod + i) & q->fill.mask] = addrs[i]; }
+    __atomic_store_n(q->fill.producer, prod + n, __ATOMIC_RELEASE);
+    q->fill_posted += n;
+    return n;
+}
+
+/* -- move finished transmissions back to the free stack; send_lock held -- */
+static void sr_xdp_reap(struct sr_xdp* x, struct sr_xdp_q* q)
+{
+    uint32_t cons = *(q->comp.consumer);
+    uint32_t n = sr_xdp_ring_avail(&(q->comp));
+    uint32_t i;
+
+    uint64_t addr;
+
+    for(i = 0; i < n; i++)
+    {
+        addr = ((uint64_t*)q->comp.descs)[(cons + i) & q->comp.mask];
+        if(sr_xdp_unref(x, addr))
+        { sr_xdp_push(x, addr); }
+    }
+    __atomic_store_n(q->comp.consumer, cons + n, __ATOMIC_RELEASE);
+    q->completions += n;
+    q->tx_inflight -= n;
+}
+
+/* -- have the kernel send what is on the transmit ring; send_lock held -- */
+static void sr_xdp_kick(struct sr_instance* sr, struct sr_xdp_q* q)
+{
+    int tries;
+    int ret = 0;
+
+    for(tries = 0; tries < SR_XDP_KICK_TRIES; tries++)
+    {
+        ret = sendto(q->fd, 0, 0, MSG_DONTWAIT, 0, 0);
+        q->kicks++;
+        sr->txq.writes++;
+        if(ret >= 0 || (errno != EAGAIN && errno != EBUSY && errno != EINTR))
+        { break; }
+    }
+    if(ret >= 0 || errno == ENOBUFS || errno == ENETDOWN)
+    { q->tx_pending = 0; }
+    else if(errno != EAGAIN && errno != EBUSY && errno != EINTR)
+    { perror("sendto(..):sr_xdp.c::sr_xdp_kick"); }
+}
+
+static int sr_xdp_map_ring(int fd, struct sr_xdp_ring* r,
+                           const struct xdp_ring_offset* off,
+                           size_t desc_size, uint64_t pgoff)
+{
+    uint8_t* map;
+
+    r->map_len = off->desc + SR_XDP_RING * desc_size;
+    map = (uint8_t*)mmap(0, r->map_len, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd, (off_t)pgoff);
+    if(map == MAP_FAILED)
+    {
+        perror("mmap(AF_XDP ring)");
+        r->map = 0;
+        return -1;
+    }
+    r->map      = map;
+    r->producer = (uint32_t*)(map + off->producer);
+    r->consumer = (uint32_t*)(map + off->consumer);
+    r->flags    = (uint32_t*)(map + off->flags);
+    r->descs    = map + off->desc;
+    r->mask     = SR_XDP_RING - 1;
+    return 0;
+}
+
+/* -- receive queues the driver uses, at least 1 -- */
+static unsigned int sr_xdp_nqueues(const char* name)
+{
+    struct ethtool_channels ch;
+    struct ifreq ifr;
+    unsigned int n = 1;
+    int fd;
+
+    fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if(fd < 0)
+    { return 1; }
+    memset(&ch, 0, sizeof(ch));
+    memset(&ifr, 0, sizeof(ifr));
+    ch.cmd = ETHTOOL_GCHANNELS;
+    strncpy(ifr.ifr_name, name, IFNAMSIZ - 1);
+    ifr.ifr_data = (void*)&ch;
+    if(ioctl(fd, SIOCETHTOOL, &ifr) == 0)
+    {
+        n = (ch.combined_count > ch.rx_count) ? ch.combined_count : ch.rx_count;
+        if(n == 0)
+        { n = 1; }
+    }
+    close(fd);
+
+    if(n > SR_XDP_MAX_QUEUES)
+    {
+        fprintf(stderr, "xdp: %s has %u queues, using %d; frames on the "
+                "others go to the kernel\n", name, n, SR_XDP_MAX_QUEUES);
+        n = SR_XDP_MAX_QUEUES;
+    }
+    return n;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_xdp_open_q(..)
+ * Scope:  Local
+ *
+ * Create the socket for one receive queue, on the shared UMEM (which the
+ * first socket registers), bind it and give it its first frames.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_xdp_open_q(struct sr_xdp* x, struct sr_xdp_if* xif,
+                         struct sr_xdp_q* q, unsigned int queue)
+{
+    struct xdp_umem_reg reg;
+    struct xdp_mmap_offsets off;
+    struct sockaddr_xdp sxdp;
+    struct epoll_event ev;
+    union bpf_attr attr;
+    uint64_t addrs[SR_XDP_RING / 2];
+    socklen_t optlen = sizeof(off);
+    int ndesc = SR_XDP_RING;
+    int first = (q == &(x->qs[0]));
+    unsigned int i;
+
+    q->fd = socket(AF_XDP, SOCK_RAW | SOCK_CLOEXEC, 0);
+    if(q->fd < 0)
+    {
+        perror("socket(AF_XDP)");
+        return -1;
+    }
+    q->ifidx = xif - x->ifs;
+    q->queue = queue;
+
+    if(first)
+    {
+        memset(&reg, 0, sizeof(reg));
+        reg.addr       = (uint64_t)(uintptr_t)x->umem;
+        reg.len        = x->umem_len;
+        reg.chunk_size = SR_XDP_FRAME_SIZE;
+        reg.headroom   = 0;
+        if(setsockopt(q->fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) != 0)
+        {
+            perror("setsockopt(XDP_UMEM_REG)");
+            return -1;
+        }
+    }
+
+    /* -- every socket has its own fill and completion ring on the UMEM -- */
+    if(setsockopt(q->fd, SOL_XDP, XDP_UMEM_FILL_RING, &ndesc, sizeof(ndesc)) != 0 ||
+       setsockopt(q->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ndesc, sizeof(ndesc)) != 0 ||
+       setsockopt(q->fd, SOL_XDP, XDP_RX_RING, &ndesc, sizeof(ndesc)) != 0 ||
+       setsockopt(q->fd, SOL_XDP, XDP_TX_RING, &ndesc, sizeof(ndesc)) != 0)
+    {
+        perror("setsockopt(AF_XDP rings)");
+        return -1;
+    }
+    if(getsockopt(q->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) != 0)
+    {
+        perror("getsockopt(XDP_MMAP_OFFSETS)");
+        return -1;
+    }
+    if(sr_xdp_map_ring(q->fd, &(q->rx), &(off.rx), sizeof(struct xdp_desc),
+                       XDP_PGOFF_RX_RING) != 0 ||
+       sr_xdp_map_ring(q->fd, &(q->tx), &(off.tx), sizeof(struct xdp_desc),
+                       XDP_PGOFF_TX_RING) != 0 ||
+       sr_xdp_map_ring(q->fd, &(q->fill), &(off.fr), sizeof(uint64_t),
+                       XDP_UMEM_PGOFF_FILL_RING) != 0 ||
+       sr_xdp_map_ring(q->fd, &(q->comp), &(off.cr), sizeof(uint64_t),
+                       XDP_UMEM_PGOFF_COMPLETION_RING) != 0)
+    { return -1; }
+
+    /* -- zero-copy if the driver can, copy mode otherwise -- */
+    memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family   = AF_XDP;
+    sxdp.sxdp_ifindex  = xif->os_ifindex;
+    sxdp.sxdp_queue_id = queue;
+    if(first)
+    { sxdp.sxdp_flags = XDP_USE_NEED_WAKEUP; }
+    else
+    {
+        /* -- sharers may not pass flags, they inherit the first one's -- */
+        sxdp.sxdp_flags = XDP_SHARED_UMEM;
+        sxdp.sxdp_shared_umem_fd = x->qs[0].fd;
+    }
+    if(bind(q->fd, (struct sockaddr*)&sxdp, sizeof(sxdp)) != 0)
+    {
+        perror("bind(AF_XDP)");
+        return -1;
+    }
+
+    for(i = 0; i < SR_XDP_RING / 2; i++)
+    { addrs[i] = sr_xdp_pop(x); }
+    sr_xdp_fill(q, addrs, SR_XDP_RING / 2);
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = xif->map_fd;
+    attr.key    = (uint64_t)(uintptr_t)&queue;
+    attr.value  = (uint64_t)(uintptr_t)&(q->fd);
+    if(sr_bpf(BPF_MAP_UPDATE_ELEM, &attr) != 0)
+    {
+        perror("bpf(BPF_MAP_UPDATE_ELEM)");
+        return -1;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = q - x->qs;
+    if(epoll_ctl(x->epfd, EPOLL_CTL_ADD, q->fd, &ev) != 0)
+    {
+        perror("epoll_ctl");
+        return -1;
+    }
+    return 0;
+} /* -- sr_xdp_open_q -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_xdp_attach(..)
+ * Scope:  Local
+ *
+ * Load the program that sends every frame to the socket of the queue it
+ * arrived on (or to the kernel if that queue has none) and attach it to
+ * the interface, in driver mode if possible and generic mode if not.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_xdp_attach(struct sr_xdp_if* xif)
+{
+    struct bpf_insn prog[] =
+    {
+        /* r2 = ctx->rx_queue_index */
+        { BPF_LDX | BPF_MEM | BPF_W, 2, 1, offsetof(struct xdp_md, rx_queue_index), 0 },
+        /* r1 = map */
+        { BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, 0 },
+        { 0, 0, 0, 0, 0 },
+        /* return bpf_redirect_map(r1, r2, XDP_PASS) */
+        { BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS },
+        { BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map },
+        { BPF_JMP | BPF_EXIT, 0, 0, 0, 0 }
+    };
+    union bpf_attr attr;
+
+    prog[1].imm = xif->map_fd;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insns     = (uint64_t)(uintptr_t)prog;
+    attr.insn_cnt  = sizeof(prog) / sizeof(prog[0]);
+    attr.license   = (uint64_t)(uintptr_t)"GPL";
+    xif->prog_fd = sr_bpf(BPF_PROG_LOAD, &attr);
+    if(xif->prog_fd < 0)
+    {
+        perror("bpf(BPF_PROG_LOAD)");
+        return -1;
+    }
+
+    memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd        = xif->prog_fd;
+    attr.link_create.target_ifindex = xif->os_ifindex;
+    attr.link_create.attach_type    = BPF_XDP;
+    attr.link_create.flags          = XDP_FLAGS_DRV_MODE;
+    xif->link_fd = sr_bpf(BPF_LINK_CREATE, &attr);
+    if(xif->link_fd < 0)
+    {
+        attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+        xif->link_fd = sr_bpf(BPF_LINK_CREATE, &attr);
+        xif->skb_mode = 1;
+    }
+    if(xif->link_fd < 0)
+    {
+        fprintf(stderr, "xdp: cannot attach to %s: %s\n", xif->name,
+                strerror(errno));
+        return -1;
+    }
+    return 0;
+} /* -- sr_xdp_attach -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_xdp_open(..)
+ * Scope:  Local
+ *
+ * arg is a comma separated list of interfaces, or 0 for every
+ * non-loopback interface that is up and has an IPv4 address.  The
+ * interfaces and their queues are counted first, since the UMEM has to
+ * be registered, at its final size, before the first socket is bound.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_xdp_close(struct sr_instance* sr);
+
+static int sr_xdp_open(struct sr_instance* sr, const char* arg)
+{
+    struct sr_xdp* x;
+    struct sr_xdp_if* xif;
+    char names[SR_XDP_MAX_IFS][sr_IFACE_NAMELEN];
+    struct sr_kif kifs[SR_XDP_MAX_IFS];
+    union bpf_attr attr;
+    unsigned int nframes, i, k;
+    int n, ret;
+
+    assert(sr);
+    if(sr->if_list)
+    {
+        fprintf(stderr, "xdp: interface list already set up\n");
+        return -1;
+    }
+    n = sr_afp_if_names(arg, names, SR_XDP_MAX_IFS);
+    if(n < 0)
+    { return -1; }
+
+    x = (struct sr_xdp*)calloc(1, sizeof(struct sr_xdp));
+    if(x == 0)
+    { return -1; }
+    for(i = 0; i < SR_XDP_MAX_IFS; i++)
+    { x->ifs[i].map_fd = x->ifs[i].prog_fd = x->ifs[i].link_fd = -1; }
+    for(i = 0; i < SR_XDP_MAX_QS; i++)
+    { x->qs[i].fd = -1; }
+    x->epfd = epoll_create1(EPOLL_CLOEXEC);
+    sr->transport_priv = x;
+    sr->sockfd = x->epfd;
+    if(x->epfd < 0)
+    {
+        perror("epoll_create1");
+        goto fail;
+    }
+
+    /* -- interfaces and queues -- */
+    for(i = 0; i < (unsigned int)n; i++)
+    {
+        ret = sr_afp_kernel_if(names[i], &(kifs[x->nifs]));
+        if(ret == 1 && !(arg && *arg))
+        { continue; }
+        if(ret == 1)
+        { fprintf(stderr, "xdp: %s is not Ethernet with an IPv4 address\n", names[i]); }
+        if(ret != 0)
+        { goto fail; }
+        xif = &(x->ifs[x->nifs++]);
+        strncpy(xif->name, names[i], sr_IFACE_NAMELEN);
+        xif->os_ifindex = kifs[x->nifs - 1].os_ifindex;
+        xif->first_q = x->nqs;
+        xif->nqueues = sr_xdp_nqueues(xif->name);
+        x->nqs += xif->nqueues;
+    }
+    if(x->nifs == 0)
+    {
+        fprintf(stderr, "xdp: no usable interfaces\n");
+        goto fail;
+    }
+
+    /* -- the UMEM, every frame free to begin with -- */
+    nframes = x->nqs * SR_XDP_FRAMES_PER_Q;
+    x->umem_len = (size_t)nframes * SR_XDP_FRAME_SIZE;
+    x->umem = (uint8_t*)mmap(0, x->umem_len, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    x->free_frames = (uint64_t*)malloc(nframes * sizeof(uint64_t));
+    x->frames = (struct sr_pbuf*)calloc(nframes, sizeof(struct sr_pbuf));
+    if(x->umem == MAP_FAILED || x->free_frames == 0 || x->frames == 0)
+    {
+        fprintf(stderr, "xdp: cannot allocate %lu byte UMEM\n",
+                (unsigned long)x->umem_len);
+        if(x->umem == MAP_FAILED)
+        { x->umem = 0; }
+        goto fail;
+    }
+    for(i = nframes; i > 0; i--)
+    { sr_xdp_push(x, (uint64_t)(i - 1) * SR_XDP_FRAME_SIZE); }
+    for(i = 0; i < nframes; i++)
+    {
+        x->frames[i].head    = x->umem + (size_t)i * SR_XDP_FRAME_SIZE;
+        x->frames[i].size    = SR_XDP_FRAME_SIZE;
+        x->frames[i].pool    = &(sr->pbufs);
+        x->frames[i].release = sr_xdp_release;
+        x->frames[i].owner   = sr;
+    }
+
+    for(i = 0; i < x->nifs; i++)
+    {
+        xif = &(x->ifs[i]);
+
+        memset(&attr, 0, sizeof(attr));
+        attr.map_type    = BPF_MAP_TYPE_XSKMAP;
+        attr.key_size    = sizeof(uint32_t);
+        attr.value_size  = sizeof(int);
+        attr.max_entries = SR_XDP_MAX_QUEUES;
+        xif->map_fd = sr_bpf(BPF_MAP_CREATE, &attr);
+        if(xif->map_fd < 0)
+        {
+            perror("bpf(BPF_MAP_CREATE)");
+            goto fail;
+        }
+
+        for(k = 0; k < xif->nqueues; k++)
+        {
+            if(sr_xdp_open_q(x, xif, &(x->qs[xif->first_q + k]), k) != 0)
+            { goto fail; }
+        }
+        if(sr_xdp_attach(xif) != 0)
+        { goto fail; }
+
+        /* -- position in if_list is the index into x->ifs -- */
+        sr_add_interface(sr, xif->name);
+        sr_set_ether_addr(sr, kifs[i].addr);
+        sr_set_ether_ip(sr, kifs[i].ip);
+        sr_set_ether_mask(sr, kifs[i].mask);
+        sr_add_interface_status(sr, xif->name);
+    }
+
+    printf("xdp: %u interfaces, %u queues, %u UMEM frames\n",
+           x->nifs, x->nqs, nframes);
+    sr_print_if_list(sr);
+    return 0;
+
+fail:
+    sr_xdp_close(sr);
+    return -1;
+} /* -- sr_xdp_open -- */
+
+static void sr_xdp_unmap(struct sr_xdp_ring* r)
+{
+    if(r->map)
+    { munmap(r->map, r->map_len); }
+    r->map = 0;
+}
+
+static void sr_xdp_close(struct sr_instance* sr)
+{
+    struct sr_xdp* x = sr_xdp(sr);
+    unsigned int i;
+
+    if(x == 0)
+    { return; }
+
+    /* -- detach first so the kernel stops redirecting to the sockets -- */
+    for(i = 0; i < SR_XDP_MAX_IFS; i++)
+    {
+        if(x->ifs[i].link_fd >= 0)
+        { close(x->ifs[i].link_fd); }
+        if(x->ifs[i].prog_fd >= 0)
+        { close(x->ifs[i].prog_fd); }
+        if(x->ifs[i].map_fd >= 0)
+        { close(x->ifs[i].map_fd); }
+    }
+    for(i = 0; i < SR_XDP_MAX_QS; i++)
+    {
+        sr_xdp_unmap(&(x->qs[i].rx));
+        sr_xdp_unmap(&(x->qs[i].tx));
+        sr_xdp_unmap(&(x->qs[i].fill));
+        sr_xdp_unmap(&(x->qs[i].comp));
+        if(x->qs[i].fd >= 0)
+        { close(x->qs[i].fd); }
+    }
+    if(x->umem)
+    { munmap(x->umem, x->umem_len); }
+    free(x->free_frames);
+    free(x->frames);
+    if(x->epfd >= 0)
+    { close(x->epfd); }
+    free(x);
+    sr->transport_priv = 0;
+    sr->sockfd = -1;
+}
+
+/*---------------------------------------------------------------------
+ * Method: sr_xdp_rx(..)
+ * Scope:  Local
+ *
+ * Handle up to SR_XDP_BATCH frames from one receive ring in place, each
+ * lent to the router as the pbuf of its frame.  Frames nobody kept a
+ * reference to go straight back on the fill ring; it is topped up from
+ * the free stack when it runs low.  Returns the number of frames
+ * handled.
+ *
+ *---------------------------------------------------------------------*/
+
+static unsigned int sr_xdp_rx(struct sr_instance* sr, struct sr_xdp* x,
+                              struct sr_xdp_q* q)
+{
+    struct xdp_desc* d;
+    struct sr_pbuf* f;
+    uint64_t recycle[SR_XDP_BATCH];
+    uint32_t cons = *(q->rx.consumer);
+    uint32_t n = sr_xdp_ring_avail(&(q->rx));
+    uint32_t level;
+    unsigned int i, nrec = 0, posted;
+
+    if(n == 0)
+    { return 0; }
+    if(n > SR_XDP_BATCH)
+    { n = SR_XDP_BATCH; }
+
+    for(i = 0; i < n; i++)
+    {
+        d = &(((struct xdp_desc*)q->rx.descs)[(cons + i) & q->rx.mask]);
+        f = sr_xdp_frame(x, d->addr);
+        f->data   = x->umem + d->addr;
+        f->len    = d->len;
+        f->refcnt = 1;
+        f->next   = 0;
+        sr_receive_pbuf(sr, f, q->ifidx);
+        if(sr_xdp_unref(x, d->addr))
+        { recycle[nrec++] = SR_XDP_FRAME(d->addr); }
+    }
+    __atomic_store_n(q->rx.consumer, cons + n, __ATOMIC_RELEASE);
+    q->rx_frames += n;
+
+    posted = sr_xdp_fill(q, recycle, nrec);
+    level = SR_XDP_RING - sr_xdp_ring_free(&(q->fill));
+    if(posted < nrec || level < SR_XDP_RING / 4)
+    {
+        pthread_mutex_lock(&(sr->send_lock));
+        for(i = posted; i < nrec; i++)
+        { sr_xdp_push(x, recycle[i]); }
+        nrec = 0;
+        while(level + nrec < SR_XDP_RING / 2 && nrec < SR_XDP_BATCH && x->nfree)
+        { recycle[nrec++] = sr_xdp_pop(x); }
+        pthread_mutex_unlock(&(sr->send_lock));
+        sr_xdp_fill(q, recycle, nrec);
+    }
+
+    if(__atomic_load_n(q->fill.flags, __ATOMIC_RELAXED) & XDP_RING_NEED_WAKEUP)
+    { recvfrom(q->fd, 0, 0, MSG_DONTWAIT, 0, 0); }
+    return n;
+} /* -- sr_xdp_rx -- */
+
+static int sr_xdp_read(struct sr_instance* sr)
+{
+    struct sr_xdp* x = sr_xdp(sr);
+    struct epoll_event evs[SR_XDP_MAX_QS];
+    unsigned int i, handled;
+    int timeout = sr->event_loop ? 0 : -1; /* the event loop already waited */
+    int n, k;
+
+    while(1)
+    {
+        handled = 0;
+        for(i = 0; i < x->nqs; i++)
+        { handled += sr_xdp_rx(sr, x, &(x->qs[i])); }
+        if(handled)
+        { return 1; }
+
+        n = epoll_wait(x->epfd, evs, SR_XDP_MAX_QS, timeout);
+        if(n < 0 && errno == EINTR)
+        { continue; }
+        if(n < 0)
+        {
+            perror("epoll_wait");
+            return -1;
+        }
+        for(k = 0; k < n; k++)
+        {
+            if(evs[k].events & (EPOLLERR | EPOLLHUP))
+            {
+                fprintf(stderr, "xdp: interface %s went away\n",
+                        x->ifs[x->qs[evs[k].data.u32].ifidx].name);
+                return 0;
+            }
+        }
+        if(sr->event_loop)
+        { return 1; }
+    }
+} /* -- sr_xdp_read -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_xdp_flush(..)
+ * Scope:  Local
+ *
+ * Kick every socket with frames on its transmit ring and collect the
+ * frames the kernel is done with.  Caller holds sr->send_lock.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_xdp_flush(struct sr_instance* sr)
+{
+    struct sr_xdp* x = sr_xdp(sr);
+    unsigned int i, pending = 0;
+
+    for(i = 0; i < x->nqs; i++)
+    {
+        if(x->qs[i].tx_pending)
+        { sr_xdp_kick(sr, &(x->qs[i])); }
+        if(x->qs[i].tx_inflight)
+        { sr_xdp_reap(x, &(x->qs[i])); }
+        pending += x->qs[i].tx_pending;
+    }
+
+    /* -- whatever the kernel did not take yet goes with the next kick -- */
+    sr->txq.frames += sr->txq.nframes - pending;
+    sr->txq.nframes = pending;
+    return 0;
+} /* -- sr_xdp_flush -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_xdp_send(..)
+ * Scope:  Local
+ *
+ * Put one frame on the transmit ring of iface.  A frame the router is
+ * forwarding goes out of the UMEM frame it arrived in, which the
+ * transmit ring takes a reference to; anything else is copied into a
+ * free frame.  Caller holds sr->send_lock.
+ *
+ *---------------------------------------------------------------------*/
+
+static int sr_xdp_send(struct sr_instance* sr, uint8_t* buf, unsigned int len,
+                       const char* iface)
+{
+    struct sr_xdp* x = sr_xdp(sr);
+    struct sr_txq* txq = &(sr->txq);
+    struct sr_if* sr_iface;
+    struct sr_xdp_q* q;
+    struct xdp_desc* d;
+    struct sr_pbuf* f = 0;
+    uintptr_t off = (uintptr_t)buf - (uintptr_t)x->umem;
+    uint64_t addr;
+    uint32_t prod;
+    uint64_t now;
+    unsigned int i;
+
+    assert(buf);
+    assert(iface);
+
+    if(len < sizeof(struct sr_ethernet_hdr) || len > SR_XDP_FRAME_SIZE)
+    {
+        fprintf(stderr , "** Error: packet length %u out of range \n", len);
+        return -1;
+    }
+    sr_iface = sr_get_interface(sr, iface);
+    if(sr_iface == 0 || sr_iface->ifindex >= x->nifs)
+    {
+        fprintf(stderr, "xdp: no interface %s\n", iface);
+        return -1;
+    }
+    q = &(x->qs[x->ifs[sr_iface->ifindex].first_q]);
+
+    if(sr_xdp_ring_free(&(q->tx)) == 0)
+    {
+        sr_xdp_kick(sr, q);
+        sr_xdp_reap(x, q);
+        if(sr_xdp_ring_free(&(q->tx)) == 0)
+        {
+            q->tx_dropped++;
+            return -1;
+        }
+    }
+
+    if((uintptr_t)buf >= (uintptr_t)x->umem && off < x->umem_len)
+    { f = sr_xdp_frame(x, off); }
+    if(f && __atomic_load_n(&(f->refcnt), __ATOMIC_ACQUIRE) > 0 &&
+       off - SR_XDP_FRAME(off) + len <= SR_XDP_FRAME_SIZE)
+    {
+        /* -- forwarded in place: the tx ring holds the frame until done -- */
+        addr = off;
+        __atomic_fetch_add(&(f->refcnt), 1, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        if(x->nfree == 0)
+        {
+            for(i = 0; i < x->nqs; i++)
+            { sr_xdp_reap(x, &(x->qs[i])); }
+        }
+        addr = sr_xdp_pop(x);
+        if(addr == SR_XDP_NO_FRAME)
+        {
+            q->tx_dropped++;
+            return -1;
+        }
+        memcpy(x->umem + addr, buf, len);
+        sr_xdp_frame(x, addr)->refcnt = 1;
+        q->tx_copied++;
+    }
+
+    prod = *(q->tx.producer);
+    d = &(((struct xdp_desc*)q->tx.descs)[prod & q->tx.mask]);
+    d->addr = addr;
+    d->len = len;
+    d->options = 0;
+    __atomic_store_n(q->tx.producer, prod + 1, __ATOMIC_RELEASE);
+    q->tx_pending++;
+    q->tx_inflight++;
+    q->tx_frames++;
+
+    now = sr_timer_now_ms();
+    if(txq->nframes++ == 0)
+    { txq->first_ms = now; }
+    else if(now - txq->first_ms >= SR_TXQ_LATENCY_MS)
+    { return sr_xdp_flush(sr); }
+
+    return 0;
+} /* -- sr_xdp_send -- */
+
+/*---------------------------------------------------------------------
+ * Method: sr_xdp_print_stats(..)
+ * Scope:  Local
+ *
+ * One line per queue: what the router moved through its rings, then the
+ * kernel's own drop counters for the socket.
+ *
+ *---------------------------------------------------------------------*/
+
+static void sr_xdp_print_stats(struct sr_instance* sr, FILE* out)
+{
+    struct sr_xdp* x = sr_xdp(sr);
+    struct sr_xdp_q* q;
+    struct xdp_statistics ks;
+    struct xdp_options opts;
+    socklen_t len;
+    unsigned int i;
+
+    if(x == 0)
+    { return; }
+
+    pthread_mutex_lock(&(sr->send_lock));
+    fprintf(out, "%-8s %5s %-8s %10s %10s %10s %8s %10s %10s %8s %8s %8s %8s %8s\n",
+            "iface", "queue", "mode", "rx", "tx", "tx copied", "tx drop",
+            "fill", "completed", "kicks", "k drop", "k rxfull", "k fillemp",
+            "k txinv");
+    for(i = 0; i < x->nqs; i++)
+    {
+        q = &(x->qs[i]);
+        memset(&ks, 0, sizeof(ks));
+        len = sizeof(ks);
+        getsockopt(q->fd, SOL_XDP, XDP_STATISTICS, &ks, &len);
+        memset(&opts, 0, sizeof(opts));
+        len = sizeof(opts);
+        getsockopt(q->fd, SOL_XDP, XDP_OPTIONS, &opts, &len);
+
+        fprintf(out, "%-8s %5u %-8s %10lu %10lu %10lu %8lu %10lu %10lu %8lu "
+                "%8llu %8llu %8llu %8llu\n",
+                x->ifs[q->ifidx].name, q->queue,
+                (opts.flags & XDP_OPTIONS_ZEROCOPY) ? "zc" :
+                (x->ifs[q->ifidx].skb_mode ? "copy/skb" : "copy"),
+                q->rx_frames, q->tx_frames, q->tx_copied, q->tx_dropped,
+                q->fill_posted, q->completions, q->kicks,
+                (unsigned long long)ks.rx_dropped,
+                (unsigned long long)ks.rx_ring_full,
+                (unsigned long long)ks.rx_fill_ring_empty_descs,
+                (unsigned long long)ks.tx_invalid_descs);
+    }
+    fprintf(out, "UMEM: %lu frames, %u free\n",
+            (unsigned long)(x->umem_len / SR_XDP_FRAME_SIZE), x->nfree);
+    fprintf(out, "sent %lu frames in %lu writes\n",
+            sr->txq.frames, sr->txq.writes);
+    pthread_mutex_unlock(&(sr->send_lock));
+} /* -- sr_xdp_print_stats -- */
+
+const struct sr_transport_ops sr_xdp_transport =
+{
+    "xdp",
+    sr_xdp_open,
+    sr_xdp_read,
+    sr_xdp_send,
+    sr_xdp_flush,
+    sr_xdp_close,
+    sr_xdp_print_stats
+};
+
+#else /* -- no AF_XDP -- */
+
+static int sr_xdp_open(struct sr_instance* sr, const char* arg)
+{
+    fprintf(stderr, "xdp transport needs Linux\n");
+    return -1;
+}
+
+static int sr_xdp_read(struct sr_instance* sr)
+{ return -1; }
+
+static int sr_xdp_send(struct sr_instance* sr, uint8_t* buf, unsigned int len,
+                       const char* iface)
+{ return -1; }
+
+static int sr_xdp_flush(struct sr_instance* sr)
+{ return 0; }
+
+static void sr_xdp_close(struct sr_instance* sr)
+{ }
+
+static void sr_xdp_print_stats(struct sr_instance* sr, FILE* out)
+{ }
+
+const struct sr_transport_ops sr_xdp_transport =
+{
+    "xdp",
+    sr_xdp_open,
+    sr_xdp_read,
+    sr_xdp_send,
+    sr_xdp_flush,
+    sr_xdp_close,
+    sr_xdp_print_stats
+};
+
+#endif /* _LINUX_ */
@@ -0,0 +1,119 @@
+/*-----------------------------------------------------------------------------
+ * file:  sr_xdp.h
+ *
+ * Description:
+ *
+ * AF_XDP transport.  A small XDP program on each interface redirects
+ * every frame to an AF_XDP socket, one per receive queue.  All the sockets
+ * share one UMEM, which is the buffer pool for every frame the transport
+ * receives or sends: a received frame is handled in place, and when the
+ * router forwards it the same UMEM frame is put on the transmit ring of
+ * the outgoing interface, so forwarding never copies the payload.  Only
+ * frames the router builds itself are copied into a free UMEM frame.
+ *
+ * The kernel uses zero-copy mode where the driver supports it and copy
+ * mode elsewhere (veth, or any interface with a generic XDP program), so
+ * the transport works on a plain Linux box.  Needs CAP_NET_ADMIN and
+ * CAP_BPF (or root), and a 5.10 or later kernel for sharing the UMEM
+ * between interfaces.
+ *
+ * Frame ownership: a frame is in exactly one of the fill ring, the
+ * kernel, the receive ring, the free stack, or in use.  A frame in use
+ * is described by its own pbuf (sr_pbuf.h) and is counted by that
+ * pbuf's references: one while the receive path handles it, one for
+ * each worker ring or ARP queue entry holding it, and one for each trip
+ * on a transmit ring until it comes back on the completion ring.  The
+ * last reference returns it to the fill ring or the free stack, so
+ * frames handed to forwarding workers or queued for ARP are sent from
+ * the UMEM without being copied either.
+ *
+ *---------------------------------------------------------------------------*/
+
+#ifndef sr_XDP_H
+#define sr_XDP_H
+
+#ifdef _LINUX_
+#include <stdint.h>
+#endif /* _LINUX_ */
+
+#include "sr_protocol.h"
+#include "sr_pbuf.h"
+
+#define SR_XDP_MAX_IFS      16
+#define SR_XDP_MAX_QUEUES   8     /* receive queues used per interface */
+#define SR_XDP_MAX_QS       (SR_XDP_MAX_IFS * SR_XDP_MAX_QUEUES)
+#define SR_XDP_RING         2048  /* entries in each ring, a power of two */
+#define SR_XDP_FRAME_SIZE   2048  /* UMEM chunk */
+#define SR_XDP_FRAMES_PER_Q (2 * SR_XDP_RING)
+#define SR_XDP_BATCH        64    /* frames taken off a receive ring at once */
+
+struct sr_instance;
+
+/* -- one of the four rings of a socket, mmap()ed from the kernel -- */
+struct sr_xdp_ring
+{
+    uint32_t* producer;
+    uint32_t* consumer;
+    uint32_t* flags;
+    void* descs;              /* struct xdp_desc, or uint64_t UMEM addresses */
+    uint32_t mask;
+    void* map;
+    size_t map_len;
+};
+
+/* ----------------------------------------------------------------------------
+ * struct sr_xdp_q
+ *
+ * The AF_XDP socket for one receive queue of one interface.  The first
+ * queue of each interface also transmits everything leaving on it.
+ *
+ * -------------------------------------------------------------------------- */
+
+struct sr_xdp_q
+{
+    int fd;
+    unsigned int ifidx;       /* index into sr_xdp.ifs */
+    unsigned int queue;
+    struct sr_xdp_ring rx;
+    struct sr_xdp_ring tx;
+    struct sr_xdp_ring fill;
+    struct sr_xdp_ring comp;
+    unsigned int tx_pending;  /* on the transmit ring, not kicked yet */
+    unsigned int tx_inflight; /* on the transmit ring, not completed yet */
+
+    unsigned long rx_frames;
+    unsigned long tx_frames;
+    unsigned long tx_copied;  /* built by the router, not forwarded in place */
+    unsigned long tx_dropped; /* transmit ring or UMEM full */
+    unsigned long fill_posted;
+    unsigned long completions;
+    unsigned long kicks;
+};
+
+struct sr_xdp_if
+{
+    char name[sr_IFACE_NAMELEN];
+    int os_ifindex;
+    int map_fd;               /* XSKMAP: receive queue -> socket */
+    int prog_fd;
+    int link_fd;              /* closing it detaches the program */
+    int skb_mode;             /* program runs in generic mode */
+    unsigned int first_q;     /* index into sr_xdp.qs */
+    unsigned int nqueues;
+};
+
+struct sr_xdp
+{
+    int epfd;                 /* all the sockets; sr->sockfd */
+    uint8_t* umem;
+    size_t umem_len;
+    uint64_t* free_frames;    /* free stack, under sr->send_lock */
+    unsigned int nfree;
+    struct sr_pbuf* frames;   /* one per UMEM frame, in use while refcnt > 0 */
+    unsigned int nifs;
+    unsigned int nqs;
+    struct sr_xdp_if ifs[SR_XDP_MAX_IFS];
+    struct sr_xdp_q qs[SR_XDP_MAX_QS];
+};
+
+#endif  /* --  sr_XDP_H -- */